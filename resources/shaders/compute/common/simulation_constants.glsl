@@ -0,0 +1,14 @@
+// Constants of the simulation a kernel is compiled for. GPU_Simulation injects
+// them as #defines (see GPU_Simulation::GetShaderDefines()) so that the grid
+// indexing and fixed point math fold into constants instead of reading uniforms.
+#if !defined(GRID_DIM) || !defined(WS_GRID_INTERVAL) || !defined(TEXTURE_PRECISION)
+#error "simulation_constants.glsl needs the defines of GPU_Simulation"
+#endif
+
+const uint grid_dim = GRID_DIM;
+const float ws_grid_interval = WS_GRID_INTERVAL;
+const vec3 ws_lower_bound = vec3(WS_LOWER_BOUND);
+const vec3 ws_upper_bound = vec3(WS_UPPER_BOUND);
+const vec3 ws_particle_lower_bound = vec3(WS_PARTICLE_LOWER_BOUND);
+const vec3 ws_particle_upper_bound = vec3(WS_PARTICLE_UPPER_BOUND);
+const float texture_precision = TEXTURE_PRECISION;
@@ -0,0 +1,126 @@
+#version 430
+
+// Draws one arrow per instance from just the vector it shows. The orientation and
+// scale that used to be a model matrix per arrow are built here instead.
+
+layout(location = 0) in vec3 ls_vert;   // The arrow model, pointing along +y with unit length
+#ifdef SIM_TEXTURES
+// The velocities and particle positions are read from the textures of GPU_Simulation
+// instead, which hold fixed point values (GPU_Simulation::GetFieldTextures())
+uniform isampler3D grid_vel_x;
+uniform isampler3D grid_vel_y;
+uniform isampler3D grid_vel_z;
+uniform isampler2D particle_pos_x;
+uniform isampler2D particle_pos_y;
+uniform isampler2D particle_pos_z;
+uniform isampler2D particle_vel_x;
+uniform isampler2D particle_vel_y;
+uniform isampler2D particle_vel_z;
+uniform float texture_precision;
+#else
+layout(location = 1) in vec3 in_vector; // The velocity shown
+layout(location = 2) in vec3 in_origin; // Only read for PARTICLE arrows
+#endif
+
+out vec3 color;
+out float blend;
+
+// Where the arrows come from (DebugRenderer::ArrowSource)
+const uint GRID = 0u;      // One arrow per grid cell, from its center
+const uint GRID_AXIS = 1u; // One arrow per velocity component, from the face centers of the cell
+const uint PARTICLE = 2u;  // One arrow per particle, from in_origin
+
+uniform uint arrow_source;
+uniform float arrow_thickness;
+uniform vec3 arrow_color;
+
+// Every sample_stride-th grid velocity is uploaded, in the order the simulation
+// stores them, index = x * sample_dim * sample_dim + y * sample_dim + z
+uniform vec3 ws_grid_lower_bound;
+uniform float ws_grid_cell_size;
+uniform uint sample_dim;
+uniform uint sample_stride;
+
+const vec3 axis_colors[3] = vec3[3](vec3(0.8, 0.2, 0.2), vec3(0.2, 0.8, 0.2), vec3(0.2, 0.2, 0.8));
+
+uniform mat4 proj_view;
+
+uvec3 GetCell(uint sample_index) {
+	uvec3 index = uvec3(sample_index / (sample_dim * sample_dim), (sample_index / sample_dim) % sample_dim, sample_index % sample_dim);
+	return index * sample_stride;
+}
+
+vec3 GetCellCorner(uint sample_index) {
+	return ws_grid_lower_bound + vec3(GetCell(sample_index)) * ws_grid_cell_size;
+}
+
+#ifdef SIM_TEXTURES
+vec3 FetchGridVelocity(uint sample_index) {
+	ivec3 texel = ivec3(GetCell(sample_index));
+	return vec3(
+		texelFetch(grid_vel_x, texel, 0).r,
+		texelFetch(grid_vel_y, texel, 0).r,
+		texelFetch(grid_vel_z, texel, 0).r) / texture_precision;
+}
+
+ivec2 GetParticleTexel(int particle) {
+	int width = textureSize(particle_pos_x, 0).x;
+	return ivec2(particle % width, particle / width);
+}
+#endif
+
+void main()
+{
+#ifdef SIM_TEXTURES
+	vec3 vector = vec3(0.0);
+	vec3 origin = vec3(0.0);
+	if (arrow_source == GRID) {
+		vector = FetchGridVelocity(uint(gl_InstanceID));
+	}
+	else if (arrow_source == GRID_AXIS) {
+		vector = FetchGridVelocity(uint(gl_InstanceID) / 3u);
+	}
+	else {
+		ivec2 texel = GetParticleTexel(gl_InstanceID);
+		vector = vec3(
+			texelFetch(particle_vel_x, texel, 0).r,
+			texelFetch(particle_vel_y, texel, 0).r,
+			texelFetch(particle_vel_z, texel, 0).r) / texture_precision;
+		origin = vec3(
+			texelFetch(particle_pos_x, texel, 0).r,
+			texelFetch(particle_pos_y, texel, 0).r,
+			texelFetch(particle_pos_z, texel, 0).r) / texture_precision;
+	}
+#else
+	vec3 vector = in_vector;
+	vec3 origin = in_origin;
+#endif
+	color = arrow_color;
+	if (arrow_source == GRID) {
+		origin = GetCellCorner(uint(gl_InstanceID)) + vec3(0.5 * ws_grid_cell_size);
+	}
+	else if (arrow_source == GRID_AXIS) {
+		// The vector advances once every 3 instances, one instance per axis
+		uint axis = uint(gl_InstanceID) % 3u;
+		vec3 axis_dir = vec3(0.0);
+		axis_dir[axis] = 1.0;
+		origin = GetCellCorner(uint(gl_InstanceID) / 3u) + (vec3(1.0) - axis_dir) * (0.5 * ws_grid_cell_size);
+		vector = axis_dir * vector[axis];
+		color = axis_colors[axis];
+	}
+
+	// Any frame around the vector will do, the arrow is symmetric about its shaft
+	float len = length(vector);
+	vec3 up = len > 0.0 ? vector / len : vec3(0.0, 1.0, 0.0);
+	vec3 helper = abs(up.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	vec3 right = normalize(cross(helper, up));
+	vec3 forward = cross(right, up);
+
+	vec3 ws_pos = origin
+		+ right * (ls_vert.x * arrow_thickness)
+		+ up * (ls_vert.y * len)
+		+ forward * (ls_vert.z * arrow_thickness);
+
+	blend = (ls_vert.y / 2.0) + 0.5;
+	gl_Position = proj_view * vec4(ws_pos, 1.0);
+}
@@ -1,8 +1,26 @@
 #version 430
 
 layout(location = 0) in vec3 ls_vert;
+#ifdef SIM_TEXTURES
+// The cells are placed from the instance index and their values read from the
+// textures of GPU_Simulation (GPU_Simulation::GetFieldTextures())
+const uint PRESSURE = 0u;
+const uint FLUID_CELLS = 1u;
+uniform uint cell_source;
+uniform sampler3D grid_pressures;
+uniform usampler3D grid_cell_types;
+uniform uint fluid_cell_type;
+
+// Every sample_stride-th cell along each axis is drawn, covering the ones skipped after it
+uniform vec3 ws_grid_lower_bound;
+uniform float ws_grid_cell_size;
+uniform uint grid_dim;
+uniform uint sample_dim;
+uniform uint sample_stride;
+#else
 layout(location = 1) in float cell_float;
 layout(location = 2) in mat4 cell_model; // Put this one last, since it reserves 4 locations, one for each column of the matrix
+#endif
 
 out float blend;
 
@@ -11,6 +29,21 @@ uniform mat4 proj_view;
 
 void main()
 {
+#ifdef SIM_TEXTURES
+	uint index = uint(gl_InstanceID);
+	uvec3 cell = uvec3(index / (sample_dim * sample_dim), (index / sample_dim) % sample_dim, index % sample_dim) * sample_stride;
+	vec3 span = vec3(min(uvec3(sample_stride), uvec3(grid_dim) - cell));
+	vec3 ws_pos = ws_grid_lower_bound + (vec3(cell) + ls_vert * span) * ws_grid_cell_size;
+
+	if (cell_source == PRESSURE) {
+		blend = texelFetch(grid_pressures, ivec3(cell), 0).r;
+	}
+	else {
+		blend = texelFetch(grid_cell_types, ivec3(cell), 0).r == fluid_cell_type ? 1.0 : 0.0;
+	}
+	gl_Position = proj_view * vec4(ws_pos, 1.0);
+#else
 	blend = cell_float;	
 	gl_Position = proj_view * cell_model * vec4(ls_vert, 1.0);
-}
\ No newline at end of file
+#endif
+}
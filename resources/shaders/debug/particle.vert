@@ -1,8 +1,15 @@
 #version 430 core
 
 layout(location = 0) in vec3 ls_particle_quad_pos;
+#ifdef SIM_TEXTURES
+// Read from the fixed point position textures of GPU_Simulation instead (GPU_Simulation::GetFieldTextures())
+uniform isampler2D particle_pos_x;
+uniform isampler2D particle_pos_y;
+uniform isampler2D particle_pos_z;
+uniform float texture_precision;
+#else
 layout(location = 1) in vec3 particle_pos;
-layout(location = 2) in vec3 particle_in_color;
+#endif
 
 out vec2 uv;
 out vec3 particle_color;
@@ -13,12 +20,28 @@ uniform float particle_radius;
 
 uniform mat4 proj_view;
 
+// The PCG hash, gives every particle its own color without a color buffer
+uint Hash(uint value) {
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
 void main() {
+#ifdef SIM_TEXTURES
+	int width = textureSize(particle_pos_x, 0).x;
+	ivec2 texel = ivec2(gl_InstanceID % width, gl_InstanceID / width);
+	vec3 particle_pos = vec3(
+		texelFetch(particle_pos_x, texel, 0).r,
+		texelFetch(particle_pos_y, texel, 0).r,
+		texelFetch(particle_pos_z, texel, 0).r) / texture_precision;
+#endif
 	vec3 ws_vertex_pos = particle_pos
 			+ ws_camera_right * ls_particle_quad_pos.x * particle_radius 
 			+ ws_camera_up * ls_particle_quad_pos.y * particle_radius;
 
 	gl_Position = proj_view * vec4(ws_vertex_pos, 1.0);
 	uv = (ls_particle_quad_pos.xy + vec2(1.0, 1.0)) / 2;
-	particle_color = particle_in_color;
+	uint h = Hash(uint(gl_InstanceID));
+	particle_color = vec3(h & 0xFFu, (h >> 8) & 0xFFu, (h >> 16) & 0xFFu) / 255.0;
 }
\ No newline at end of file
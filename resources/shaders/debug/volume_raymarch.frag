@@ -0,0 +1,74 @@
+#version 430
+
+// Raymarches the cell values of the whole grid through a transfer function,
+// one full-screen pass instead of a cube per cell
+
+in vec2 uv;
+
+out vec4 frag;
+
+// Cell (x, y, z) is stored at texel (z, y, x), the order the simulation keeps
+// its cells in (see DebugRenderer::SetGridVolume())
+uniform sampler3D volume;
+uniform float value_min;
+uniform float value_max;
+
+// The transfer function goes from empty_color and no opacity at value_min
+// to full_color and k_density at value_max
+uniform vec3 empty_color;
+uniform vec3 full_color;
+const float k_density = 6.0; // Opacity per world unit
+const int k_max_steps = 1024;
+
+uniform vec3 ws_grid_lower_bound;
+uniform vec3 ws_grid_upper_bound;
+uniform float ws_grid_cell_size;
+
+uniform mat4 proj_view;
+uniform mat4 inv_proj_view;
+
+vec3 Unproject(float ndc_z) {
+	vec4 ws_pos = inv_proj_view * vec4(uv * 2.0 - 1.0, ndc_z, 1.0);
+	return ws_pos.xyz / ws_pos.w;
+}
+
+void main()
+{
+	vec3 ray_origin = Unproject(-1.0);
+	vec3 ray_dir = normalize(Unproject(1.0) - ray_origin);
+
+	// Where the ray is inside the grid bounds
+	vec3 t_lower = (ws_grid_lower_bound - ray_origin) / ray_dir;
+	vec3 t_upper = (ws_grid_upper_bound - ray_origin) / ray_dir;
+	vec3 t_near = min(t_lower, t_upper);
+	vec3 t_far = max(t_lower, t_upper);
+	float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));
+	float t_exit = min(min(t_far.x, t_far.y), t_far.z);
+	if (t_enter >= t_exit) {
+		discard;
+	}
+
+	// About two samples per cell
+	int steps = clamp(int(ceil((t_exit - t_enter) / (0.5 * ws_grid_cell_size))), 1, k_max_steps);
+	float step_length = (t_exit - t_enter) / float(steps);
+	float value_scale = value_max > value_min ? 1.0 / (value_max - value_min) : 0.0;
+	vec3 grid_size = ws_grid_upper_bound - ws_grid_lower_bound;
+
+	// Front to back, with premultiplied alpha
+	vec4 result = vec4(0.0);
+	for (int i = 0; i < steps && result.a < 0.99; i++) {
+		vec3 ws_pos = ray_origin + ray_dir * (t_enter + (float(i) + 0.5) * step_length);
+		vec3 uvw = (ws_pos - ws_grid_lower_bound) / grid_size;
+		float value = clamp((texture(volume, uvw.zyx).r - value_min) * value_scale, 0.0, 1.0);
+		float alpha = 1.0 - exp(-k_density * value * step_length);
+		result += (1.0 - result.a) * vec4(mix(empty_color, full_color, value) * alpha, alpha);
+	}
+	if (result.a == 0.0) {
+		discard;
+	}
+
+	// Depth of where the ray enters the grid, so the scene in front of it still hides it
+	vec4 cs_enter = proj_view * vec4(ray_origin + ray_dir * t_enter, 1.0);
+	gl_FragDepth = (cs_enter.z / cs_enter.w) * 0.5 + 0.5;
+	frag = result;
+}
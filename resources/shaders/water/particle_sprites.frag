@@ -1,26 +1,32 @@
 #version 430 core
 
-in vec2 uv;
-in vec3 vs_pos;
+// Intersects the view ray of the fragment with the sphere of the particle, so
+// the depth is that of the sphere rather than of a flat sprite.
 
+flat in vec3 vs_center;
+
+// The distance along the view axis (-z in view space) of the water surface, 0 where there is none
 layout(location = 0) out vec3 Depth;
 
-uniform vec3 vs_cam_pos;
 uniform float particle_radius;
+uniform vec2 render_size;
 
 uniform mat4 proj;
+uniform mat4 inv_proj;
 
 void main() {
-	// Code used from the 2010 GDC talk on realtime water rendering
-	vec3 N;
-	N.xy = (uv.xy * 2.0 - vec2(1.0));
-	float r = dot(N.xy, N.xy);
-	if (r > 1.0) discard;
-	N.z = -sqrt(1.0 - r);
-	N = normalize(N);
-	
-	// Depth calculation
-	vec4 pixel_pos = vec4(N * particle_radius * 2, 1.0);
-	vec4 hs_pos = proj * pixel_pos;
-	Depth = vec3(vs_pos.z - hs_pos.z);
-}
\ No newline at end of file
+	vec2 ndc = gl_FragCoord.xy / render_size * 2.0 - 1.0;
+	vec4 vs_far = inv_proj * vec4(ndc, 1.0, 1.0);
+	vec3 ray = normalize(vs_far.xyz / vs_far.w);
+
+	// |t * ray - vs_center| = particle_radius, the camera is at the origin
+	float b = dot(ray, vs_center);
+	float c = dot(vs_center, vs_center) - particle_radius * particle_radius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0) discard;
+	vec3 vs_hit = ray * (b - sqrt(discriminant));
+
+	vec4 cs_hit = proj * vec4(vs_hit, 1.0);
+	gl_FragDepth = (cs_hit.z / cs_hit.w) * 0.5 + 0.5;
+	Depth = vec3(-vs_hit.z);
+}
@@ -1,42 +1,63 @@
 #version 430 core
 
-layout(location = 0) in vec3 ls_particle_quad_pos;
-layout(location = 1) in vec2 pos_index; // Center of the particle, as a uv index into the particle positions texture
-
-out vec2 uv;
-out vec3 vs_pos;
-
-// Since the compute shader updates a texture, don't process the texture on the CPU,
-// just pass it directly to the GPU and provide indices
-uniform sampler2D ws_particle_positions_x;
-uniform sampler2D ws_particle_positions_y;
-uniform sampler2D ws_particle_positions_z;
-
-uniform vec3 ws_camera_up;
-uniform vec3 ws_camera_right;
-uniform float particle_radius;
-
-uniform mat4 proj_view;
-
+// One point sprite per particle, drawn with glDrawArrays(GL_POINTS) and no vertex
+// buffers. Particle gl_VertexID is pulled straight from the position textures of
+// the simulation, where it is stored at texel (id % width, id / width).
+//
+// Points are clipped by their center and limited in size, so with edge_quads set
+// the shader is drawn a second time as an instanced 4 vertex triangle strip, which
+// draws a camera-facing quad instead for the particles the points lost: those whose
+// center is outside of the view but whose sphere still reaches into it, and those
+// larger than max_point_size. Every other quad is moved outside of the view, where
+// it is discarded before rasterization.
+
+flat out vec3 vs_center;
+
+uniform isampler2D ws_particle_positions_x;
+uniform isampler2D ws_particle_positions_y;
+uniform isampler2D ws_particle_positions_z;
 uniform float texture_precision;
 
-vec3 GetParticlePosition(vec2 particle_index_uv) {
-	float temp_x = float(texture(ws_particle_positions_x, particle_index_uv).r);
-	float temp_y = float(texture(ws_particle_positions_y, particle_index_uv).r);
-	float temp_z = float(texture(ws_particle_positions_z, particle_index_uv).r);
-	float x = temp_x / texture_precision;
-	float y = temp_y / texture_precision;
-	float z = temp_z / texture_precision;
-	return vec3(x, y, z);
-	// return vec3(particle_index_uv.x, particle_index_uv.y, x);
+uniform float particle_radius;
+uniform vec2 render_size; // Of the depth target, in pixels
+uniform float max_point_size;
+uniform uint edge_quads;
+
+uniform mat4 view;
+uniform mat4 proj;
+
+const vec2 k_corners[4] = vec2[4](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+vec3 GetParticlePosition(int particle) {
+	int width = textureSize(ws_particle_positions_x, 0).x;
+	ivec2 texel = ivec2(particle % width, particle / width);
+	return vec3(
+		texelFetch(ws_particle_positions_x, texel, 0).r,
+		texelFetch(ws_particle_positions_y, texel, 0).r,
+		texelFetch(ws_particle_positions_z, texel, 0).r) / texture_precision;
 }
 
 void main() {
-	vec3 ws_vertex_pos = GetParticlePosition(pos_index)
-			+ ws_camera_right * ls_particle_quad_pos.x * particle_radius 
-			+ ws_camera_up * ls_particle_quad_pos.y * particle_radius;
-
-	gl_Position = proj_view * vec4(ws_vertex_pos, 1.0);
-	vs_pos = (proj_view * vec4(ws_vertex_pos, 1.0)).xyz;
-	uv = (ls_particle_quad_pos.xy + vec2(1.0, 1.0)) / 2;
-}
\ No newline at end of file
+	vs_center = (view * vec4(GetParticlePosition(edge_quads != 0u ? gl_InstanceID : gl_VertexID), 1.0)).xyz;
+	vec4 cs_center = proj * vec4(vs_center, 1.0);
+
+	// Covers the sphere as seen from its nearest point, the fragment shader cuts it out
+	float center_distance = -vs_center.z;
+	float distance = max(center_distance - particle_radius, 1e-3);
+	float point_size = particle_radius * proj[1][1] * render_size.y / distance;
+	bool point_lost = any(greaterThan(abs(cs_center.xyz), vec3(cs_center.w))) || point_size > max_point_size;
+
+	if (edge_quads == 0u) {
+		gl_Position = cs_center;
+		gl_PointSize = point_size;
+	}
+	else if (point_lost) {
+		// In the plane of the center, so scaled up to cover what the point would
+		float half_size = particle_radius * max(center_distance, 0.0) / distance;
+		gl_Position = proj * vec4(vs_center + vec3(k_corners[gl_VertexID] * half_size, 0.0), 1.0);
+	}
+	else {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+	}
+}
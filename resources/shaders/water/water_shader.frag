@@ -5,6 +5,11 @@ in vec2 uv;
 out vec3 FragColor;
 
 uniform sampler2D depth_tex;
+uniform sampler2D normal_tex; // View space, from water_normals.comp
+#ifdef COMPOSITE
+// The water shaded below screen resolution (see WaterParticleRenderer::SetShadingResolution())
+uniform sampler2D shaded_water;
+#endif
 // uniform sampler2D bg_tex;
 uniform samplerCube skybox;
 uniform vec3 ws_cam_pos;
@@ -14,62 +19,45 @@ uniform vec3 diffuse_color;
 uniform mat4 inv_proj;
 uniform mat4 inv_view;
 
-vec3 GetViewPos(vec2 tex_coord) {
-	vec4 hs_pos = vec4 (
-		2.0 * tex_coord.x - 1.0,
-		2.0 * tex_coord.y - 1.0,
-		2.0 * texture(depth_tex, tex_coord).r - 1.0,
-		1.0);
-	vec4 vs_pos = (inv_proj * hs_pos);
-	return vs_pos.xyz / vs_pos.w;
-}
+// Depths further than this from the nearest texel are left out of the upsampling
+const float k_upsample_depth_range = 0.1;
 
-vec3 GetWorldPos(vec2 tex_coord) {
-	return (inv_view * vec4(GetViewPos(tex_coord), 1.0)).rgb;
+bool IsWater(float depth) {
+	return depth - 1e-5 > 0.0;
 }
 
-vec3 CalculateNorm(vec2 tex_coord, vec2 texDimen) {
-	int dd_diff = 2;
-	vec3 vs_pos = GetViewPos(tex_coord);
-	vec3 ddx = GetViewPos(tex_coord + vec2(dd_diff, 0) / texDimen) - vs_pos;
-	vec3 ddx2 = vs_pos - GetViewPos(tex_coord + vec2(-dd_diff, 0) / texDimen);
-	if (abs(ddx.z) > abs(ddx2.z)) {
-		ddx = ddx2;
-	}
-	
-	vec3 ddy = GetViewPos(uv + vec2(0, dd_diff) / texDimen) - vs_pos;
-	vec3 ddy2 = vs_pos - GetViewPos(uv + vec2(0, -dd_diff) / texDimen);
-	if (abs(ddy.z) > abs(ddy2.z)) {
-		ddy = ddy2;
-	}
-
-	return normalize(cross(ddx, ddy));
+// The depth is rendered at a fraction of the screen resolution. It is upsampled
+// bilinearly, but only between texels close in depth to the nearest one, so the
+// edges of the water don't blend with the empty background or water behind it.
+// Only the coverage and the surface position use it, the normals come from
+// whole texels anyway.
+float SampleDepth(vec2 tex_coord) {
+	vec2 f = fract(tex_coord * vec2(textureSize(depth_tex, 0)) - 0.5);
+	// The texels of the bilinear footprint, in the order textureGather returns them
+	vec4 depths = textureGather(depth_tex, tex_coord, 0);
+	vec4 weights = vec4((1.0 - f.x) * f.y, f.x * f.y, f.x * (1.0 - f.y), (1.0 - f.x) * (1.0 - f.y));
+	float nearest = texture(depth_tex, tex_coord).r;
+	weights *= step(abs(depths - nearest), vec4(k_upsample_depth_range));
+	float total = dot(weights, vec4(1.0));
+	return total > 0.0 ? dot(weights, depths) / total : nearest;
 }
 
-vec3 GetNormal() {
-	float depth = texture(depth_tex, uv).r;
-	if (depth - 1e-5 <= 0) discard;
-	ivec2 texDimen = textureSize(depth_tex, 0);
-	vec3 norm = CalculateNorm(uv, texDimen);
-			
-	// if (norm.z + 1e-5 >= 1) discard;
-	norm =	(norm 
-			+ CalculateNorm(uv + vec2(1, 0) / texDimen, texDimen) 
-			+ CalculateNorm(uv + vec2(0, 1) / texDimen, texDimen) 
-			+ CalculateNorm(uv + vec2(-1, 0) / texDimen, texDimen) 
-			+ CalculateNorm(uv + vec2(0, -1) / texDimen, texDimen))
-			/ 5;
-	// norm.y = -norm.y;
-	// norm.x = -norm.x;
-	return norm;
+// The depth is the distance along the view axis (-z in view space), as particle_sprites.frag writes it
+vec3 GetViewPos(vec2 tex_coord, float depth) {
+	vec4 vs_far = inv_proj * vec4(2.0 * tex_coord - 1.0, 1.0, 1.0);
+	vec3 ray = vs_far.xyz / vs_far.w;
+	return ray * (depth / -ray.z);
 }
 
-void main() {
+vec3 GetWorldPos(vec2 tex_coord, float depth) {
+	return (inv_view * vec4(GetViewPos(tex_coord, depth), 1.0)).rgb;
+}
 
-	vec3 N = -GetNormal();
+vec3 ShadeWater(vec2 tex_coord, float depth) {
+	vec3 N = -texture(normal_tex, tex_coord).rgb;
 	
 	// Simple diffuse and reflection illumination/shading
-    vec3 I = normalize(ws_cam_pos - GetWorldPos(uv));
+    vec3 I = normalize(ws_cam_pos - GetWorldPos(tex_coord, depth));
 	vec3 R = reflect(I, N);
 	R.y = -R.y;
 	vec3 reflection_color = texture(skybox, R).rgb;
@@ -79,7 +67,46 @@ void main() {
 
 	vec3 refraction_color = texture(skybox, refract(I, -N, 1.33)).rgb;
 
-	FragColor = reflection_color * reflection_amount 
+	return reflection_color * reflection_amount 
 			+ diffuse_color * diffuse_amount
 			+ refraction_color * (1 - reflection_amount);
-}
\ No newline at end of file
+}
+
+#ifdef COMPOSITE
+// Upsamples the shaded water bilinearly, but only from the texels whose depth is
+// close to the depth of the pixel, like SampleDepth(). The depth of a shaded texel
+// is the nearest depth at its center, the same the shading pass saw. Returns false
+// where none of the 4 texels qualifies.
+bool UpsampleWater(vec2 tex_coord, float depth, out vec3 color) {
+	ivec2 size = textureSize(shaded_water, 0);
+	vec2 pos = tex_coord * vec2(size) - 0.5;
+	ivec2 base = ivec2(floor(pos));
+	vec2 f = pos - vec2(base);
+	vec3 sum = vec3(0.0);
+	float total = 0.0;
+	for (int i = 0; i < 4; i++) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+		float texel_depth = texture(depth_tex, (vec2(texel) + 0.5) / vec2(size)).r;
+		vec2 weights = mix(1.0 - f, f, vec2(offset));
+		if (IsWater(texel_depth) && abs(texel_depth - depth) <= k_upsample_depth_range) {
+			sum += weights.x * weights.y * texelFetch(shaded_water, texel, 0).rgb;
+			total += weights.x * weights.y;
+		}
+	}
+	color = total > 0.0 ? sum / total : vec3(0.0);
+	return total > 0.0;
+}
+#endif
+
+void main() {
+	float depth = SampleDepth(uv);
+	if (!IsWater(depth)) discard;
+#ifdef COMPOSITE
+	// Thin water and its edges can miss the shaded texels, those pixels are shaded here
+	vec3 color;
+	FragColor = UpsampleWater(uv, depth, color) ? color : ShadeWater(uv, depth);
+#else
+	FragColor = ShadeWater(uv, depth);
+#endif
+}
@@ -0,0 +1,22 @@
+#version 430 core
+
+// Covers one tile the smoothing listed with water in it per instance (see
+// water_smooth_depth.comp), so the water shader only runs near the water. The
+// vertices are made from gl_VertexID, two triangles per tile.
+
+layout (location = 0) in uint tile; // x | (y << 16), in tiles
+
+out vec2 uv;
+
+uniform uint tile_size;   // In depth texels
+uniform vec2 render_size; // Of the depth texture
+
+const vec2 k_corners[6] = vec2[6](
+	vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+	vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(1.0, 1.0));
+
+void main() {
+	vec2 tile_start = vec2(uvec2(tile & 0xFFFFu, tile >> 16) * tile_size);
+	uv = min((tile_start + k_corners[gl_VertexID] * float(tile_size)) / render_size, vec2(1.0));
+	gl_Position = vec4(2.0 * uv - 1.0, 0.0, 1.0);
+}
@@ -18,7 +18,12 @@
 #include <stb_image.h>
 
 // Std Library Imports
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <numeric>
+#include <random>
 #include <stdlib.h>
 #include <vector>
 
@@ -32,12 +37,18 @@
 #include "simulation/water_particle_renderer.hpp"
 #include "rendering/skybox.hpp"
 #include "rendering/display_text.hpp"
+#include "rendering/gpu_profiler.hpp"
+#include "rendering/gpu_primitives.hpp"
+#include "rendering/headless_context.hpp"
 #include "simulation/debug_renderer.hpp"
 #include "rendering/fps_camera.hpp"
 #include "simulation/sequential_simulation.hpp"
 #include "simulation/gpu_simulation.hpp"
+#include "simulation/cpu_simulation.hpp"
+#include "simulation/simulation_diff.hpp"
 
-GLFWwindow* window;
+GLFWwindow* window = nullptr;
+HeadlessContext* g_headless_context = nullptr;
 const int kWindowWidth = 1024;
 const int kWindowHeight = 768;
 
@@ -45,6 +56,7 @@ FPSCamera* g_cam = nullptr;
 WaterParticleRenderer* g_particle_renderer = nullptr;
 Skybox* g_skybox = nullptr;
 DebugRenderer* g_debug_renderer = nullptr;
+GPUProfiler* g_gpu_profiler = nullptr;
 Simulation* g_sim = nullptr;
 bool g_simulate = false;
 bool g_draw_realistic = false;
@@ -53,12 +65,14 @@ std::set<int> g_keys_pressed;
 enum SimulationType {
     SEQ_GRID,
     SEQ_PARTICLE,
-    GPU_PARTICLE
+    GPU_PARTICLE,
+    CPU_PARTICLE
 };
 
-const int TOTAL_SIMULATION_TYPES = 3;
+const int TOTAL_SIMULATION_TYPES = 4;
 SimulationType simulation_type = SimulationType::GPU_PARTICLE;
 bool enable_particles = false;
+ParticleEmitter::Shape g_emitter_shape = ParticleEmitter::REGULAR;
 
 // TODO: Defined a scene renderer class that makes it so we don't need all these global variables
 // SceneRenderer g_scene_renderer; // Holds camera, models, skybox, etc.
@@ -66,6 +80,7 @@ bool enable_particles = false;
 // Prototypes
 void ChangeSimulationType(bool getNext);
 void SetSimulation();
+bool SeedParticles(Simulation* sim, ParticleEmitter::Shape shape);
 
 bool UpdateView(const glm::mat4& view) {
     if (g_skybox)
@@ -94,7 +109,9 @@ void WindowSizeCallback(GLFWwindow* window, int width, int height)
         g_cam->SetAspectRatio(width, height);
         UpdateProjection(g_cam->GetCam()->GetProjectionMatrix());
     }
-
+    if (g_particle_renderer != nullptr) {
+        g_particle_renderer->SetViewportSize(width, height);
+    }
 }
 
 void WindowKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -171,6 +188,11 @@ void WindowKeyCallback(GLFWwindow* window, int key, int scancode, int action, in
             g_debug_renderer->ToggleDebugView(DebugRenderer::FRAME_TIME);
         }
     }
+    if (key == GLFW_KEY_F) {
+        if (action == GLFW_PRESS) {
+            g_debug_renderer->ToggleDebugView(DebugRenderer::GPU_PROFILE);
+        }
+    }
     if (key == GLFW_KEY_G) {
         if (action == GLFW_PRESS) {
             g_debug_renderer->ToggleDebugView(DebugRenderer::GRID);
@@ -201,6 +223,23 @@ void WindowKeyCallback(GLFWwindow* window, int key, int scancode, int action, in
             g_debug_renderer->ToggleDebugView(DebugRenderer::PARTICLE_VELOCITIES);
         }
     }
+    // Sampling density of the grid views: [ denser, ] sparser, \ automatic
+    if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET || key == GLFW_KEY_BACKSLASH) {
+        if (action == GLFW_PRESS) {
+            unsigned int stride = g_debug_renderer->GetGridSampleStride();
+            if (key == GLFW_KEY_LEFT_BRACKET) {
+                stride = stride > 1 ? stride - 1 : 1;
+            }
+            else if (key == GLFW_KEY_RIGHT_BRACKET) {
+                stride = stride + 1;
+            }
+            else {
+                stride = 0;
+            }
+            g_debug_renderer->SetGridSampleStride(stride);
+            printf("Debug grid stride: %u%s\n", g_debug_renderer->GetGridSampleStride(), stride == 0 ? " (automatic)" : "");
+        }
+    }
     if (key == GLFW_KEY_P) {
         if (action == GLFW_PRESS) {
             g_simulate = !g_simulate;
@@ -220,44 +259,69 @@ void WindowKeyCallback(GLFWwindow* window, int key, int scancode, int action, in
         }
     }
 
+    if (key == GLFW_KEY_R) {
+        if (action == GLFW_PRESS) {
+            g_emitter_shape = static_cast<ParticleEmitter::Shape>((g_emitter_shape + 1) % ParticleEmitter::NUM_SHAPES);
+            if (SeedParticles(g_sim, g_emitter_shape)) {
+                printf("Particles seeded (%s)\n", ParticleEmitter::GetShapeName(g_emitter_shape));
+            }
+        }
+    }
+
     if (key == GLFW_KEY_I) {
         if (action == GLFW_PRESS) {
             g_draw_realistic = !g_draw_realistic;
         }
     }
+    if (key == GLFW_KEY_L) {
+        if (action == GLFW_PRESS) {
+            g_particle_renderer->SetNarrowRangeFilter(!g_particle_renderer->GetNarrowRangeFilter());
+            printf("Water depth smoothing: %s\n", g_particle_renderer->GetNarrowRangeFilter() ? "narrow-range" : "full window");
+        }
+    }
+    if (key == GLFW_KEY_J) {
+        if (action == GLFW_PRESS) {
+            g_particle_renderer->SetTemporalSmoothing(!g_particle_renderer->GetTemporalSmoothing());
+            printf("Water depth temporal smoothing: %s\n", g_particle_renderer->GetTemporalSmoothing() ? "on" : "off");
+        }
+    }
+    if (key == GLFW_KEY_K) {
+        if (action == GLFW_PRESS) {
+            // Cycles full, depth and quarter resolution
+            WaterParticleRenderer::ShadingResolution resolution = (WaterParticleRenderer::ShadingResolution)((g_particle_renderer->GetShadingResolution() + 1) % 3);
+            g_particle_renderer->SetShadingResolution(resolution);
+            const char* names[3] = { "full", "depth", "quarter" };
+            printf("Water shading resolution: %s\n", names[resolution]);
+        }
+    }
 
-    //if (key == GLFW_KEY_1) {
-    //    if (action == GLFW_PRESS) {
-    //        if (g_sim != nullptr && g_sim->GetGridPressures() != nullptr) {
-    //            if (g_debug_renderer->IsCellViewActive(DebugRenderer::PRESSURE) || !g_debug_renderer->IsDebugViewActive(DebugRenderer::GRID_CELL)) {
-    //                g_debug_renderer->ToggleDebugView(DebugRenderer::GRID_CELL);
-    //            }
-    //            g_debug_renderer->SetGridPressures(*g_sim->GetGridPressures(), g_sim->GetGridDimensions());
-    //        }
-    //    }
-    //}
-    //if (key == GLFW_KEY_2) {
-    //    if (action == GLFW_PRESS) {
-    //        if (g_sim != nullptr && g_sim->GetGridDyeDensities() != nullptr) {
-    //            if (g_debug_renderer->IsCellViewActive(DebugRenderer::DYE) || !g_debug_renderer->IsDebugViewActive(DebugRenderer::GRID_CELL)) {
-    //                g_debug_renderer->ToggleDebugView(DebugRenderer::GRID_CELL);
-    //            }
-    //            g_debug_renderer->SetGridDyeDensities(*g_sim->GetGridDyeDensities(), g_sim->GetGridDimensions());
-    //        }
-    //    }
-    //}
-    //if (key == GLFW_KEY_3) {
-    //    if (action == GLFW_PRESS) {
-    //        if (g_sim != nullptr && g_sim->GetGridFluidCells() != nullptr) {
-    //            printf("Displaying fluid cells\n");
-    //            if (g_debug_renderer->IsCellViewActive(DebugRenderer::IS_FLUID) || !g_debug_renderer->IsDebugViewActive(DebugRenderer::GRID_CELL)) {
-    //                printf("Toggling cell display\n");
-    //                g_debug_renderer->ToggleDebugView(DebugRenderer::GRID_CELL);
-    //            }
-    //            g_debug_renderer->SetGridFluidCells(*g_sim->GetGridFluidCells(), g_sim->GetGridDimensions());
-    //        }
-    //    }
-    //}
+    // The field of the cell views: 1 pressure, 2 dye, 3 fluid cells
+    if (key == GLFW_KEY_1 || key == GLFW_KEY_2 || key == GLFW_KEY_3) {
+        if (action == GLFW_PRESS) {
+            if (key == GLFW_KEY_1) {
+                g_debug_renderer->SetDebugCellView(DebugRenderer::PRESSURE);
+                printf("Cell views show pressure\n");
+            }
+            else if (key == GLFW_KEY_2) {
+                g_debug_renderer->SetDebugCellView(DebugRenderer::DYE);
+                printf("Cell views show dye\n");
+            }
+            else {
+                g_debug_renderer->SetDebugCellView(DebugRenderer::IS_FLUID);
+                printf("Cell views show fluid cells\n");
+            }
+        }
+    }
+    if (key == GLFW_KEY_X) {
+        if (action == GLFW_PRESS) {
+            g_debug_renderer->ToggleDebugView(DebugRenderer::GRID_CELL);
+        }
+    }
+    if (key == GLFW_KEY_C) {
+        if (action == GLFW_PRESS) {
+            g_debug_renderer->ToggleDebugView(DebugRenderer::GRID_VOLUME);
+        }
+    }
 }
 
 void APIENTRY MessageCallback(GLenum source,
@@ -273,6 +337,20 @@ void APIENTRY MessageCallback(GLenum source,
         type, severity, message);
 }
 
+void SetDefaultGLState() {
+    /* Set the viewport */
+    glClearColor(0.6784f, 0.8f, 1.0f, 1.0f);
+    glViewport(0, 0, kWindowWidth, kWindowHeight);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glDepthFunc(GL_LESS);
+
+    //// During init, enable debug output
+    //glEnable(GL_DEBUG_OUTPUT);
+    //glDebugMessageCallback(MessageCallback, 0);
+}
+
 bool Init() {
     /* Initialize the library */
     if (!glfwInit())
@@ -312,18 +390,21 @@ bool Init() {
         return false;
     }
 
-    /* Set the viewport */
-    glClearColor(0.6784f, 0.8f, 1.0f, 1.0f);
-    glViewport(0, 0, kWindowWidth, kWindowHeight);
-
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glDepthFunc(GL_LESS);
+    SetDefaultGLState();
+    return true;
+}
 
-    //// During init, enable debug output
-    //glEnable(GL_DEBUG_OUTPUT);
-    //glDebugMessageCallback(MessageCallback, 0);
+/*
+ * Creates an offscreen context instead of a window, for running and timing
+ * the simulation and render passes on machines without a display.
+ */
+bool InitHeadless() {
+    g_headless_context = new HeadlessContext();
+    if (!g_headless_context->Create(kWindowWidth, kWindowHeight)) {
+        return false;
+    }
 
+    SetDefaultGLState();
     return true;
 }
 
@@ -348,74 +429,129 @@ void ChangeSimulationType(bool getNext) {
  *
  * TODO: construct and deconstruct debug renderer based on simulation types?
  */
+// The scene every simulation starts from
+const int kNumParticles = 4096;
+const float kGridInterval = 0.25;
+const glm::vec3 kLowerBound = glm::vec3(-1.0, -1.0, -1.0);
+const glm::vec3 kUpperBound = glm::vec3(1.0, 1.0, 1.0);
+
+Simulation* CreateSimulation(SimulationType type) {
+    const int grid_dim = (kUpperBound.x - kLowerBound.x) / kGridInterval;
+
+    switch (type) {
+    case SimulationType::SEQ_GRID:
+        return new SequentialGridBased();
+
+    case SimulationType::SEQ_PARTICLE:
+        return new SequentialParticleBased();
+
+    case SimulationType::GPU_PARTICLE: {
+        // GPU_Simulation(int num_particles_sqrt, int grid_dim, int iteration)
+        GPU_Simulation* gpu_sim = new GPU_Simulation(static_cast<int>(sqrt(kNumParticles)), grid_dim, 40);
+        gpu_sim->SetPressureSolver(GPU_Simulation::MULTIGRID);
+        gpu_sim->SetProfiler(g_gpu_profiler);
+        return gpu_sim;
+    }
+
+    case SimulationType::CPU_PARTICLE:
+        // The GPU kernels run on the CPU, see CPU_Simulation
+        return new CPU_Simulation(static_cast<int>(sqrt(kNumParticles)), grid_dim, 40);
+
+    default:
+        return nullptr;
+    }
+}
+
+std::vector<glm::vec3> GetInitialParticleVelocities() {
+    // TODO: Setup simulation variables
+    std::vector<glm::vec3> init_particle_vel;
+    for (int i = 0; i < kNumParticles; i++) {
+        //init_particle_vel.push_back(glm::normalize(glm::vec3(
+        //    ((float)(rand() % 100) / 100.0f),
+        //    ((float)(rand() % 100) / 100.0f),
+        //    ((float)(rand() % 100) / 100.0f)))
+        //);
+        init_particle_vel.push_back(glm::vec3(0.0f));
+    }
+    return init_particle_vel;
+}
+
+/*
+ * Reseeds the particles of the GPU and CPU simulations in the region of the
+ * initial scene, inside the solid border of the grid. The sequential simulations
+ * place their own particles.
+ *
+ * Returns false if the simulation can't be seeded.
+ */
+bool SeedParticles(Simulation* sim, ParticleEmitter::Shape shape) {
+    ParticleEmitter emitter(shape, kLowerBound + glm::vec3(kGridInterval), kUpperBound - glm::vec3(kGridInterval));
+
+    GPU_Simulation* gpu_sim = dynamic_cast<GPU_Simulation*>(sim);
+    if (gpu_sim != nullptr) {
+        gpu_sim->SeedParticles(emitter);
+        return true;
+    }
+    CPU_Simulation* cpu_sim = dynamic_cast<CPU_Simulation*>(sim);
+    if (cpu_sim != nullptr) {
+        cpu_sim->SeedParticles(emitter);
+        return true;
+    }
+    return false;
+}
+
 void SetSimulation() {
     if (g_debug_renderer != nullptr) {
         g_debug_renderer->ResetActiveViews();
+        g_debug_renderer->SetSimulation(nullptr);
     }
     delete g_sim;
     g_sim = nullptr;
     g_simulate = false;
 
-    const int num_particles = 4096;
-    const float interval = 0.25;
-    const glm::vec3 low_bound = glm::vec3(-1.0, -1.0, -1.0);
-    const glm::vec3 up_bound = glm::vec3(1.0, 1.0, 1.0);
-    const int grid_dim = (up_bound.x - low_bound.x) / interval;
-    printf("Grid dim: %d\n", grid_dim);
+    printf("Grid dim: %d\n", (int)((kUpperBound.x - kLowerBound.x) / kGridInterval));
 
     switch (simulation_type) {
     case SimulationType::SEQ_GRID:
         printf("Simulation set to (SEQ_GRID)\n");
-        g_sim = new SequentialGridBased();
         enable_particles = false;
         break;
 
     case SimulationType::SEQ_PARTICLE:
         printf("Simulation set to (SEQ_PARTICLE)\n");
-        g_sim = new SequentialParticleBased();
         enable_particles = true;
         break;
 
     case SimulationType::GPU_PARTICLE:
         printf("Simulation set to (GPU_PARTICLE)\n");
-        // GPU_Simulation(int num_particles_sqrt, int grid_dim, int iteration)
-        g_sim = new GPU_Simulation(static_cast<int>(sqrt(num_particles)), grid_dim, 40);
+        enable_particles = true;
+        break;
+
+    case SimulationType::CPU_PARTICLE:
+        printf("Simulation set to (CPU_PARTICLE)\n");
+        enable_particles = true;
         break;
 
     default:
         printf("main.cpp: SetSimulation(): invalid simulation type: %d\n", simulation_type);
         exit(-1);
     }
-
-    // TODO: Setup simulation variables
-    std::vector<glm::vec3> init_particle_vel;
-    for (int i = 0; i < num_particles; i++) {
-        //init_particle_vel.push_back(glm::normalize(glm::vec3(
-        //    ((float)(rand() % 100) / 100.0f),
-        //    ((float)(rand() % 100) / 100.0f),
-        //    ((float)(rand() % 100) / 100.0f)))
-        //);
-        init_particle_vel.push_back(glm::vec3(0.0f));
-    }
+    g_sim = CreateSimulation(simulation_type);
 
     g_sim->SetInitialVelocities(
-        init_particle_vel,
-        low_bound, 
-        up_bound, 
-        interval
+        GetInitialParticleVelocities(),
+        kLowerBound, 
+        kUpperBound, 
+        kGridInterval
     );
+    // Keep the shape last picked with R
+    if (g_emitter_shape != ParticleEmitter::REGULAR) {
+        SeedParticles(g_sim, g_emitter_shape);
+    }
 
-    // Create/Update debug renderer
+    // Create/Update debug renderer, the active views read the data from the simulation
     if (g_debug_renderer != nullptr) {
-        if (simulation_type != SimulationType::GPU_PARTICLE) {
-            g_debug_renderer->SetGridBoundaries(g_sim->GetGridLowerBounds(), g_sim->GetGridUpperBounds(), g_sim->GetGridInterval());
-            g_debug_renderer->SetGridVelocities(*g_sim->GetGridVelocities(), g_sim->GetGridDimensions());
-
-            if (simulation_type == SimulationType::SEQ_PARTICLE) {
-                g_debug_renderer->SetParticlePositions(*g_sim->GetParticlePositions());
-                g_debug_renderer->SetParticleVelocities(*g_sim->GetParticlePositions(), *g_sim->GetParticleVelocities());
-            }
-        }
+        g_debug_renderer->SetGridBoundaries(g_sim->GetGridLowerBounds(), g_sim->GetGridUpperBounds(), g_sim->GetGridInterval());
+        g_debug_renderer->SetSimulation(g_sim);
     }
 
 }
@@ -428,6 +564,8 @@ bool LoadContent()
     // Create Skybox for scene
     g_skybox = new Skybox({ "skybox/right.jpg", "skybox/left.jpg", "skybox/top.jpg", "skybox/bottom.jpg", "skybox/front.jpg", "skybox/back.jpg" });
     g_debug_renderer = new DebugRenderer();
+    g_gpu_profiler = new GPUProfiler();
+    g_debug_renderer->SetProfiler(g_gpu_profiler);
 
     // Create simulation 
     SetSimulation();
@@ -435,6 +573,7 @@ bool LoadContent()
     g_particle_renderer = new WaterParticleRenderer();
     g_particle_renderer->UpdateSkybox(g_skybox);
     g_particle_renderer->UpdateCamera(g_cam->GetCam());
+    g_particle_renderer->SetProfiler(g_gpu_profiler);
     if (dynamic_cast<GPU_Simulation*>(g_sim) != nullptr)
         g_particle_renderer->UpdateTexturePrecision(dynamic_cast<GPU_Simulation*>(g_sim)->GetTexturePrecision());
     
@@ -456,12 +595,14 @@ void UpdateLoop()
     double lastTime = glfwGetTime();
     int nbFrames = 0;
     while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && !glfwWindowShouldClose(window)) {
+        g_gpu_profiler->BeginFrame();
         double currentTime = glfwGetTime();
         nbFrames++;
         if (currentTime - lastTime >= 1.0) {
             // printf("%f ms/frame\n", 1000.0 / double(nbFrames));
             if (g_debug_renderer != nullptr) {
                 g_debug_renderer->UpdateFrameTime(1000.0 / double(nbFrames));
+                g_debug_renderer->UpdateProfileDisplay();
             }
             nbFrames = 0;
             lastTime += 1.0;
@@ -480,33 +621,6 @@ void UpdateLoop()
             // Perform new step in simulation
             g_sim->TimeStep(deltaTime + time_step);
 
-            // Update debug renderer
-            if (simulation_type != SimulationType::GPU_PARTICLE) {
-                g_debug_renderer->SetGridVelocities(*g_sim->GetGridVelocities(), g_sim->GetGridDimensions());
-
-                if (g_sim->GetParticlePositions() != nullptr) {
-                    g_debug_renderer->SetParticlePositions(*g_sim->GetParticlePositions());
-                    g_debug_renderer->SetParticleVelocities(*g_sim->GetParticlePositions(), *g_sim->GetParticleVelocities());
-                }
-                if (g_debug_renderer->IsDebugViewActive(DebugRenderer::GRID_CELL)) {
-                    switch (g_debug_renderer->GetCellViewActive()) {
-                    case DebugRenderer::DYE:
-                        g_debug_renderer->SetGridDyeDensities(*g_sim->GetGridDyeDensities(), g_sim->GetGridDimensions());
-                        break;
-                    case DebugRenderer::IS_FLUID:
-                        g_debug_renderer->SetGridDyeDensities(*g_sim->GetGridFluidCells(), g_sim->GetGridDimensions());
-                        break;
-                    case DebugRenderer::PRESSURE:
-                        g_debug_renderer->SetGridPressures(*g_sim->GetGridPressures(), g_sim->GetGridDimensions());
-                        break;
-                    case DebugRenderer::NONE:
-                        break;
-                    }
-                }
-            } else {
-                // GPU Simulation rendering
-            }
-
             last_time_updated = new_time;
         }
 
@@ -523,8 +637,14 @@ void UpdateLoop()
             );
             g_particle_renderer->Draw();
         }
-        g_skybox->Draw();
-        g_debug_renderer->Draw(enable_particles);
+        {
+            GPUProfiler::Scope scope(g_gpu_profiler, "skybox");
+            g_skybox->Draw();
+        }
+        {
+            GPUProfiler::Scope scope(g_gpu_profiler, "debug views");
+            g_debug_renderer->Draw(enable_particles);
+        }
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -534,26 +654,320 @@ void UpdateLoop()
     }
 }
 
-int main() 
+/*
+ * Runs a fixed number of simulation steps and frames as fast as possible and
+ * prints the wall time per frame along with the GPU time of every profiled pass.
+ * The step size is fixed so that runs are comparable.
+ */
+void RunBenchmark(int frames)
+{
+    const float time_step = 1.0f / 60.0f;
+    GPU_Simulation* gpu_sim = dynamic_cast<GPU_Simulation*>(g_sim);
+
+    g_gpu_profiler->SetEnabled(true);
+    glFinish();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        g_gpu_profiler->BeginFrame();
+        g_sim->TimeStep(time_step);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        if (gpu_sim != nullptr) {
+            g_particle_renderer->UpdateParticlePositionsTexture(
+                gpu_sim->GetTexParticlePositions_X(),
+                gpu_sim->GetTexParticlePositions_Y(),
+                gpu_sim->GetTexParticlePositions_Z()
+            );
+            g_particle_renderer->Draw();
+        }
+        {
+            GPUProfiler::Scope scope(g_gpu_profiler, "skybox");
+            g_skybox->Draw();
+        }
+
+        if (window != nullptr) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+    glFinish();
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    g_gpu_profiler->Flush();
+
+    // One "name: value" per line so that CI can pick the numbers out
+    printf("benchmark frames: %d\n", frames);
+    printf("benchmark renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    printf("benchmark wall ms/frame: %.3f\n", total_ms / frames);
+    printf("benchmark water render scale: %.3f\n", g_particle_renderer->GetRenderScale());
+    for (const GPUProfiler::Result& result : g_gpu_profiler->GetResults()) {
+        printf("benchmark gpu ms %s: %.3f\n", result.name.c_str(), result.average_ms);
+    }
+    CPU_Simulation* cpu_sim = dynamic_cast<CPU_Simulation*>(g_sim);
+    if (cpu_sim != nullptr) {
+        printf("benchmark cpu threads: %u\n", cpu_sim->GetThreadCount());
+        for (const std::pair<const std::string, double>& kernel : cpu_sim->GetKernelTimes()) {
+            printf("benchmark cpu ms %s: %.3f\n", kernel.first.c_str(), kernel.second);
+        }
+    }
+}
+
+/*
+ * Runs the selected simulation and another one side by side from the same initial
+ * state and prints how far apart they get, phase by phase where both support it.
+ * Returns false if anything went over its tolerance.
+ */
+bool RunDiff(SimulationType other_type, int steps, const std::vector<std::pair<SimulationDiff::Field, float>>& tolerances)
+{
+    const float time_step = 1.0f / 60.0f;
+    Simulation* sim_a = CreateSimulation(simulation_type);
+    Simulation* sim_b = CreateSimulation(other_type);
+    for (Simulation* sim : { sim_a, sim_b }) {
+        // CPU_Simulation only has the red-black solver, so the GPU uses it too
+        GPU_Simulation* gpu_sim = dynamic_cast<GPU_Simulation*>(sim);
+        if (gpu_sim != nullptr) {
+            gpu_sim->SetPressureSolver(GPU_Simulation::RED_BLACK);
+            gpu_sim->SetProfiler(nullptr);
+        }
+    }
+
+    SimulationDiff diff(sim_a, sim_b);
+    for (const std::pair<SimulationDiff::Field, float>& tolerance : tolerances) {
+        diff.SetTolerance(tolerance.first, tolerance.second);
+    }
+    bool passed = diff.SetInitialState(GetInitialParticleVelocities(), kLowerBound, kUpperBound, kGridInterval);
+    passed &= diff.Run(steps, time_step);
+    diff.PrintReport();
+
+    delete sim_a;
+    delete sim_b;
+    return passed;
+}
+
+std::vector<unsigned int> ReadPrimitivesBuffer(GLuint buffer, unsigned int count)
+{
+    std::vector<unsigned int> data(count);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(unsigned int), data.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return data;
+}
+
+/*
+ * Runs the scan, radix sort and compaction of GPUPrimitives on random data and
+ * compares them with the standard library, for sizes around the block size and
+ * its powers as well as up to a few hundred thousand elements.
+ * Returns false if any result differs.
+ */
+bool RunPrimitivesTest()
+{
+    const unsigned int sizes[] = { 1, 2, 3, 255, 256, 257, 1000, 65535, 65536, 65537, 100003, 300000 };
+    GPUPrimitives primitives;
+    std::mt19937 rng(1);
+    bool passed = true;
+    for (unsigned int count : sizes) {
+        // Exclusive scan
+        std::vector<unsigned int> input(count);
+        for (unsigned int& value : input) {
+            value = rng() % 16;
+        }
+        std::vector<unsigned int> expected_scan(count, 0);
+        std::partial_sum(input.begin(), input.end() - 1, expected_scan.begin() + 1);
+        GLuint input_buffer = GPUPrimitives::GenerateBuffer(count, input.data());
+        GLuint output_buffer = GPUPrimitives::GenerateBuffer(count);
+        primitives.ExclusiveScan(input_buffer, output_buffer, count);
+        bool scan_passed = ReadPrimitivesBuffer(output_buffer, count) == expected_scan;
+
+        // Key-value radix sort, stable, on all 32 bits and on the lowest 17
+        bool sort_passed = true;
+        std::vector<unsigned int> sorted_keys;
+        for (unsigned int key_bits : { 32u, 17u }) {
+            std::vector<unsigned int> keys(count);
+            std::vector<unsigned int> values(count);
+            for (unsigned int i = 0; i < count; i++) {
+                keys[i] = key_bits == 32 ? (unsigned int)rng() : (unsigned int)rng() % (1u << key_bits);
+                values[i] = i;
+            }
+            std::vector<unsigned int> expected_values = values;
+            std::stable_sort(expected_values.begin(), expected_values.end(), [&](unsigned int a, unsigned int b) { return keys[a] < keys[b]; });
+            std::vector<unsigned int> expected_keys(count);
+            for (unsigned int i = 0; i < count; i++) {
+                expected_keys[i] = keys[expected_values[i]];
+            }
+            GLuint keys_buffer = GPUPrimitives::GenerateBuffer(count, keys.data());
+            GLuint values_buffer = GPUPrimitives::GenerateBuffer(count, values.data());
+            primitives.RadixSort(keys_buffer, values_buffer, count, key_bits);
+            sorted_keys = ReadPrimitivesBuffer(keys_buffer, count);
+            sort_passed &= sorted_keys == expected_keys && ReadPrimitivesBuffer(values_buffer, count) == expected_values;
+            glDeleteBuffers(1, &keys_buffer);
+            glDeleteBuffers(1, &values_buffer);
+        }
+
+        // Compaction of the sorted keys, keeping about a third of them
+        std::vector<unsigned int> flags(count);
+        for (unsigned int& flag : flags) {
+            flag = rng() % 3 == 0 ? 1 : 0;
+        }
+        std::vector<unsigned int> expected_compact;
+        unsigned int index = 0;
+        std::copy_if(sorted_keys.begin(), sorted_keys.end(), std::back_inserter(expected_compact), [&](unsigned int) { return flags[index++] != 0; });
+        GLuint flags_buffer = GPUPrimitives::GenerateBuffer(count, flags.data());
+        GLuint count_buffer = GPUPrimitives::GenerateBuffer(1);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, input_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(unsigned int), sorted_keys.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        primitives.Compact(input_buffer, flags_buffer, output_buffer, count_buffer, count);
+        unsigned int compact_count = GPUPrimitives::ReadCount(count_buffer);
+        bool compact_passed = compact_count == expected_compact.size();
+        if (compact_passed) {
+            std::vector<unsigned int> compacted = ReadPrimitivesBuffer(output_buffer, count);
+            compact_passed = std::equal(expected_compact.begin(), expected_compact.end(), compacted.begin());
+        }
+
+        printf("primitives n=%u: scan %s, sort %s, compact %s\n", count,
+            scan_passed ? "ok" : "FAILED", sort_passed ? "ok" : "FAILED", compact_passed ? "ok" : "FAILED");
+        passed &= scan_passed && sort_passed && compact_passed;
+        glDeleteBuffers(1, &input_buffer);
+        glDeleteBuffers(1, &output_buffer);
+        glDeleteBuffers(1, &flags_buffer);
+        glDeleteBuffers(1, &count_buffer);
+    }
+    return passed;
+}
+
+bool ParseSimulationType(const char* name, SimulationType& type)
+{
+    if (strcmp(name, "gpu") == 0)
+        type = SimulationType::GPU_PARTICLE;
+    else if (strcmp(name, "cpu") == 0)
+        type = SimulationType::CPU_PARTICLE;
+    else if (strcmp(name, "seq_grid") == 0)
+        type = SimulationType::SEQ_GRID;
+    else if (strcmp(name, "seq_particle") == 0)
+        type = SimulationType::SEQ_PARTICLE;
+    else
+        return false;
+    return true;
+}
+
+void PrintUsage(const char* program)
 {
-    if (!Init()) 
+    printf("Usage: %s [--headless] [--benchmark <frames>] [--sim <type>] [--water-budget <ms>] [--diff <type> <steps> [--tolerance <field> <value>]...] [--test-primitives]\n", program);
+    printf("  --headless                  Run without a window (needs a build with WATERFLOW_HEADLESS)\n");
+    printf("  --benchmark <frames>        Time a fixed number of steps and frames, then exit\n");
+    printf("  --sim <type>                The simulation to start with: gpu, cpu, seq_grid or seq_particle\n");
+    printf("  --water-budget <ms>         GPU time per frame for the water depth, its resolution adapts to fit.\n");
+    printf("                              0 keeps half resolution, the default for --benchmark\n");
+    printf("  --diff <type> <steps>       Compare the --sim simulation with another for a number of steps, then exit\n");
+    printf("  --tolerance <field> <value> The largest difference of a field --diff accepts, fields are:\n");
+    printf("%30s", "");
+    for (int field = 0; field < SimulationDiff::NUM_FIELDS; field++) {
+        printf(" %s", SimulationDiff::GetFieldName((SimulationDiff::Field)field));
+    }
+    printf("\n");
+    printf("  --test-primitives           Check the GPU scan, radix sort and compaction against the CPU, then exit\n");
+}
+
+int main(int argc, char** argv) 
+{
+    bool headless = false;
+    int benchmark_frames = 0;
+    int diff_steps = 0;
+    bool test_primitives = false;
+    float water_budget_ms = -1.0f;
+    SimulationType diff_type = simulation_type;
+    std::vector<std::pair<SimulationDiff::Field, float>> diff_tolerances;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmark_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sim") == 0 && i + 1 < argc) {
+            if (!ParseSimulationType(argv[++i], simulation_type)) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--water-budget") == 0 && i + 1 < argc) {
+            water_budget_ms = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--diff") == 0 && i + 2 < argc) {
+            if (!ParseSimulationType(argv[++i], diff_type)) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+            diff_steps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 2 < argc) {
+            SimulationDiff::Field field;
+            if (!SimulationDiff::GetFieldByName(argv[++i], field)) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+            diff_tolerances.push_back(std::make_pair(field, (float)atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--test-primitives") == 0) {
+            test_primitives = true;
+        }
+        else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (headless && benchmark_frames <= 0 && diff_steps <= 0 && !test_primitives) {
+        fprintf(stderr, "--headless has nothing to show, use it with --benchmark, --diff or --test-primitives.\n");
+        return 1;
+    }
+
+    if (headless ? !InitHeadless() : !Init()) 
     {
-        fprintf(stderr, "Failure in initializing the window.");
+        fprintf(stderr, headless ? "Failure in creating the headless context." : "Failure in initializing the window.");
         return 1;
     }
 
-    if (!LoadContent()) {
+    int exit_code = 0;
+    if (test_primitives) {
+        exit_code = RunPrimitivesTest() ? 0 : 1;
+    }
+    else if (diff_steps > 0) {
+        // Needs no content, only the GL context for the GPU simulation
+        exit_code = RunDiff(diff_type, diff_steps, diff_tolerances) ? 0 : 1;
+    }
+    else if (!LoadContent()) {
         fprintf(stderr, "Failure in loading content.");
         return 1;
     }
-    printf("Just before update begins\n");
-    UpdateLoop();
-    glfwTerminate();
+    else {
+        if (water_budget_ms >= 0.0f) {
+            g_particle_renderer->SetGPUTimeBudget(water_budget_ms);
+        }
+        else if (benchmark_frames > 0) {
+            // A fixed resolution, so that runs stay comparable
+            g_particle_renderer->SetGPUTimeBudget(0.0f);
+        }
+        if (benchmark_frames > 0) {
+            RunBenchmark(benchmark_frames);
+        }
+        else {
+            printf("Just before update begins\n");
+            UpdateLoop();
+        }
+    }
 
     delete g_sim;
     delete g_cam;
     delete g_debug_renderer;
+    delete g_gpu_profiler;
     delete g_skybox;
+    delete g_particle_renderer;
 
-	return 0;
+    if (g_headless_context != nullptr) {
+        delete g_headless_context;
+    }
+    else {
+        glfwTerminate();
+    }
+	return exit_code;
 }
\ No newline at end of file
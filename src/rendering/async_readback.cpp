@@ -0,0 +1,161 @@
+#include "async_readback.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+void AsyncReadback::Consume(Slot& slot)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	// An older copy can't complete after a newer one, but don't count on it
+	if (slot.tag <= data_tag_) {
+		return;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_, GL_MAP_READ_BIT);
+	if (mapped == nullptr) {
+		fprintf(stderr, "AsyncReadback::Consume() failed to map the readback buffer.\n");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return;
+	}
+	data_.resize(size_);
+	memcpy(&data_[0], mapped, size_);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	data_tag_ = slot.tag;
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+AsyncReadback::AsyncReadback() : size_(0), last_requested_(-1), data_tag_(-1)
+{
+	for (Slot& slot : slots_) {
+		slot.buffer = 0;
+		slot.fence = 0;
+		slot.tag = -1;
+	}
+}
+
+AsyncReadback::~AsyncReadback()
+{
+	for (Slot& slot : slots_) {
+		if (slot.fence != 0) {
+			glDeleteSync(slot.fence);
+		}
+		if (slot.buffer != 0) {
+			glDeleteBuffers(1, &slot.buffer);
+		}
+	}
+}
+
+void AsyncReadback::Resize(unsigned int size)
+{
+	size_ = size;
+	for (Slot& slot : slots_) {
+		if (slot.fence != 0) {
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+		if (slot.buffer == 0) {
+			glGenBuffers(1, &slot.buffer);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size_, nullptr, GL_STREAM_READ);
+		slot.tag = -1;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	data_.clear();
+	data_tag_ = -1;
+	last_requested_ = -1;
+}
+
+bool AsyncReadback::Request(const std::vector<Source>& sources, long long tag)
+{
+	Slot* free_slot = nullptr;
+	for (Slot& slot : slots_) {
+		if (slot.buffer != 0 && slot.fence == 0) {
+			free_slot = &slot;
+			break;
+		}
+	}
+	if (free_slot == nullptr) {
+		return false;
+	}
+
+	unsigned int total = 0;
+	for (const Source& source : sources) {
+		total += source.size;
+	}
+	if (total > size_) {
+		fprintf(stderr, "AsyncReadback::Request() needs %u bytes but the buffers hold %u.\n", total, size_);
+		return false;
+	}
+
+	// With a pack buffer bound, glGetTexImage takes an offset into it and returns right away
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, free_slot->buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	unsigned int offset = 0;
+	for (const Source& source : sources) {
+		glBindTexture(source.target, source.texture);
+		glGetTexImage(source.target, 0, source.format, source.type, (void*)(GLintptr)offset);
+		glBindTexture(source.target, 0);
+		offset += source.size;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	free_slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	free_slot->tag = tag;
+	last_requested_ = tag;
+	return true;
+}
+
+bool AsyncReadback::Poll(bool wait)
+{
+	long long previous_tag = data_tag_;
+	while (true) {
+		// Oldest copy in flight first
+		Slot* oldest = nullptr;
+		for (Slot& slot : slots_) {
+			if (slot.fence != 0 && (oldest == nullptr || slot.tag < oldest->tag)) {
+				oldest = &slot;
+			}
+		}
+		if (oldest == nullptr) {
+			break;
+		}
+
+		GLenum status = glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? k_wait_timeout_ : 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			Consume(*oldest);
+		}
+		else {
+			if (status == GL_WAIT_FAILED) {
+				fprintf(stderr, "AsyncReadback::Poll() failed waiting on a readback fence.\n");
+			}
+			break;
+		}
+	}
+	return data_tag_ > previous_tag;
+}
+
+const std::vector<unsigned char>& AsyncReadback::GetData() const
+{
+	return data_;
+}
+
+long long AsyncReadback::GetTag() const
+{
+	return data_tag_;
+}
+
+long long AsyncReadback::GetLastRequested() const
+{
+	return last_requested_;
+}
@@ -0,0 +1,124 @@
+#ifndef ASYNC_READBACK_H
+#define ASYNC_READBACK_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+/*
+* @brief
+* Copies texture data from the GPU to the CPU without stalling the pipeline.
+*
+* Each Request() queues a copy of some textures into a pixel pack buffer and
+* places a fence behind it. Poll() checks the fences and, once a copy has landed,
+* maps the buffer and keeps the bytes. Callers always get the most recent copy
+* that has completed, together with the tag they gave it (e.g. the simulation
+* step), so they know how stale it is.
+*
+* A small ring of buffers is used so that new copies can be queued while older
+* ones are still in flight. If every buffer is busy, Request() is skipped rather
+* than waited on.
+*
+* Usage:
+*	readback.Poll(false);
+*	readback.Request(sources, step);
+*	if (readback.GetTag() >= 0) Use(readback.GetData());
+*/
+class AsyncReadback {
+public:
+	/*
+	* @brief
+	* One texture to copy. Textures are copied back to back in the order
+	* given, each taking size bytes.
+	*/
+	struct Source {
+		GLenum target;
+		GLuint texture;
+		GLenum format;
+		GLenum type;
+		unsigned int size;
+	};
+
+private:
+	/// <summary>
+	/// The number of copies that can be in flight at once.
+	/// </summary>
+	static const unsigned int k_num_slots_ = 3;
+
+	/// <summary>
+	/// How long Poll(true) waits on a fence before giving up, in nanoseconds.
+	/// </summary>
+	static const GLuint64 k_wait_timeout_ = 1000000000;
+
+	struct Slot {
+		GLuint buffer;
+		GLsync fence;
+		long long tag;
+	};
+
+	Slot slots_[k_num_slots_];
+	unsigned int size_;
+	long long last_requested_;
+
+	std::vector<unsigned char> data_;
+	long long data_tag_;
+
+	void Consume(Slot& slot);
+
+public:
+	AsyncReadback();
+	~AsyncReadback();
+
+	/*
+	* @brief
+	* Allocates the buffers. Every request must copy at most size bytes.
+	* Discards anything in flight.
+	*/
+	void Resize(unsigned int size);
+
+	/*
+	* @brief
+	* Queues a copy of the sources into a free buffer. Any shader writes to the
+	* textures must be made visible with GL_TEXTURE_UPDATE_BARRIER_BIT first.
+	*
+	* @param
+	* tag: Identifies the copy, e.g. the step it was taken at. Tags should
+	* increase from one request to the next.
+	*
+	* @return
+	* Returns false if every buffer is still in flight or the sources don't fit.
+	*/
+	bool Request(const std::vector<Source>& sources, long long tag);
+
+	/*
+	* @brief
+	* Takes in every copy that has completed.
+	*
+	* @param
+	* wait: Block until every copy in flight has completed.
+	*
+	* @return
+	* Returns true if newer data is available than before the call.
+	*/
+	bool Poll(bool wait);
+
+	/*
+	* @brief
+	* The bytes of the most recent completed copy.
+	*/
+	const std::vector<unsigned char>& GetData() const;
+
+	/*
+	* @brief
+	* The tag of the data returned by GetData(), or -1 if no copy has completed yet.
+	*/
+	long long GetTag() const;
+
+	/*
+	* @brief
+	* The tag of the last copy queued, or -1 if none has been.
+	*/
+	long long GetLastRequested() const;
+};
+
+#endif // !ASYNC_READBACK_H
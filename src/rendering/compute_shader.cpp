@@ -13,10 +13,10 @@
 ///	Public Methods ///
 //////////////////////
 
-ComputeShader::ComputeShader(const std::string& compute_shader_file_name, const glm::ivec3& work_group_dim) 
+ComputeShader::ComputeShader(const std::string& compute_shader_file_name, const glm::ivec3& work_group_dim, const ShaderDefines& defines) 
     : Shader(), work_group_dim_(work_group_dim)
 {
-	const std::string shader_code = LoadFile(compute_shader_file_name);
+	const std::string shader_code = LoadFile(compute_shader_file_name, defines);
 
     printf("Work Group Sizes: %d, %d, %d\n", work_group_dim_.x, work_group_dim_.y, work_group_dim_.z);
 
@@ -29,6 +29,11 @@ ComputeShader::ComputeShader(const std::string& compute_shader_file_name, const
         return;
     }
 
+    if (LoadCachedProgram({ shader_code }))
+    {
+        return;
+    }
+
     GLuint comp_shader_obj = glCreateShader(GL_COMPUTE_SHADER);
     if (shader_code.empty() || comp_shader_obj == 0) 
     {
@@ -73,11 +78,27 @@ void ComputeShader::Barrier()
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
+void ComputeShader::Barrier(GLbitfield barrier_bits)
+{
+    glMemoryBarrier(barrier_bits);
+}
+
 void ComputeShader::Dispatch()
 {
     glDispatchCompute(work_group_dim_.x, work_group_dim_.y, work_group_dim_.z);
 }
 
+void ComputeShader::Dispatch(const glm::ivec3& work_group_count)
+{
+    glDispatchCompute(work_group_count.x, work_group_count.y, work_group_count.z);
+}
+
+void ComputeShader::DispatchIndirect(GLuint indirect_buffer, GLintptr offset)
+{
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirect_buffer);
+    glDispatchComputeIndirect(offset);
+}
+
 GLuint ComputeShader::GenerateAndBindSSBO(const void* data, unsigned int data_size, GLuint target_binding)
 {
     GLuint ssbo;
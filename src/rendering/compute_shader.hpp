@@ -25,8 +25,12 @@ public:
 	* @param
 	* work_group_dim: Defines the dimensions of the work group for the compute shader. For
 	* a 2D work group, we use (x, y, 1).
+	* 
+	* @param
+	* defines: Constants injected into the source (see ShaderDefines), such as the
+	* problem size or local work group size the shader is specialized for.
 	*/
-	ComputeShader(const std::string& compute_shader_file_name, const glm::ivec3& work_group_dim);
+	ComputeShader(const std::string& compute_shader_file_name, const glm::ivec3& work_group_dim, const ShaderDefines& defines = ShaderDefines());
 
 	/*
 	* @brief
@@ -38,6 +42,17 @@ public:
 	*/
 	void Barrier();
 
+	/*
+	* @brief
+	* Same as Barrier(), but with the barrier bits given explicitly. Use
+	* GL_SHADER_STORAGE_BARRIER_BIT when the next dispatch reads SSBOs written
+	* by this one.
+	* 
+	* @param
+	* barrier_bits: The bits passed along to glMemoryBarrier.
+	*/
+	void Barrier(GLbitfield barrier_bits);
+
 	/*
 	* @brief
 	* Has the compute shader execute on the GPU when called. This is called before
@@ -45,6 +60,31 @@ public:
 	*/
 	void Dispatch();
 
+	/*
+	* @brief
+	* Dispatches the compute shader with a work group count given at call time
+	* rather than the one given in the constructor. Useful for shaders that run
+	* over buffers whose size changes between calls.
+	* 
+	* @param
+	* work_group_count: The number of work groups to dispatch in x, y, z.
+	*/
+	void Dispatch(const glm::ivec3& work_group_count);
+
+	/*
+	* @brief
+	* Dispatches the compute shader with the work group count read from a buffer
+	* on the GPU (three consecutive uints). This lets earlier compute passes decide how much
+	* work a later pass does (or skip it with a count of 0) without a round trip to the CPU.
+	* 
+	* @param
+	* indirect_buffer: The buffer holding the work group counts.
+	* 
+	* @param
+	* offset: The offset in bytes of the counts within the buffer. Must be a multiple of 4.
+	*/
+	void DispatchIndirect(GLuint indirect_buffer, GLintptr offset);
+
 	/*
 	* @brief
 	* Generates and binds an SSBO (Shader Storage Buffer Object) to
@@ -0,0 +1,247 @@
+#include "gpu_primitives.hpp"
+
+#include <cstdio>
+#include <utility>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+unsigned int GPUPrimitives::NumBlocks(unsigned int count)
+{
+	return (count + k_block_size_ - 1) / k_block_size_;
+}
+
+void GPUPrimitives::EnsureCapacity(ScratchBuffer& scratch, unsigned int count)
+{
+	if (scratch.buffer != 0 && scratch.capacity >= count)
+	{
+		return;
+	}
+	if (scratch.buffer != 0)
+	{
+		glDeleteBuffers(1, &scratch.buffer);
+	}
+	// Never allocate an empty buffer so that there is always something to bind
+	scratch.capacity = count > 0 ? count : 1;
+	scratch.buffer = GenerateBuffer(scratch.capacity);
+}
+
+void GPUPrimitives::ExclusiveScanLevel(GLuint input, GLuint output, unsigned int count, unsigned int level)
+{
+	unsigned int num_blocks = NumBlocks(count);
+
+	if (scan_levels_.size() <= level)
+	{
+		scan_levels_.resize(level + 1, ScratchBuffer{ 0, 0 });
+	}
+	EnsureCapacity(scan_levels_[level], num_blocks);
+	GLuint block_sums = scan_levels_[level].buffer;
+
+	WorkGroupExclusiveScan(input, output, count, num_blocks > 1 ? block_sums : 0);
+
+	if (num_blocks > 1)
+	{
+		// Scan the totals of the blocks in place, then offset every block by the
+		// sum of the blocks before it.
+		ExclusiveScanLevel(block_sums, block_sums, num_blocks, level + 1);
+
+		add_block_sums_shader_.SetUniform1ui("count", count);
+		add_block_sums_shader_.SetActive();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, output);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, block_sums);
+		add_block_sums_shader_.Dispatch(glm::ivec3(num_blocks, 1, 1));
+		add_block_sums_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+GPUPrimitives::GPUPrimitives() :
+	scan_blocks_shader_("compute/primitives/scan_blocks.comp", glm::ivec3(1)),
+	add_block_sums_shader_("compute/primitives/add_block_sums.comp", glm::ivec3(1)),
+	radix_count_shader_("compute/primitives/radix_count.comp", glm::ivec3(1)),
+	radix_scatter_shader_("compute/primitives/radix_scatter.comp", glm::ivec3(1)),
+	compact_scatter_shader_("compute/primitives/compact_scatter.comp", glm::ivec3(1)),
+	sort_keys_{ 0, 0 },
+	sort_values_{ 0, 0 },
+	sort_histogram_{ 0, 0 },
+	compact_offsets_{ 0, 0 }
+{
+}
+
+GPUPrimitives::~GPUPrimitives()
+{
+	for (ScratchBuffer& level : scan_levels_)
+	{
+		glDeleteBuffers(1, &level.buffer);
+	}
+	ScratchBuffer* scratch[] = { &sort_keys_, &sort_values_, &sort_histogram_, &compact_offsets_ };
+	for (ScratchBuffer* s : scratch)
+	{
+		if (s->buffer != 0)
+		{
+			glDeleteBuffers(1, &s->buffer);
+		}
+	}
+}
+
+GLuint GPUPrimitives::GenerateBuffer(unsigned int count, const void* data)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return buffer;
+}
+
+unsigned int GPUPrimitives::ReadCount(GLuint count_buffer)
+{
+	GLuint count = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, count_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return count;
+}
+
+void GPUPrimitives::WorkGroupExclusiveScan(GLuint input, GLuint output, unsigned int count, GLuint block_sums)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	scan_blocks_shader_.SetUniform1ui("count", count);
+	scan_blocks_shader_.SetUniform1ui("write_block_sums", block_sums != 0 ? 1 : 0);
+	scan_blocks_shader_.SetActive();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+	// The block sums binding is never written when block_sums is 0, but
+	// keep something valid bound to it.
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, block_sums != 0 ? block_sums : output);
+	scan_blocks_shader_.Dispatch(glm::ivec3(NumBlocks(count), 1, 1));
+	scan_blocks_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GPUPrimitives::ExclusiveScan(GLuint input, GLuint output, unsigned int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	ExclusiveScanLevel(input, output, count, 0);
+}
+
+void GPUPrimitives::RadixSort(GLuint keys, GLuint values, unsigned int count, unsigned int key_bits)
+{
+	if (count <= 1 || key_bits == 0)
+	{
+		return;
+	}
+	if (key_bits > 32)
+	{
+		fprintf(stderr, "GPUPrimitives::RadixSort() only supports keys of up to 32 bits, got %u.\n", key_bits);
+		key_bits = 32;
+	}
+
+	unsigned int num_blocks = NumBlocks(count);
+	unsigned int num_passes = (key_bits + k_radix_bits_ - 1) / k_radix_bits_;
+	bool has_values = values != 0;
+
+	EnsureCapacity(sort_keys_, count);
+	if (has_values)
+	{
+		EnsureCapacity(sort_values_, count);
+	}
+	EnsureCapacity(sort_histogram_, k_radix_size_ * num_blocks);
+
+	radix_count_shader_.SetUniform1ui("count", count);
+	radix_count_shader_.SetUniform1ui("num_blocks", num_blocks);
+	radix_scatter_shader_.SetUniform1ui("count", count);
+	radix_scatter_shader_.SetUniform1ui("num_blocks", num_blocks);
+	radix_scatter_shader_.SetUniform1ui("has_values", has_values ? 1 : 0);
+
+	// Ping-pong between the caller's buffers and the scratch buffers
+	GLuint keys_in = keys;
+	GLuint keys_out = sort_keys_.buffer;
+	GLuint values_in = has_values ? values : keys;
+	GLuint values_out = has_values ? sort_values_.buffer : keys_out;
+
+	for (unsigned int pass = 0; pass < num_passes; ++pass)
+	{
+		unsigned int shift = pass * k_radix_bits_;
+
+		// (1) Digit histogram of every block
+		radix_count_shader_.SetUniform1ui("shift", shift);
+		radix_count_shader_.SetActive();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keys_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sort_histogram_.buffer);
+		radix_count_shader_.Dispatch(glm::ivec3(num_blocks, 1, 1));
+		radix_count_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// (2) Global offset of every (digit, block) pair
+		ExclusiveScan(sort_histogram_.buffer, sort_histogram_.buffer, k_radix_size_ * num_blocks);
+
+		// (3) Move the keys to their place for this digit
+		radix_scatter_shader_.SetUniform1ui("shift", shift);
+		radix_scatter_shader_.SetActive();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keys_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, values_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, keys_out);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, values_out);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, sort_histogram_.buffer);
+		radix_scatter_shader_.Dispatch(glm::ivec3(num_blocks, 1, 1));
+		radix_scatter_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		std::swap(keys_in, keys_out);
+		if (has_values)
+		{
+			std::swap(values_in, values_out);
+		}
+	}
+
+	// After an odd number of passes the result lives in the scratch buffers
+	if (num_passes % 2 == 1)
+	{
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, sort_keys_.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, keys);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * sizeof(GLuint));
+		if (has_values)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, sort_values_.buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, values);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * sizeof(GLuint));
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
+
+void GPUPrimitives::Compact(GLuint input, GLuint flags, GLuint output, GLuint output_count, unsigned int count)
+{
+	if (count == 0)
+	{
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, output_count);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return;
+	}
+
+	EnsureCapacity(compact_offsets_, count);
+	ExclusiveScan(flags, compact_offsets_.buffer, count);
+
+	compact_scatter_shader_.SetUniform1ui("count", count);
+	compact_scatter_shader_.SetActive();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, flags);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, compact_offsets_.buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, output_count);
+	compact_scatter_shader_.Dispatch(glm::ivec3(NumBlocks(count), 1, 1));
+	compact_scatter_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,170 @@
+#ifndef GPU_PRIMITIVES_H
+#define GPU_PRIMITIVES_H
+
+#include <vector>
+
+#include "compute_shader.hpp"
+
+/*
+* @brief
+* A small library of data-parallel building blocks that run as compute shaders
+* over SSBOs of uints: exclusive scan (per work group and device-wide), stable
+* key-value radix sort and stream compaction.
+*
+* Buffers passed in are plain OpenGL buffer ids (see GenerateBuffer()) and are
+* bound as SSBOs internally. All of the work stays on the GPU; nothing is read
+* back unless ReadCount() is called. The shaders only use GL 4.3 core features
+* (no subgroup extensions) so they behave the same on Mesa's llvmpipe.
+*
+* Results are visible to later compute dispatches reading SSBOs. If the results
+* are consumed some other way (as vertex data, indirect commands, ...) the caller
+* must issue the matching glMemoryBarrier bit.
+*/
+class GPUPrimitives {
+private:
+	/// <summary>
+	/// The number of elements each work group of the primitive shaders
+	/// processes. Must match the local_size_x of the shaders in
+	/// "resources/shaders/compute/primitives/".
+	/// </summary>
+	static const unsigned int k_block_size_ = 256;
+
+	/// <summary>
+	/// Each radix sort pass sorts on this many bits of the key.
+	/// </summary>
+	static const unsigned int k_radix_bits_ = 4;
+	static const unsigned int k_radix_size_ = 1 << k_radix_bits_;
+
+	ComputeShader scan_blocks_shader_;
+	ComputeShader add_block_sums_shader_;
+	ComputeShader radix_count_shader_;
+	ComputeShader radix_scatter_shader_;
+	ComputeShader compact_scatter_shader_;
+
+	/// <summary>
+	/// A scratch buffer along with the number of uints it can hold.
+	/// Scratch buffers are only ever grown, so repeated calls on the
+	/// same sizes do not allocate.
+	/// </summary>
+	struct ScratchBuffer {
+		GLuint buffer;
+		unsigned int capacity;
+	};
+
+	/// <summary>
+	/// One buffer of block sums for each level of the device-wide scan.
+	/// Level 0 holds the totals of the input's blocks, level 1 the totals
+	/// of level 0's blocks, and so on.
+	/// </summary>
+	std::vector<ScratchBuffer> scan_levels_;
+	ScratchBuffer sort_keys_;
+	ScratchBuffer sort_values_;
+	ScratchBuffer sort_histogram_;
+	ScratchBuffer compact_offsets_;
+
+	void EnsureCapacity(ScratchBuffer& scratch, unsigned int count);
+	void ExclusiveScanLevel(GLuint input, GLuint output, unsigned int count, unsigned int level);
+	static unsigned int NumBlocks(unsigned int count);
+
+public:
+	GPUPrimitives();
+	~GPUPrimitives();
+
+	/*
+	* @brief
+	* Creates a buffer suitable for use with the primitives.
+	*
+	* @param
+	* count: The number of uints the buffer holds.
+	*
+	* @param
+	* data: Optional initial data, count uints long.
+	*
+	* @return
+	* The OpenGL buffer id. The caller owns it and must delete it with glDeleteBuffers.
+	*/
+	static GLuint GenerateBuffer(unsigned int count, const void* data = nullptr);
+
+	/*
+	* @brief
+	* Reads back a single uint written by the GPU, such as the count written by
+	* Compact(). This stalls until the GPU catches up, so use it for debugging and
+	* tests rather than in the update loop.
+	*/
+	static unsigned int ReadCount(GLuint count_buffer);
+
+	/*
+	* @brief
+	* Exclusive scan (prefix sum) of each work-group sized block of the input,
+	* independently of the other blocks.
+	*
+	* @param
+	* input / output: Buffers of at least count uints. May be the same buffer.
+	*
+	* @param
+	* count: The number of elements to scan.
+	*
+	* @param
+	* block_sums: If non-zero, receives the total of each block, which must hold
+	* at least (count + 255) / 256 uints.
+	*/
+	void WorkGroupExclusiveScan(GLuint input, GLuint output, unsigned int count, GLuint block_sums = 0);
+
+	/*
+	* @brief
+	* Exclusive scan (prefix sum) of the whole input. Scans the blocks, then
+	* recursively scans the block totals and adds them back.
+	*
+	* @param
+	* input / output: Buffers of at least count uints. May be the same buffer.
+	*
+	* @param
+	* count: The number of elements to scan.
+	*/
+	void ExclusiveScan(GLuint input, GLuint output, unsigned int count);
+
+	/*
+	* @brief
+	* Stable least-significant-digit radix sort of uint keys, 4 bits per pass.
+	*
+	* @param
+	* keys: The buffer of keys, sorted in place.
+	*
+	* @param
+	* values: A buffer of uint values which is permuted along with the keys.
+	* Pass 0 to sort keys only.
+	*
+	* @param
+	* count: The number of keys.
+	*
+	* @param
+	* key_bits: Only the lowest key_bits of every key are sorted on. Passing the
+	* bit width actually used by the keys (e.g. for cell indices) saves passes.
+	*/
+	void RadixSort(GLuint keys, GLuint values, unsigned int count, unsigned int key_bits = 32);
+
+	/*
+	* @brief
+	* Stream compaction. Copies every input element whose flag is non-zero to
+	* the front of output, keeping their order.
+	*
+	* @param
+	* input: The buffer of count uints to compact.
+	*
+	* @param
+	* flags: A buffer of count uints. Non-zero keeps the matching input element.
+	*
+	* @param
+	* output: Receives the kept elements. Must hold count uints.
+	*
+	* @param
+	* output_count: A buffer of at least one uint which receives the number of
+	* kept elements. It can be used directly for indirect dispatches or draws.
+	*
+	* @param
+	* count: The number of input elements.
+	*/
+	void Compact(GLuint input, GLuint flags, GLuint output, GLuint output_count, unsigned int count);
+};
+
+#endif // !GPU_PRIMITIVES_H
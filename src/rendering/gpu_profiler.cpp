@@ -0,0 +1,235 @@
+#include "gpu_profiler.hpp"
+
+#include <cstdio>
+
+GPUProfiler::Scope::Scope(GPUProfiler* profiler, const char* name) :
+	profiler_(profiler),
+	query_(-1)
+{
+	if (profiler_ != nullptr)
+	{
+		query_ = profiler_->Begin(name);
+	}
+}
+
+GPUProfiler::Scope::~Scope()
+{
+	if (profiler_ != nullptr)
+	{
+		profiler_->End(query_);
+	}
+}
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+unsigned int GPUProfiler::GetSectionId(const std::string& name)
+{
+	auto it = section_ids_.find(name);
+	if (it != section_ids_.end())
+	{
+		return it->second;
+	}
+	Section section;
+	section.name = name;
+	section.history_next = 0;
+	section.last_ms = 0.0f;
+	sections_.push_back(section);
+	section_ids_[name] = (unsigned int)sections_.size() - 1;
+	return (unsigned int)sections_.size() - 1;
+}
+
+void GPUProfiler::CollectFrame(FrameQueries& frame)
+{
+	if (frame.used == 0)
+	{
+		return;
+	}
+
+	// Never wait on the GPU. If a query is somehow still pending this many
+	// frames later, the whole frame is dropped.
+	bool available = true;
+	for (unsigned int i = 0; i < frame.used && available; ++i)
+	{
+		GLint ready = 0;
+		if (frame.queries[i].ended)
+		{
+			glGetQueryObjectiv(frame.queries[i].end, GL_QUERY_RESULT_AVAILABLE, &ready);
+		}
+		available = ready != 0;
+	}
+
+	if (available)
+	{
+		std::vector<float> totals(sections_.size(), -1.0f);
+		for (unsigned int i = 0; i < frame.used; ++i)
+		{
+			const TimerQuery& query = frame.queries[i];
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+			float ms = end > begin ? (float)((end - begin) / 1.0e6) : 0.0f;
+			totals[query.section] = (totals[query.section] < 0.0f ? 0.0f : totals[query.section]) + ms;
+		}
+		for (unsigned int s = 0; s < sections_.size(); ++s)
+		{
+			if (totals[s] < 0.0f)
+			{
+				continue;
+			}
+			Section& section = sections_[s];
+			if (section.history.size() < k_history_length_)
+			{
+				section.history.push_back(totals[s]);
+			}
+			else
+			{
+				section.history[section.history_next] = totals[s];
+			}
+			section.history_next = (section.history_next + 1) % k_history_length_;
+			section.last_ms = totals[s];
+		}
+	}
+	frame.used = 0;
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+GPUProfiler::GPUProfiler() :
+	current_frame_(0),
+	supported_(false),
+	enabled_(true)
+{
+	for (FrameQueries& frame : frames_)
+	{
+		frame.used = 0;
+	}
+
+	GLint counter_bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counter_bits);
+	supported_ = counter_bits > 0;
+	if (!supported_)
+	{
+		fprintf(stderr, "GPUProfiler: the GL implementation has no timestamp counter, GPU profiling is disabled.\n");
+	}
+}
+
+GPUProfiler::~GPUProfiler()
+{
+	for (FrameQueries& frame : frames_)
+	{
+		for (TimerQuery& query : frame.queries)
+		{
+			glDeleteQueries(1, &query.begin);
+			glDeleteQueries(1, &query.end);
+		}
+	}
+}
+
+void GPUProfiler::BeginFrame()
+{
+	current_frame_ = (current_frame_ + 1) % k_frames_in_flight_;
+	CollectFrame(frames_[current_frame_]);
+}
+
+void GPUProfiler::Flush()
+{
+	glFinish();
+	// Oldest frame first, ending with the current one
+	for (unsigned int i = 1; i <= k_frames_in_flight_; ++i)
+	{
+		CollectFrame(frames_[(current_frame_ + i) % k_frames_in_flight_]);
+	}
+}
+
+int GPUProfiler::Begin(const char* name)
+{
+	if (!supported_ || !enabled_)
+	{
+		return -1;
+	}
+
+	FrameQueries& frame = frames_[current_frame_];
+	if (frame.used == frame.queries.size())
+	{
+		TimerQuery query;
+		glGenQueries(1, &query.begin);
+		glGenQueries(1, &query.end);
+		frame.queries.push_back(query);
+	}
+	TimerQuery& query = frame.queries[frame.used];
+	query.section = GetSectionId(name);
+	query.ended = false;
+	glQueryCounter(query.begin, GL_TIMESTAMP);
+	return (int)frame.used++;
+}
+
+void GPUProfiler::End(int query)
+{
+	FrameQueries& frame = frames_[current_frame_];
+	if (query < 0 || (unsigned int)query >= frame.used)
+	{
+		return;
+	}
+	glQueryCounter(frame.queries[query].end, GL_TIMESTAMP);
+	frame.queries[query].ended = true;
+}
+
+void GPUProfiler::SetEnabled(bool enabled)
+{
+	enabled_ = enabled;
+}
+
+bool GPUProfiler::IsEnabled() const
+{
+	return supported_ && enabled_;
+}
+
+bool GPUProfiler::GetAverage(const std::string& name, float& average_ms) const
+{
+	auto it = section_ids_.find(name);
+	if (it == section_ids_.end() || sections_[it->second].history.empty())
+	{
+		return false;
+	}
+	const std::vector<float>& history = sections_[it->second].history;
+	float sum = 0.0f;
+	for (float ms : history)
+	{
+		sum += ms;
+	}
+	average_ms = sum / history.size();
+	return true;
+}
+
+bool GPUProfiler::GetLast(const std::string& name, float& last_ms) const
+{
+	auto it = section_ids_.find(name);
+	if (it == section_ids_.end() || sections_[it->second].history.empty())
+	{
+		return false;
+	}
+	last_ms = sections_[it->second].last_ms;
+	return true;
+}
+
+std::vector<GPUProfiler::Result> GPUProfiler::GetResults() const
+{
+	std::vector<Result> results;
+	for (const Section& section : sections_)
+	{
+		Result result;
+		result.name = section.name;
+		result.last_ms = section.last_ms;
+		if (!GetAverage(section.name, result.average_ms))
+		{
+			continue;
+		}
+		results.push_back(result);
+	}
+	return results;
+}
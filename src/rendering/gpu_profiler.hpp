@@ -0,0 +1,171 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+* @brief
+* Measures how long named sections of GPU work (compute dispatches, draw passes)
+* take using GL_TIMESTAMP queries.
+*
+* Timestamps are written at the start and end of every section, so sections can
+* nest and can be entered several times per frame (the times are summed). The
+* queries of a frame are only read back k_frames_in_flight_ frames later, once
+* the GPU is done with them, so profiling never stalls the pipeline. Results that
+* are still not available by then are dropped rather than waited on.
+*
+* Usage:
+*	profiler.BeginFrame();	// once per frame
+*	{
+*		GPUProfiler::Scope scope(&profiler, "particle_to_grid");
+*		shader.Dispatch();
+*	}
+*/
+class GPUProfiler {
+public:
+	/*
+	* @brief
+	* The timing of one section, averaged over the last k_history_length_
+	* frames it was recorded in.
+	*/
+	struct Result {
+		std::string name;
+		float last_ms;
+		float average_ms;
+	};
+
+	/*
+	* @brief
+	* Times the GPU work issued during its lifetime. The profiler may be
+	* null, in which case the scope does nothing, so callers don't need
+	* to check whether profiling is on.
+	*/
+	class Scope {
+	private:
+		GPUProfiler* profiler_;
+		int query_;
+
+	public:
+		Scope(GPUProfiler* profiler, const char* name);
+		~Scope();
+	};
+
+private:
+	/// <summary>
+	/// Queries are read back this many frames after they are issued.
+	/// </summary>
+	static const unsigned int k_frames_in_flight_ = 4;
+
+	/// <summary>
+	/// The number of frames the rolling average of a section covers.
+	/// </summary>
+	static const unsigned int k_history_length_ = 64;
+
+	struct TimerQuery {
+		unsigned int section;
+		GLuint begin;
+		GLuint end;
+		bool ended;
+	};
+
+	/// <summary>
+	/// The queries issued in one frame. Query objects are kept and
+	/// reused when the slot comes around again.
+	/// </summary>
+	struct FrameQueries {
+		std::vector<TimerQuery> queries;
+		unsigned int used;
+	};
+
+	struct Section {
+		std::string name;
+		std::vector<float> history;
+		unsigned int history_next;
+		float last_ms;
+	};
+
+	FrameQueries frames_[k_frames_in_flight_];
+	unsigned int current_frame_;
+	bool supported_;
+	bool enabled_;
+
+	/// <summary>
+	/// Sections in the order they were first seen, which is usually
+	/// the order they run in.
+	/// </summary>
+	std::vector<Section> sections_;
+	std::unordered_map<std::string, unsigned int> section_ids_;
+
+	unsigned int GetSectionId(const std::string& name);
+	void CollectFrame(FrameQueries& frame);
+
+public:
+	GPUProfiler();
+	~GPUProfiler();
+
+	/*
+	* @brief
+	* Marks the start of a new frame. Reads back the queries of the frame
+	* k_frames_in_flight_ frames ago and adds them to the history.
+	*/
+	void BeginFrame();
+
+	/*
+	* @brief
+	* Waits for the GPU and reads back every frame still in flight, so that
+	* the results include the frames just issued. For the end of benchmarks,
+	* not for use every frame.
+	*/
+	void Flush();
+
+	/*
+	* @brief
+	* Starts timing a section. Prefer GPUProfiler::Scope.
+	*
+	* @return
+	* The id to pass to End(), or -1 if nothing is being recorded.
+	*/
+	int Begin(const char* name);
+	void End(int query);
+
+	/*
+	* @brief
+	* Turns recording on or off. Nothing is recorded if the GL implementation
+	* has no timestamp counter.
+	*/
+	void SetEnabled(bool enabled);
+	bool IsEnabled() const;
+
+	/*
+	* @brief
+	* Gets the rolling average of a section in milliseconds.
+	*
+	* @return
+	* Returns false if the section has no results yet.
+	*/
+	bool GetAverage(const std::string& name, float& average_ms) const;
+
+	/*
+	* @brief
+	* Gets the time of a section in the latest frame that has been read back
+	* (k_frames_in_flight_ frames behind), for decisions that need to react
+	* faster than the rolling average.
+	*
+	* @return
+	* Returns false if the section has no results yet.
+	*/
+	bool GetLast(const std::string& name, float& last_ms) const;
+
+	/*
+	* @brief
+	* The results of every section that has been recorded, in the order
+	* the sections were first seen.
+	*/
+	std::vector<Result> GetResults() const;
+};
+
+#endif // !GPU_PROFILER_H
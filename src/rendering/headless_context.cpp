@@ -0,0 +1,136 @@
+#include "headless_context.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdio>
+
+#ifdef WATERFLOW_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+HeadlessContext::HeadlessContext() : display_(nullptr), surface_(nullptr), context_(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	Destroy();
+}
+
+#ifdef WATERFLOW_HEADLESS
+
+bool HeadlessContext::Create(int width, int height)
+{
+	// Prefer the surfaceless platform, which needs neither X11 nor a GPU device node
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if (get_platform_display != nullptr) {
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "HeadlessContext::Create() could not initialize an EGL display.\n");
+		return false;
+	}
+	display_ = display;
+
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &num_configs)) {
+		num_configs = 0;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "HeadlessContext::Create() could not bind the OpenGL API.\n");
+		Destroy();
+		return false;
+	}
+
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, num_configs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "HeadlessContext::Create() could not create a GL 4.3 core context (0x%x).\n", eglGetError());
+		Destroy();
+		return false;
+	}
+	context_ = context;
+
+	EGLSurface surface = EGL_NO_SURFACE;
+	if (num_configs > 0) {
+		const EGLint pbuffer_attributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+	}
+	if (surface == EGL_NO_SURFACE) {
+		fprintf(stderr, "HeadlessContext::Create() has no pbuffer, drawing to the default framebuffer is discarded.\n");
+	}
+	surface_ = surface;
+
+	if (!eglMakeCurrent(display, surface, surface, context)) {
+		fprintf(stderr, "HeadlessContext::Create() could not make the context current (0x%x).\n", eglGetError());
+		Destroy();
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		fprintf(stderr, "HeadlessContext::Create() could not load the GL functions.\n");
+		Destroy();
+		return false;
+	}
+	printf("Headless context: %s / %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (display_ == nullptr) {
+		return;
+	}
+	EGLDisplay display = (EGLDisplay)display_;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context_ != nullptr) {
+		eglDestroyContext(display, (EGLContext)context_);
+	}
+	if (surface_ != nullptr) {
+		eglDestroySurface(display, (EGLSurface)surface_);
+	}
+	eglTerminate(display);
+	display_ = nullptr;
+	surface_ = nullptr;
+	context_ = nullptr;
+}
+
+#else
+
+bool HeadlessContext::Create(int /*width*/, int /*height*/)
+{
+	fprintf(stderr, "HeadlessContext::Create() is not available, build with the WATERFLOW_HEADLESS CMake option.\n");
+	return false;
+}
+
+void HeadlessContext::Destroy()
+{
+}
+
+#endif
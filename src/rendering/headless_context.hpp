@@ -0,0 +1,42 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+/*
+* @brief
+* An OpenGL 4.3 core context without a window, created through EGL. This lets
+* the GPU simulation and the render passes run (and be timed) on machines with
+* no display, such as CI servers using Mesa's llvmpipe.
+*
+* The context renders into a pbuffer of the given size, so the default
+* framebuffer (0) behaves as it does with a window. If the display has no
+* pbuffer capable config, a surfaceless context is made instead, in which case
+* drawing to framebuffer 0 does nothing but everything else works.
+*
+* Only available when built with WATERFLOW_HEADLESS (the CMake option of the
+* same name); otherwise Create() reports an error and fails.
+*/
+class HeadlessContext {
+private:
+	void* display_;
+	void* surface_;
+	void* context_;
+
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	/*
+	* @brief
+	* Creates the context, makes it current and loads the GL functions with glad.
+	*
+	* @param
+	* width / height: The size of the pbuffer, which stands in for the window.
+	*
+	* @return
+	* Returns false if no suitable context could be made.
+	*/
+	bool Create(int width, int height);
+	void Destroy();
+};
+
+#endif // !HEADLESS_CONTEXT_H
@@ -0,0 +1,161 @@
+#include "mapped_buffer_ring.hpp"
+
+#include <cstdio>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+void MappedBufferRing::Allocate(unsigned int slot_size)
+{
+	Release();
+	slot_size_ = (slot_size + k_slot_alignment_ - 1) / k_slot_alignment_ * k_slot_alignment_;
+	if (slot_size_ == 0) {
+		slot_size_ = k_slot_alignment_;
+	}
+	GLsizeiptr total = (GLsizeiptr)slot_size_ * k_num_slots_;
+
+	// Bound to GL_COPY_WRITE_BUFFER so the bindings of the caller are left alone
+	glGenBuffers(1, &buffer_);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+	// glBufferStorage is only loaded on GL 4.4+
+	if (glBufferStorage != nullptr) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+		mapped_ = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+		if (mapped_ == nullptr) {
+			fprintf(stderr, "MappedBufferRing::Allocate() failed to map the buffer persistently, mapping every write instead.\n");
+		}
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+	}
+	persistent_ = mapped_ != nullptr;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MappedBufferRing::Release()
+{
+	for (GLsync& fence : fences_) {
+		if (fence != 0) {
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	if (buffer_ != 0) {
+		// Deleting the buffer unmaps it. Commands still reading from it keep it alive.
+		glDeleteBuffers(1, &buffer_);
+		buffer_ = 0;
+	}
+	mapped_ = nullptr;
+	persistent_ = false;
+	slot_size_ = 0;
+	current_slot_ = k_num_slots_;
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+MappedBufferRing::MappedBufferRing(unsigned int slot_size)
+	: buffer_(0), mapped_(nullptr), persistent_(false), slot_size_(slot_size), current_slot_(k_num_slots_), writing_(false)
+{
+	for (GLsync& fence : fences_) {
+		fence = 0;
+	}
+}
+
+MappedBufferRing::~MappedBufferRing()
+{
+	Release();
+}
+
+void* MappedBufferRing::BeginWrite(unsigned int size)
+{
+	if (writing_) {
+		fprintf(stderr, "MappedBufferRing::BeginWrite() called twice without EndWrite().\n");
+		return nullptr;
+	}
+	if (buffer_ == 0 || size > slot_size_) {
+		Allocate(size > slot_size_ ? size : slot_size_);
+	}
+
+	unsigned int slot = current_slot_ < k_num_slots_ ? (current_slot_ + 1) % k_num_slots_ : 0;
+	if (fences_[slot] != 0) {
+		GLenum status = glClientWaitSync(fences_[slot], GL_SYNC_FLUSH_COMMANDS_BIT, k_wait_timeout_);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			fprintf(stderr, "MappedBufferRing::BeginWrite() timed out waiting for a slot.\n");
+			return nullptr;
+		}
+		glDeleteSync(fences_[slot]);
+		fences_[slot] = 0;
+	}
+
+	GLintptr offset = (GLintptr)slot * slot_size_;
+	unsigned char* dst = nullptr;
+	if (persistent_) {
+		// Coherent, so writes are visible to the GPU without a flush
+		dst = mapped_ + offset;
+	}
+	else {
+		// The fence above already guarantees the GPU is done with this slot
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+		dst = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		if (dst == nullptr) {
+			fprintf(stderr, "MappedBufferRing::BeginWrite() failed to map the buffer.\n");
+			return nullptr;
+		}
+	}
+	current_slot_ = slot;
+	writing_ = true;
+	return dst;
+}
+
+void MappedBufferRing::EndWrite()
+{
+	if (!writing_) {
+		return;
+	}
+	if (!persistent_) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	writing_ = false;
+}
+
+void MappedBufferRing::FenceCurrentSlot()
+{
+	if (current_slot_ >= k_num_slots_) {
+		return;
+	}
+	if (fences_[current_slot_] != 0) {
+		glDeleteSync(fences_[current_slot_]);
+	}
+	fences_[current_slot_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool MappedBufferRing::HasCurrentSlot() const
+{
+	return current_slot_ < k_num_slots_;
+}
+
+GLuint MappedBufferRing::GetBuffer() const
+{
+	return buffer_;
+}
+
+GLintptr MappedBufferRing::GetOffset() const
+{
+	if (current_slot_ >= k_num_slots_) {
+		return 0;
+	}
+	return (GLintptr)current_slot_ * slot_size_;
+}
+
+bool MappedBufferRing::IsPersistent() const
+{
+	return persistent_;
+}
@@ -0,0 +1,110 @@
+#ifndef MAPPED_BUFFER_RING_H
+#define MAPPED_BUFFER_RING_H
+
+#include <glad/glad.h>
+
+/*
+* @brief
+* A buffer split into three slots that the CPU writes in turn while the GPU may
+* still be reading the others. Each slot is fenced once the GPU commands reading
+* it have been issued, and only handed out again once that fence has passed.
+*
+* On GL 4.4+ the buffer is allocated with glBufferStorage and stays mapped
+* (persistent and coherent), so writes go straight into GPU-visible memory.
+* Otherwise every BeginWrite() maps its slot unsynchronized, which the fences
+* make safe.
+*
+* The ring only ever binds GL_COPY_WRITE_BUFFER, and leaves it unbound, so how the
+* slots are read is up to the owner. PixelUploadRing reads them as a pixel unpack
+* buffer, StreamingBuffer as vertex buffers.
+*/
+class MappedBufferRing {
+private:
+	/// <summary>
+	/// The number of slots, so up to two can be read while the third is written.
+	/// </summary>
+	static const unsigned int k_num_slots_ = 3;
+
+	/// <summary>
+	/// Slots are a multiple of this many bytes, which keeps every offset
+	/// aligned for any texel type or vertex attribute.
+	/// </summary>
+	static const unsigned int k_slot_alignment_ = 256;
+
+	/// <summary>
+	/// How long BeginWrite() waits for a slot to be free, in nanoseconds.
+	/// </summary>
+	static const GLuint64 k_wait_timeout_ = 1000000000;
+
+	GLuint buffer_;
+	unsigned char* mapped_;
+	bool persistent_;
+	unsigned int slot_size_;
+
+	GLsync fences_[k_num_slots_];
+	/// <summary>
+	/// The slot the last write went to, k_num_slots_ before anything is written.
+	/// </summary>
+	unsigned int current_slot_;
+	bool writing_;
+
+	void Allocate(unsigned int slot_size);
+	void Release();
+
+public:
+	/*
+	* @brief
+	* No GL calls are made until the first write.
+	*
+	* @param
+	* slot_size: The largest write expected, in bytes. Larger ones grow the ring.
+	*/
+	MappedBufferRing(unsigned int slot_size = 0);
+	~MappedBufferRing();
+
+	/*
+	* @brief
+	* Moves on to the next slot and returns where to write size bytes into it.
+	* Waits if the slot's fence has not passed yet. Every successful BeginWrite()
+	* must be followed by EndWrite() before the slot is read.
+	*
+	* @return
+	* nullptr if no slot could be had, in which case the current slot stays as it was.
+	*/
+	void* BeginWrite(unsigned int size);
+
+	/*
+	* @brief
+	* Finishes the write started by BeginWrite().
+	*/
+	void EndWrite();
+
+	/*
+	* @brief
+	* Fences the current slot. Call it once every GPU command reading the slot
+	* has been issued, before the ring comes back around to it.
+	*/
+	void FenceCurrentSlot();
+
+	/*
+	* @brief
+	* Whether a slot has been written yet.
+	*/
+	bool HasCurrentSlot() const;
+
+	GLuint GetBuffer() const;
+
+	/*
+	* @brief
+	* Where the current slot starts in the buffer, 0 before anything is written.
+	*/
+	GLintptr GetOffset() const;
+
+	/*
+	* @brief
+	* Whether the buffer is persistently mapped (GL 4.4+).
+	*/
+	bool IsPersistent() const;
+};
+
+#endif // !MAPPED_BUFFER_RING_H
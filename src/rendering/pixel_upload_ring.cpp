@@ -0,0 +1,47 @@
+#include "pixel_upload_ring.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+PixelUploadRing::PixelUploadRing(unsigned int slot_size)
+	: ring_(slot_size), staged_(false)
+{
+}
+
+bool PixelUploadRing::Stage(const void* data, unsigned int size, GLintptr& offset)
+{
+	if (staged_) {
+		fprintf(stderr, "PixelUploadRing::Stage() called twice without Submit().\n");
+		return false;
+	}
+	void* dst = ring_.BeginWrite(size);
+	if (dst == nullptr) {
+		return false;
+	}
+	memcpy(dst, data, size);
+	ring_.EndWrite();
+
+	offset = ring_.GetOffset();
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_.GetBuffer());
+	staged_ = true;
+	return true;
+}
+
+void PixelUploadRing::Submit()
+{
+	if (!staged_) {
+		return;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	ring_.FenceCurrentSlot();
+	staged_ = false;
+}
+
+bool PixelUploadRing::IsPersistent() const
+{
+	return ring_.IsPersistent();
+}
@@ -0,0 +1,69 @@
+#ifndef PIXEL_UPLOAD_RING_H
+#define PIXEL_UPLOAD_RING_H
+
+#include <glad/glad.h>
+
+#include "mapped_buffer_ring.hpp"
+
+/*
+* @brief
+* Streams texture data from the CPU to the GPU without stalling the pipeline.
+* The counterpart of AsyncReadback.
+*
+* Stage() copies the data into the next slot of a MappedBufferRing and binds it
+* as the pixel unpack buffer, so the following glTexSubImage* call takes an offset
+* into it and returns right away instead of copying from client memory. Submit()
+* fences the slot behind that call.
+*
+* Usage:
+*	GLintptr offset;
+*	if (ring.Stage(data, size, offset)) {
+*		glTexSubImage2D(..., (const void*)offset);
+*		ring.Submit();
+*	}
+*/
+class PixelUploadRing {
+private:
+	MappedBufferRing ring_;
+	bool staged_;
+
+public:
+	/*
+	* @brief
+	* No GL calls are made until the first Stage().
+	*
+	* @param
+	* slot_size: The largest upload expected, in bytes. Larger ones grow the ring.
+	*/
+	PixelUploadRing(unsigned int slot_size = 0);
+
+	/*
+	* @brief
+	* Copies size bytes into the next free slot and binds the ring as the
+	* GL_PIXEL_UNPACK_BUFFER. Waits if every slot is still in flight.
+	* Every successful Stage() must be followed by the upload and Submit().
+	*
+	* @param
+	* offset: Set to where the data starts in the buffer, to be passed as the
+	* pixel pointer of the upload.
+	*
+	* @return
+	* Returns false if no slot could be had, in which case nothing is bound
+	* and the caller should upload from client memory instead.
+	*/
+	bool Stage(const void* data, unsigned int size, GLintptr& offset);
+
+	/*
+	* @brief
+	* Fences the upload issued since Stage() and unbinds the ring.
+	*/
+	void Submit();
+
+	/*
+	* @brief
+	* Whether the buffer is persistently mapped (GL 4.4+).
+	*/
+	bool IsPersistent() const;
+};
+
+#endif // !PIXEL_UPLOAD_RING_H
@@ -0,0 +1,135 @@
+#include "program_binary_cache.hpp"
+#include <RootDir.h>
+
+#include <cstdio>
+#include <fstream>
+
+bool ProgramBinaryCache::enabled_ = true;
+
+namespace {
+	// Written at the start of every entry so that stale or foreign files are rejected
+	const unsigned int k_entry_magic = 0x4e494257; // "WBIN"
+
+	struct EntryHeader {
+		unsigned int magic;
+		GLenum format;
+		GLint length;
+	};
+
+	// 64-bit FNV-1a
+	void HashBytes(unsigned long long& hash, const char* bytes, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			hash ^= (unsigned char)bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	void HashString(unsigned long long& hash, const char* str)
+	{
+		if (str == nullptr) {
+			return;
+		}
+		std::string s(str);
+		HashBytes(hash, s.c_str(), s.size() + 1);
+	}
+}
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+std::string ProgramBinaryCache::GetEntryPath(const std::string& key)
+{
+	return ROOT_DIR "resources/shaders/cache/" + key + ".bin";
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+std::string ProgramBinaryCache::MakeKey(const std::vector<std::string>& sources)
+{
+	if (!enabled_) {
+		return "";
+	}
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (num_formats <= 0) {
+		return "";
+	}
+
+	unsigned long long hash = 14695981039346656037ULL;
+	HashString(hash, (const char*)glGetString(GL_VENDOR));
+	HashString(hash, (const char*)glGetString(GL_RENDERER));
+	HashString(hash, (const char*)glGetString(GL_VERSION));
+	for (const std::string& source : sources) {
+		// Include the terminator so that moving text between stages changes the key
+		HashBytes(hash, source.c_str(), source.size() + 1);
+	}
+
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", hash);
+	return key;
+}
+
+bool ProgramBinaryCache::Load(GLuint program, const std::string& key)
+{
+	if (key.empty()) {
+		return false;
+	}
+	std::ifstream in_file(GetEntryPath(key), std::ios::binary);
+	if (!in_file) {
+		return false;
+	}
+
+	EntryHeader header;
+	if (!in_file.read((char*)&header, sizeof(header)) || header.magic != k_entry_magic || header.length <= 0) {
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!in_file.read(&binary[0], header.length)) {
+		return false;
+	}
+
+	glProgramBinary(program, header.format, &binary[0], header.length);
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	// A driver update with the same version string can still reject the binary,
+	// in which case the program is compiled as usual and the entry overwritten.
+	return status == GL_TRUE;
+}
+
+void ProgramBinaryCache::Store(GLuint program, const std::string& key)
+{
+	if (key.empty()) {
+		return;
+	}
+	EntryHeader header;
+	header.magic = k_entry_magic;
+	header.length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0) {
+		return;
+	}
+	std::vector<char> binary(header.length);
+	GLsizei written = 0;
+	glGetProgramBinary(program, header.length, &written, &header.format, &binary[0]);
+	if (written <= 0) {
+		return;
+	}
+	header.length = written;
+
+	std::ofstream out_file(GetEntryPath(key), std::ios::binary | std::ios::trunc);
+	if (!out_file) {
+		fprintf(stderr, "ProgramBinaryCache::Store() could not write %s\n", GetEntryPath(key).c_str());
+		return;
+	}
+	out_file.write((const char*)&header, sizeof(header));
+	out_file.write(&binary[0], written);
+}
+
+void ProgramBinaryCache::SetEnabled(bool enabled)
+{
+	enabled_ = enabled;
+}
@@ -0,0 +1,64 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+/*
+* @brief
+* Keeps linked shader programs on disk (glGetProgramBinary / glProgramBinary)
+* so that later launches can skip compiling and linking them.
+*
+* Entries live in resources/shaders/cache/ and are named by a hash of the
+* program's sources together with the GL vendor, renderer and version strings.
+* Editing a shader or updating the driver therefore simply misses the cache.
+* A binary the driver refuses to load is treated as a miss as well, and the
+* caller compiles from source as it would without the cache.
+*/
+class ProgramBinaryCache {
+private:
+	static bool enabled_;
+
+	static std::string GetEntryPath(const std::string& key);
+
+public:
+	/*
+	* @brief
+	* Builds the cache key of a program.
+	*
+	* @param
+	* sources: The full source text of every stage of the program, in a fixed order.
+	*
+	* @return
+	* The key as a hex string, or an empty string if the cache is disabled or the
+	* driver does not support program binaries.
+	*/
+	static std::string MakeKey(const std::vector<std::string>& sources);
+
+	/*
+	* @brief
+	* Loads a cached binary into the program.
+	*
+	* @return
+	* Returns true if the program is now linked from the cache.
+	*/
+	static bool Load(GLuint program, const std::string& key);
+
+	/*
+	* @brief
+	* Writes a linked program to the cache. The program must have been linked
+	* with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	*/
+	static void Store(GLuint program, const std::string& key);
+
+	/*
+	* @brief
+	* Turns the cache on or off (on by default). Useful while editing drivers
+	* or when comparing startup times.
+	*/
+	static void SetEnabled(bool enabled);
+};
+
+#endif // !PROGRAM_BINARY_CACHE_H
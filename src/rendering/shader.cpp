@@ -2,10 +2,12 @@
 #include <RootDir.h>
 
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <fstream>
 #include <string>
 
 #include "texture.hpp"
+#include "program_binary_cache.hpp"
 
 ///////////////////////
 ///	Private Methods ///
@@ -38,6 +40,10 @@ bool Shader::GetUniformLocation(const std::string& uniform_name)
 
 void Shader::LinkProgram()
 {
+    if (!binary_cache_key_.empty())
+    {
+        glProgramParameteri(program_id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program_id_);
 
     GLint status;
@@ -63,48 +69,123 @@ void Shader::LinkProgram()
             free(log);
         }
     }
+    else
+    {
+        ProgramBinaryCache::Store(program_id_, binary_cache_key_);
+    }
+}
+
+bool Shader::LoadCachedProgram(const std::vector<std::string>& sources)
+{
+    binary_cache_key_ = ProgramBinaryCache::MakeKey(sources);
+    is_linked_ = ProgramBinaryCache::Load(program_id_, binary_cache_key_);
+    return is_linked_;
 }
 
-std::string Shader::LoadFile(const std::string& filename)
+std::string Shader::LoadFile(const std::string& filename, const ShaderDefines& defines)
 {
     if (filename.empty())
     {
         return "";
     }
 
+    std::vector<std::string> included;
     std::string filetext;
-    std::string line;
+    if (!AppendFile(filename, included, 0, filetext))
+    {
+        return "";
+    }
 
-    std::ifstream in_file(ROOT_DIR "resources/shaders/" + filename);
+    if (defines.empty())
+    {
+        return filetext;
+    }
+
+    // The defines have to come after #version, which must be the first line
+    std::string define_text;
+    for (const std::pair<const std::string, std::string>& define : defines)
+    {
+        define_text.append("#define " + define.first + " " + define.second + "\n");
+    }
+
+    size_t version = filetext.find("#version");
+    if (version == std::string::npos)
+    {
+        return define_text + "#line 1\n" + filetext;
+    }
+    size_t version_end = filetext.find('\n', version);
+    if (version_end == std::string::npos)
+    {
+        return filetext + "\n" + define_text;
+    }
+    size_t version_line = std::count(filetext.begin(), filetext.begin() + version_end, '\n') + 1;
+    return filetext.substr(0, version_end + 1) + define_text
+        + "#line " + std::to_string(version_line + 1) + "\n"
+        + filetext.substr(version_end + 1);
+}
 
+bool Shader::AppendFile(const std::string& filename, std::vector<std::string>& included, int depth, std::string& out)
+{
+    const int max_include_depth = 16;
+
+    std::ifstream in_file(ROOT_DIR "resources/shaders/" + filename);
     if (!in_file)
     {
         fprintf(stderr, "Could not open file %s\n", filename.c_str());
-        in_file.close();
-
-        return "";
+        return false;
     }
-    else
+
+    // Source string 0 is the file being loaded, includes are numbered from 1
+    std::string source_number = std::to_string(depth == 0 ? 0 : included.size());
+    std::string line;
+    int line_number = 0;
+    while (getline(in_file, line))
     {
-        while (getline(in_file, line))
+        ++line_number;
+
+        size_t directive = line.find_first_not_of(" \t");
+        if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0)
         {
-            filetext.append(line + "\n");
+            out.append(line + "\n");
+            continue;
         }
 
-        in_file.close();
+        size_t name_begin = line.find('"', directive);
+        size_t name_end = name_begin == std::string::npos ? std::string::npos : line.find('"', name_begin + 1);
+        if (name_end == std::string::npos)
+        {
+            fprintf(stderr, "%s(%d): malformed #include\n", filename.c_str(), line_number);
+            return false;
+        }
+        std::string include_name = line.substr(name_begin + 1, name_end - name_begin - 1);
 
-        return filetext;
+        if (std::find(included.begin(), included.end(), include_name) == included.end())
+        {
+            if (depth >= max_include_depth)
+            {
+                fprintf(stderr, "%s(%d): includes nested too deeply\n", filename.c_str(), line_number);
+                return false;
+            }
+            included.push_back(include_name);
+            out.append("#line 1 " + std::to_string(included.size()) + "\n");
+            if (!AppendFile(include_name, included, depth + 1, out))
+            {
+                return false;
+            }
+        }
+        out.append("#line " + std::to_string(line_number + 1) + " " + source_number + "\n");
     }
+    return true;
 }
 
 //////////////////////
 ///	Public Methods ///
 //////////////////////
 
-Shader::Shader(const std::string& vertex_shader_file_name, const std::string& fragment_shader_file_name)
+Shader::Shader(const std::string& vertex_shader_file_name, const std::string& fragment_shader_file_name, const ShaderDefines& defines)
 {
-    const std::string shader_codes[2] = { LoadFile(vertex_shader_file_name),
-                                         LoadFile(fragment_shader_file_name) };
+    const std::string shader_codes[2] = { LoadFile(vertex_shader_file_name, defines),
+                                         LoadFile(fragment_shader_file_name, defines) };
     const std::string filenames[2] = { vertex_shader_file_name,
                                        fragment_shader_file_name };
     program_id_ = glCreateProgram();
@@ -117,6 +198,11 @@ Shader::Shader(const std::string& vertex_shader_file_name, const std::string& fr
         return;
     }
 
+    if (LoadCachedProgram({ shader_codes[0], shader_codes[1] }))
+    {
+        return;
+    }
+
     // Process each shader's text, compile it, and connect it to
     // a unified program to be run on the GPU.
     // Lastly, link the program once finished with the shaders
@@ -209,7 +295,7 @@ bool Shader::SetUniformTexture2D(const std::string& uniform_name, Texture2D& tex
     if (GetUniformLocation(uniform_name)) 
     {
         texture.ActiveBind(texture_unit);
-        glUniform1i(uniform_ids_[uniform_name], texture_unit - GL_TEXTURE0);
+        glProgramUniform1i(program_id_, uniform_ids_[uniform_name], texture_unit - GL_TEXTURE0);
         return true;
     }
     return false;
@@ -219,8 +305,8 @@ bool Shader::SetUniformTexture3D(const std::string& uniform_name, Texture3D& tex
 {
     if (GetUniformLocation(uniform_name)) 
     {
-        texture.BindImageTexture(texture_unit);
-        glUniform1i(uniform_ids_[uniform_name], texture_unit - GL_TEXTURE0);
+        texture.ActiveBind(texture_unit);
+        glProgramUniform1i(program_id_, uniform_ids_[uniform_name], texture_unit - GL_TEXTURE0);
         return true;
     }
     return false;
@@ -253,6 +339,15 @@ bool Shader::SetUniform3fv(const std::string& uniform_name, const glm::vec3& vec
     return false;
 }
 
+bool Shader::SetUniform2fv(const std::string& uniform_name, const glm::vec2& vec)
+{
+    if (GetUniformLocation(uniform_name)) {
+        glProgramUniform2fv(program_id_, uniform_ids_[uniform_name], 1, glm::value_ptr(vec));
+        return true;
+    }
+    return false;
+}
+
 bool Shader::SetUniform1fv(const std::string& uniform_name, const float& f)
 {
     if (GetUniformLocation(uniform_name)) {
@@ -6,9 +6,17 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "texture.hpp"
 
+/// <summary>
+/// Preprocessor constants injected into a shader's source right after its
+/// #version line, as "#define name value". Each distinct set compiles (and is
+/// cached) as its own program variant.
+/// </summary>
+typedef std::map<std::string, std::string> ShaderDefines;
+
 class Shader {
 protected:
 	/// <summary>
@@ -29,6 +37,12 @@ protected:
 	/// </summary>
 	bool is_linked_;
 
+	/// <summary>
+	/// The key of the program in the ProgramBinaryCache, or empty when
+	/// the program isn't cached.
+	/// </summary>
+	std::string binary_cache_key_;
+
 	/*
 	* @brief
 	* Gets the location of a uniform and stores it in uniform_ids_
@@ -54,20 +68,52 @@ protected:
 	*/
 	void LinkProgram();
 
+	/*
+	* @brief
+	* Tries to link the program from the on-disk ProgramBinaryCache instead of
+	* compiling it. On a miss, the next LinkProgram() call stores the program in
+	* the cache under the same key.
+	* 
+	* @param
+	* sources: The source text of every stage, in the order the stages are attached.
+	* 
+	* @return
+	* Returns true if the program was loaded and is ready to use.
+	*/
+	bool LoadCachedProgram(const std::vector<std::string>& sources);
+
 	/*
 	* @brief
 	* Used for loading in the program's text
 	* 
+	* Lines of the form #include "file" are replaced by the text of that file,
+	* which is also looked up in resources/shaders/. A file is only included once
+	* per program. #line directives are added around included text so that
+	* compile errors point at the right line; included files are numbered as
+	* source strings 1, 2, ... in the order they are first included.
+	* 
 	* @param 
 	* filename the file to be loaded in as a string. 
 	* The path is not passed in, as shaders are
 	* assumed to be in the resources/shaders folder.
 	* The call will fail if they are not there.
 	* 
+	* @param
+	* defines: Constants to insert after the #version line.
+	* 
 	* @return
 	* Returns the program's text. Returns an empty string when program is empty.
 	*/
-	std::string LoadFile(const std::string& filename);
+	std::string LoadFile(const std::string& filename, const ShaderDefines& defines = ShaderDefines());
+
+	/*
+	* @brief
+	* Appends the text of a file to out, expanding its includes.
+	* 
+	* @return
+	* Returns false if the file or one of its includes could not be opened.
+	*/
+	bool AppendFile(const std::string& filename, std::vector<std::string>& included, int depth, std::string& out);
 
 	/*
 	* @brief
@@ -93,9 +139,14 @@ public:
 	* @param
 	* fragment_shader_filename:
 	* The name of the fragment shader to be loaded in.
+	* 
+	* @param
+	* defines:
+	* Constants injected into both stages (see ShaderDefines).
 	*/
 	Shader(	const std::string& vertex_shader_file_name,
-			const std::string& fragment_shader_file_name );
+			const std::string& fragment_shader_file_name,
+			const ShaderDefines& defines = ShaderDefines() );
 
 	~Shader();
 
@@ -141,6 +192,7 @@ public:
 	bool SetUniformMatrix4fv(const std::string& uniform_name, const glm::mat4& matrix);
 	bool SetUniformMatrix3fv(const std::string& uniform_name, const glm::mat3& matrix);
 	bool SetUniform3fv(const std::string& uniform_name, const glm::vec3& vec);
+	bool SetUniform2fv(const std::string& uniform_name, const glm::vec2& vec);
 	bool SetUniform1fv(const std::string& uniform_name, const float& f);
 	bool SetUniform1ui(const std::string& uniform_name, const unsigned int& ui);
 };
@@ -0,0 +1,57 @@
+#include "streaming_buffer.hpp"
+
+#include <cstring>
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+StreamingBuffer::StreamingBuffer(unsigned int slot_size)
+	: ring_(slot_size)
+{
+}
+
+void* StreamingBuffer::BeginWrite(unsigned int size)
+{
+	// Everything drawn from the current slot has been issued by now
+	ring_.FenceCurrentSlot();
+	return ring_.BeginWrite(size);
+}
+
+void StreamingBuffer::EndWrite()
+{
+	ring_.EndWrite();
+}
+
+bool StreamingBuffer::Write(const void* data, unsigned int size)
+{
+	void* dst = BeginWrite(size);
+	if (dst == nullptr) {
+		return false;
+	}
+	memcpy(dst, data, size);
+	EndWrite();
+	return true;
+}
+
+void StreamingBuffer::BindVertexBuffer(GLuint binding_index, GLsizei stride) const
+{
+	if (ring_.HasCurrentSlot()) {
+		glBindVertexBuffer(binding_index, ring_.GetBuffer(), ring_.GetOffset(), stride);
+	}
+}
+
+GLuint StreamingBuffer::GetBuffer() const
+{
+	return ring_.GetBuffer();
+}
+
+GLintptr StreamingBuffer::GetOffset() const
+{
+	return ring_.GetOffset();
+}
+
+bool StreamingBuffer::IsPersistent() const
+{
+	return ring_.IsPersistent();
+}
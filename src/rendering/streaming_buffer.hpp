@@ -0,0 +1,84 @@
+#ifndef STREAMING_BUFFER_H
+#define STREAMING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "mapped_buffer_ring.hpp"
+
+/*
+* @brief
+* A vertex buffer for data rewritten every frame, kept in a MappedBufferRing so
+* the CPU fills one slot while the GPU may still draw from the others. Replaces
+* orphaning with glBufferData(NULL) followed by glBufferSubData, which copies
+* every upload once more inside the driver.
+*
+* BeginWrite() hands out a pointer into the next slot, so data can be written
+* straight into GPU-visible memory. The slot being replaced is fenced at that
+* point, since every draw reading it was issued before. PixelUploadRing is the
+* pixel unpack counterpart.
+*
+* Usage:
+*	if (stream.Write(data, size)) {
+*		glBindVertexArray(vao);
+*		stream.BindVertexBuffer(attrib_binding, sizeof(element));
+*	}
+*/
+class StreamingBuffer {
+private:
+	/// <summary>
+	/// Draws read from the current slot of the ring, the one last written.
+	/// </summary>
+	MappedBufferRing ring_;
+
+public:
+	/*
+	* @brief
+	* No GL calls are made until the first write.
+	*
+	* @param
+	* slot_size: The largest write expected, in bytes. Larger ones grow the buffer.
+	*/
+	StreamingBuffer(unsigned int slot_size = 0);
+
+	/*
+	* @brief
+	* Moves on to the next slot and returns where to write size bytes into it.
+	* Waits if the GPU may still be drawing from that slot. Every successful
+	* BeginWrite() must be followed by EndWrite() before the slot is drawn from.
+	*
+	* @return
+	* nullptr if no slot could be had, in which case the last written slot
+	* stays current.
+	*/
+	void* BeginWrite(unsigned int size);
+
+	/*
+	* @brief
+	* Finishes the write started by BeginWrite().
+	*/
+	void EndWrite();
+
+	/*
+	* @brief
+	* BeginWrite() and EndWrite() around a copy of data.
+	*/
+	bool Write(const void* data, unsigned int size);
+
+	/*
+	* @brief
+	* Binds the current slot to a vertex buffer binding point of the bound VAO.
+	* The slot moves on every write, so this is needed after each one.
+	*/
+	void BindVertexBuffer(GLuint binding_index, GLsizei stride) const;
+
+	GLuint GetBuffer() const;
+	GLintptr GetOffset() const;
+
+	/*
+	* @brief
+	* Whether the buffer is persistently mapped (GL 4.4+).
+	*/
+	bool IsPersistent() const;
+};
+
+#endif // !STREAMING_BUFFER_H
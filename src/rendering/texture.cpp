@@ -1,4 +1,5 @@
 #include "texture.hpp"
+#include "pixel_upload_ring.hpp"
 
 #include <RootDir.h>
 #include <stb_image.h>
@@ -7,81 +8,156 @@
 ///	Private Methods ///
 ///////////////////////
 
-void Texture2D::GenTexture(const void* data) {
-	// Generate handle for texture on GPU
-	glGenTextures(1, &texture_id_);
-	// Bind the texture to the active texture. Future texture calls modify this texture
-	glBindTexture(GL_TEXTURE_2D, texture_id_);
-	
-	// Set texture parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-	// TODO: figure out format and internal format for glTexImage2D(...)
-	GLenum format = GL_RGBA;
+// Resolves the GL formats of a channel and storage type. Immutable storage needs a
+// sized internal format, so the unsized channel types are sized by the storage type.
+static void GetGLFormats(ChannelType channel_type, StorageType storage_type, GLenum& internal_format, GLenum& format, GLenum& type)
+{
+	switch (storage_type) {
+	case StorageType::TEX_BYTE:
+		type = GL_BYTE;
+		break;
+	case StorageType::TEX_SHORT:
+		type = GL_SHORT;
+		break;
+	case StorageType::TEX_INT:
+		type = GL_INT;
+		break;
+	case StorageType::TEX_UINT:
+		type = GL_UNSIGNED_INT;
+		break;
+	case StorageType::TEX_FLOAT:
+		type = GL_FLOAT;
+		break;
+	}
 
-	switch (channel_type_) {
+	// The sized formats of 1 to 4 channels for every storage type, in the order of StorageType
+	static const GLenum sized_formats[5][4] = {
+		{ GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F },
+		{ GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 },
+		{ GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 },
+		{ GL_R32UI, GL_RG32UI, GL_RGB32UI, GL_RGBA32UI },
+		{ GL_R32I, GL_RG32I, GL_RGB32I, GL_RGBA32I },
+	};
+	bool integer = storage_type == StorageType::TEX_INT || storage_type == StorageType::TEX_UINT;
+
+	switch (channel_type) {
 	case ChannelType::R:
-		gl_channel_type_ = GL_RED;
-		format = GL_RED;
+		internal_format = sized_formats[storage_type][0];
+		format = integer ? GL_RED_INTEGER : GL_RED;
 		break;
 	case ChannelType::R32F:
-		gl_channel_type_ = GL_R32F;
+		internal_format = GL_R32F;
 		format = GL_RED;
 		break;
 	case ChannelType::R32I:
-		gl_channel_type_ = GL_R32I;
+		internal_format = GL_R32I;
 		format = GL_RED_INTEGER;
 		break;
 	case ChannelType::R32UI:
-		gl_channel_type_ = GL_R32UI;
+		internal_format = GL_R32UI;
 		format = GL_RED_INTEGER;
 		break;
 	case ChannelType::RG:
-		gl_channel_type_ = GL_RG;
+		internal_format = sized_formats[storage_type][1];
+		format = integer ? GL_RG_INTEGER : GL_RG;
+		break;
+	case ChannelType::RG32F:
+		internal_format = GL_RG32F;
 		format = GL_RG;
 		break;
 	case ChannelType::RGB:
-		gl_channel_type_ = GL_RGB;
-		format = GL_RGB;
+		internal_format = sized_formats[storage_type][2];
+		format = integer ? GL_RGB_INTEGER : GL_RGB;
 		break;
 	case ChannelType::RGB32F:
-		gl_channel_type_ = GL_RGB32F;
+		internal_format = GL_RGB32F;
 		format = GL_RGB;
 		break;
 	case ChannelType::RGBA:
-		gl_channel_type_ = GL_RGBA;
-		format = GL_RGBA;
+		internal_format = sized_formats[storage_type][3];
+		format = integer ? GL_RGBA_INTEGER : GL_RGBA;
 		break;
 	case ChannelType::RGBA32F:
-		gl_channel_type_ = GL_RGBA32F;
+		internal_format = GL_RGBA32F;
 		format = GL_RGBA;
 		break;
 	}
+}
 
-	switch (storage_type_) {
-	case StorageType::TEX_BYTE:
-		gl_storage_type_ = GL_BYTE;
+// The size in bytes of one texel of pixel data in the given format and type
+static unsigned int GetTexelSize(GLenum format, GLenum type)
+{
+	unsigned int channels = 4;
+	switch (format) {
+	case GL_RED:
+	case GL_RED_INTEGER:
+		channels = 1;
 		break;
-	case StorageType::TEX_SHORT:
-		gl_storage_type_ = GL_SHORT;
+	case GL_RG:
+	case GL_RG_INTEGER:
+		channels = 2;
 		break;
-	case StorageType::TEX_INT:
-		gl_storage_type_ = GL_INT;
+	case GL_RGB:
+	case GL_RGB_INTEGER:
+		channels = 3;
 		break;
-	case StorageType::TEX_UINT:
-		gl_storage_type_ = GL_UNSIGNED_INT;
+	}
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return channels;
+	case GL_SHORT:
+		return channels * 2;
+	default:
+		return channels * 4;
+	}
+}
+
+// Sets the unpack state for tightly packed data. Row length and image height
+// are left at 0 (the size of the upload) so other uploads aren't affected.
+static void SetUnpackState(StorageType storage_type)
+{
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+	switch (storage_type) {
+	case TEX_BYTE:
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		break;
-	case StorageType::TEX_FLOAT:
-		gl_storage_type_ = GL_FLOAT;
+	case TEX_SHORT:
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		break;
+	case TEX_INT:
+	case TEX_UINT:
+	case TEX_FLOAT:
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 		break;
 	}
-	// Place texture data to the GPU
-	glTexImage2D(GL_TEXTURE_2D, 0, gl_channel_type_, dimensions_.x, dimensions_.y, 0, format, gl_storage_type_, data);
+}
+
+void Texture2D::GenTexture(const void* data) {
+	// Generate handle for texture on GPU
+	glGenTextures(1, &texture_id_);
+	// Bind the texture to the active texture. Future texture calls modify this texture
+	glBindTexture(GL_TEXTURE_2D, texture_id_);
+	
+	// Set texture parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	GetGLFormats(channel_type_, storage_type_, gl_channel_type_, gl_format_, gl_storage_type_);
+
+	// Immutable storage: the size and format are fixed for the lifetime of the id,
+	// so later data only ever goes through glTexSubImage2D
+	glTexStorage2D(GL_TEXTURE_2D, 1, gl_channel_type_, dimensions_.x, dimensions_.y);
 	// TODO: Error check the result of OpenGL calls
 	valid_texture_ = true;
+
+	// Place texture data to the GPU
+	if (data != nullptr) {
+		ModifyTextureData(glm::ivec2(0, 0), dimensions_, data);
+	}
 }
 
 // Code for creating a Texture object are from Tomasz Ga'aj's
@@ -91,14 +167,14 @@ void Texture2D::GenTexture(const void* data) {
 
 Texture2D::Texture2D(glm::ivec2 dimensions, StorageType storage_type, ChannelType channel_type, const void* initial_data) :
 	dimensions_(dimensions), storage_type_(storage_type), channel_type_(channel_type),
-	gl_storage_type_(GL_NONE), gl_channel_type_(GL_NONE), valid_texture_(false), texture_id_(0)
+	gl_storage_type_(GL_NONE), gl_channel_type_(GL_NONE), gl_format_(GL_NONE), valid_texture_(false), texture_id_(0)
 {
 	GenTexture(initial_data);
 }
 
 Texture2D::Texture2D(const std::string& texture_filename) : 
 	dimensions_(glm::ivec2(0,0)), storage_type_(StorageType::TEX_BYTE), channel_type_(ChannelType::RGBA),
-	gl_storage_type_(GL_BYTE), gl_channel_type_(GL_RGBA), valid_texture_(false), texture_id_(0)
+	gl_storage_type_(GL_UNSIGNED_BYTE), gl_channel_type_(GL_RGBA8), gl_format_(GL_RGBA), valid_texture_(false), texture_id_(0)
 {
 	if (texture_filename.empty())
 	{
@@ -146,31 +222,26 @@ GLuint Texture2D::GetTextureId() const
 	return texture_id_;
 }
 
-bool Texture2D::ModifyTextureData(glm::ivec2 top_left_start, glm::ivec2 data_dimensions, const void* texture_data)
+bool Texture2D::ModifyTextureData(glm::ivec2 top_left_start, glm::ivec2 data_dimensions, const void* texture_data, PixelUploadRing* upload_ring)
 {
 	if (!valid_texture_) {
 		return false;
 	}
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, data_dimensions.x);
-	//glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	switch (storage_type_) {
-	case TEX_BYTE:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		break;
-	case TEX_SHORT:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
-		break;
-	case TEX_INT:
-	case TEX_FLOAT:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-		break;
-	}
+	// With the ring bound as the unpack buffer, the pixel pointer is an offset into it
+	GLintptr offset = 0;
+	unsigned int size = data_dimensions.x * data_dimensions.y * GetTexelSize(gl_format_, gl_storage_type_);
+	bool staged = upload_ring != nullptr && upload_ring->Stage(texture_data, size, offset);
+
+	glBindTexture(GL_TEXTURE_2D, texture_id_);
+	SetUnpackState(storage_type_);
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 
 		top_left_start.x, top_left_start.y, 
 		data_dimensions.x, data_dimensions.y, 
-		gl_channel_type_, gl_storage_type_, texture_data);
+		gl_format_, gl_storage_type_, staged ? (const void*)offset : texture_data);
 
+	if (staged) {
+		upload_ring->Submit();
+	}
 	return true;
 }
 
@@ -179,11 +250,21 @@ glm::ivec2 Texture2D::GetDimensions() const
 	return dimensions_;
 }
 
-void Texture2D::SetNewData(glm::ivec2 dimensions, const void* texture_data)
+void Texture2D::SetNewData(glm::ivec2 dimensions, const void* texture_data, PixelUploadRing* upload_ring)
 {
+	// Immutable storage can't be resized, only new dimensions need a new texture
+	if (valid_texture_ && dimensions == dimensions_)
+	{
+		if (texture_data != nullptr)
+		{
+			ModifyTextureData(glm::ivec2(0, 0), dimensions_, texture_data, upload_ring);
+		}
+		return;
+	}
 	if (texture_id_ != 0)
 	{
 		glDeleteTextures(1, &texture_id_);
+		texture_id_ = 0;
 	}
 	dimensions_ = dimensions;
 	GenTexture(texture_data);
@@ -214,7 +295,8 @@ bool Texture2D::BindImageTexture(GLenum texture_unit_binding)
 	if (!valid_texture_) {
 		return false;
 	}
-	glBindImageTexture(texture_unit_binding, texture_id_, 0, 0, 0, GL_READ_WRITE, gl_storage_type_);
+	// The format of an image binding is the internal format of the texture
+	glBindImageTexture(texture_unit_binding, texture_id_, 0, GL_FALSE, 0, GL_READ_WRITE, gl_channel_type_);
 	return true;
 }
 
@@ -222,7 +304,7 @@ bool Texture2D::BindImageTexture(GLenum texture_unit_binding)
 
 Texture3D::Texture3D(glm::ivec3 dimensions, StorageType storage_type, ChannelType channel_type, const void* initial_data)
 	: dimensions_(dimensions), channel_type_(channel_type), storage_type_(storage_type),
-	gl_storage_type_(GL_NONE), gl_channel_type_(GL_NONE), valid_texture_(false), texture_id_(0)
+	gl_storage_type_(GL_NONE), gl_channel_type_(GL_NONE), gl_format_(GL_NONE), valid_texture_(false), texture_id_(0)
 {
 	GenTexture(initial_data);
 }
@@ -245,67 +327,14 @@ void Texture3D::GenTexture(const void* data)
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-	GLenum format = GL_RGBA;
-	switch (channel_type_) {
-	case ChannelType::R:
-		gl_channel_type_ = GL_RED;
-		format = GL_RED;
-		break;
-	case ChannelType::R32F:
-		gl_channel_type_ = GL_R32F;
-		format = GL_RED;
-		break;
-	case ChannelType::R32I:
-		gl_channel_type_ = GL_R32I;
-		format = GL_RED_INTEGER;
-		break;
-	case ChannelType::R32UI:
-		gl_channel_type_ = GL_R32UI;
-		format = GL_RED_INTEGER;
-		break;
-	case ChannelType::RG:
-		gl_channel_type_ = GL_RG;
-		format = GL_RG;
-		break;
-	case ChannelType::RGB:
-		gl_channel_type_ = GL_RGB;
-		format = GL_RGB;
-		break;
-	case ChannelType::RGB32F:
-		gl_channel_type_ = GL_RGB32F;
-		format = GL_RGB;
-		break;
-	case ChannelType::RGBA:
-		gl_channel_type_ = GL_RGBA;
-		format = GL_RGBA;
-		break;
-	case ChannelType::RGBA32F:
-		gl_channel_type_ = GL_RGBA32F;
-		format = GL_RGBA;
-		break;
-	}
-
-	switch (storage_type_) {
-	case StorageType::TEX_BYTE:
-		gl_storage_type_ = GL_BYTE;
-		break;
-	case StorageType::TEX_SHORT:
-		gl_storage_type_ = GL_SHORT;
-		break;
-	case StorageType::TEX_INT:
-		gl_storage_type_ = GL_INT;
-		break;
-	case StorageType::TEX_UINT:
-		gl_storage_type_ = GL_UNSIGNED_INT;
-		break;
-	case StorageType::TEX_FLOAT:
-		gl_storage_type_ = GL_FLOAT;
-		break;
-	}
-
-	glTexImage3D(GL_TEXTURE_3D, 0, gl_channel_type_, dimensions_.x, dimensions_.y, dimensions_.z, 0, format, gl_storage_type_, data);
+	GetGLFormats(channel_type_, storage_type_, gl_channel_type_, gl_format_, gl_storage_type_);
 
+	glTexStorage3D(GL_TEXTURE_3D, 1, gl_channel_type_, dimensions_.x, dimensions_.y, dimensions_.z);
 	valid_texture_ = true;
+
+	if (data != nullptr) {
+		ModifyTextureData(glm::ivec3(0, 0, 0), dimensions_, data);
+	}
 }
 
 GLuint Texture3D::GetTextureId() const
@@ -313,39 +342,43 @@ GLuint Texture3D::GetTextureId() const
 	return texture_id_;
 }
 
-bool Texture3D::ModifyTextureData(glm::ivec3 top_left_start, glm::ivec3 data_dimensions, const void* texture_data)
+bool Texture3D::ModifyTextureData(glm::ivec3 top_left_start, glm::ivec3 data_dimensions, const void* texture_data, PixelUploadRing* upload_ring)
 {
 	if (!valid_texture_) {
 		return false;
 	}
+	GLintptr offset = 0;
+	unsigned int size = data_dimensions.x * data_dimensions.y * data_dimensions.z * GetTexelSize(gl_format_, gl_storage_type_);
+	bool staged = upload_ring != nullptr && upload_ring->Stage(texture_data, size, offset);
+
 	glBindTexture(GL_TEXTURE_3D, texture_id_);
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, data_dimensions.x);
-	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, data_dimensions.y);
-	//glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	switch (storage_type_) {
-	case TEX_BYTE:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		break;
-	case TEX_SHORT:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
-		break;
-	case TEX_INT:
-	case TEX_FLOAT:
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-		break;
-	}
+	SetUnpackState(storage_type_);
 	glTexSubImage3D(GL_TEXTURE_3D, 0, 
 		top_left_start.x, top_left_start.y, top_left_start.z, 
 		data_dimensions.x, data_dimensions.y, data_dimensions.z, 
-		gl_channel_type_, gl_storage_type_, texture_data);
+		gl_format_, gl_storage_type_, staged ? (const void*)offset : texture_data);
+
+	if (staged) {
+		upload_ring->Submit();
+	}
 	return true;
 }
 
-void Texture3D::SetNewData(glm::ivec3 dimensions, const void* texture_data)
+void Texture3D::SetNewData(glm::ivec3 dimensions, const void* texture_data, PixelUploadRing* upload_ring)
 {
+	// Immutable storage can't be resized, only new dimensions need a new texture
+	if (valid_texture_ && dimensions == dimensions_)
+	{
+		if (texture_data != nullptr)
+		{
+			ModifyTextureData(glm::ivec3(0, 0, 0), dimensions_, texture_data, upload_ring);
+		}
+		return;
+	}
 	if (texture_id_ != 0)
 	{
 		glDeleteTextures(1, &texture_id_);
+		texture_id_ = 0;
 	}
 	dimensions_ = dimensions;
 	GenTexture(texture_data);
@@ -372,7 +405,7 @@ bool Texture3D::ActiveBind(GLenum texture_unit_binding)
 		return false;
 	}
 	glActiveTexture(texture_unit_binding);
-	glBindTexture(GL_TEXTURE_2D, texture_id_);
+	glBindTexture(GL_TEXTURE_3D, texture_id_);
 	return true;
 }
 
@@ -382,10 +415,10 @@ bool Texture3D::BindImageTexture(GLenum texture_unit_binding)
 		return false;
 	}
 	glBindImageTexture(texture_unit_binding, texture_id_, 
-		0,		// level to bind
-		false,	// T/F texture is layered
-		0,		// layer to bind if layered is T
-		GL_READ_WRITE, storage_type_);
+		0,			// level to bind
+		GL_TRUE,	// T/F texture is layered (must be T to access every slice through an image3D)
+		0,			// layer to bind if layered is T
+		GL_READ_WRITE, gl_channel_type_);
 	return true;
 }
 
@@ -28,6 +28,7 @@ enum ChannelType {
 };
 
 class Shader;
+class PixelUploadRing;
 
 class Texture2D {
 private:
@@ -60,6 +61,14 @@ protected:
 	ChannelType channel_type_;
 	GLenum gl_channel_type_;
 
+	/*
+	* @brief
+	* The format of the pixel data we upload, e.g. GL_RED_INTEGER for R32I.
+	* gl_channel_type_ is always a sized internal format (unsized channel types
+	* get a size from the storage type), since immutable storage requires one.
+	*/
+	GLenum gl_format_;
+
 	/*
 	* @brief
 	* The dimensions / number of pixels for this texture. This MUST be a power of 2
@@ -80,7 +89,7 @@ protected:
 	// For children classes so that they don't have to follow the same format as the public facing API
 	Texture2D() : dimensions_(glm::ivec2(0, 0)), storage_type_(StorageType::TEX_FLOAT), 
 		channel_type_(ChannelType::RGBA), gl_storage_type_(GL_NONE), gl_channel_type_(GL_NONE), 
-		valid_texture_(false), texture_id_(0) {};
+		gl_format_(GL_NONE), valid_texture_(false), texture_id_(0) {};
 public:
 	Texture2D(glm::ivec2 dimensions, StorageType storage_type = StorageType::TEX_FLOAT, 
 		ChannelType channel_type = ChannelType::RGBA, const void* initial_data = nullptr);
@@ -113,8 +122,23 @@ public:
 	*/
 	GLuint GetTextureId() const;
 
-	bool ModifyTextureData(glm::ivec2 top_left_start, glm::ivec2 data_dimensions, const void* texture_data);
-	void SetNewData(glm::ivec2 dimensions, const void* data);
+	/*
+	* @brief
+	* Uploads tightly packed data into a region of the texture.
+	*
+	* @param
+	* upload_ring: If given, the data is staged in it and uploaded from there,
+	* so the call returns without waiting for the copy. Otherwise it is uploaded
+	* from texture_data directly.
+	*/
+	bool ModifyTextureData(glm::ivec2 top_left_start, glm::ivec2 data_dimensions, const void* texture_data, PixelUploadRing* upload_ring = nullptr);
+	/*
+	* @brief
+	* Replaces the contents of the texture. The storage is immutable, so as long as
+	* the dimensions stay the same this is an upload into the same texture and
+	* GetTextureId() stays valid. New dimensions create a new texture.
+	*/
+	void SetNewData(glm::ivec2 dimensions, const void* data, PixelUploadRing* upload_ring = nullptr);
 	glm::ivec2 GetDimensions() const;
 	GLenum GetGLStorageType() const;
 	GLenum GetGLChannelType() const;
@@ -128,6 +152,9 @@ public:
 	* @brief
 	* Used to bind the texture to an image texture unit for use in a shader. Allows for writes in a compute shader and
 	* binding for rendering to texture.
+	* 
+	* Note: image units are plain indices (0, 1, 2, ...) matching the binding in the shader,
+	* not GL_TEXTURE0 + n like ActiveBind().
 	*/
 	virtual bool BindImageTexture(GLenum texture_unit_binding);
 };
@@ -164,6 +191,12 @@ protected:
 	ChannelType channel_type_;
 	GLenum gl_channel_type_;
 
+	/*
+	* @brief
+	* The format of the pixel data we upload, see Texture2D.
+	*/
+	GLenum gl_format_;
+
 	/*
 	* @brief
 	* The dimensions in x, y, z for this 3D texture.
@@ -198,8 +231,17 @@ public:
 	*/
 	GLuint GetTextureId() const;
 
-	bool ModifyTextureData(glm::ivec3 top_left_start, glm::ivec3 data_dimensions, const void* texture_data);
-	void SetNewData(glm::ivec3 dimensions, const void* texture_data);
+	/*
+	* @brief
+	* Uploads tightly packed data into a region of the texture, see Texture2D.
+	*/
+	bool ModifyTextureData(glm::ivec3 top_left_start, glm::ivec3 data_dimensions, const void* texture_data, PixelUploadRing* upload_ring = nullptr);
+	/*
+	* @brief
+	* Replaces the contents of the texture, keeping the texture id unless the
+	* dimensions change. See Texture2D.
+	*/
+	void SetNewData(glm::ivec3 dimensions, const void* texture_data, PixelUploadRing* upload_ring = nullptr);
 	glm::ivec3 GetDimensions() const;
 	GLenum GetGLStorageType() const;
 	GLenum GetGLChannelType() const;
@@ -212,7 +254,10 @@ public:
 	/*
 	* @brief
 	* Used to bind the texture to an image texture unit for use in a shader. Allows for writes in a compute shader and
-	* binding for rendering to texture. 
+	* binding for rendering to texture.
+	* 
+	* Note: image units are plain indices (0, 1, 2, ...) matching the binding in the shader,
+	* not GL_TEXTURE0 + n like ActiveBind(). The whole 3D texture is bound (layered).
 	*/
 	virtual bool BindImageTexture(GLenum texture_unit_binding);
 };
@@ -0,0 +1,623 @@
+#include "cpu_simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+	// The eight faces a particle is splatted to / sampled from for one velocity
+	// component, with their trilinear weights, in the order the shaders use.
+	struct FaceStencil {
+		glm::ivec3 faces[8];
+		float weights[8];
+	};
+
+	// GetGridOffset() and the weight computation of particle_to_grid.comp / grid_to_particle.comp
+	FaceStencil GetFaceStencil(const glm::vec3& ws_pos, int component, float ws_grid_interval, unsigned int grid_dim)
+	{
+		glm::vec3 delta(ws_grid_interval * 0.5f);
+		delta[component] = 0.0f;
+		float one_over_ws_interval = 1.0f / ws_grid_interval;
+
+		unsigned int c0[3];
+		unsigned int c1[3];
+		float t[3];
+		for (int i = 0; i < 3; i++) {
+			c0[i] = std::min((unsigned int)std::floor((ws_pos[i] - delta[i]) * one_over_ws_interval), grid_dim - 1);
+			t[i] = ((ws_pos[i] - delta[i]) - (float)c0[i] * ws_grid_interval) * one_over_ws_interval;
+			c1[i] = std::min(c0[i] + 1, grid_dim - 1);
+		}
+		float sx = 1.0f - t[0];
+		float sy = 1.0f - t[1];
+		float sz = 1.0f - t[2];
+
+		FaceStencil stencil;
+		stencil.faces[0] = glm::ivec3(c0[0], c0[1], c0[2]);
+		stencil.faces[1] = glm::ivec3(c1[0], c0[1], c0[2]);
+		stencil.faces[2] = glm::ivec3(c0[0], c0[1], c1[2]);
+		stencil.faces[3] = glm::ivec3(c1[0], c0[1], c1[2]);
+		stencil.faces[4] = glm::ivec3(c0[0], c1[1], c0[2]);
+		stencil.faces[5] = glm::ivec3(c1[0], c1[1], c0[2]);
+		stencil.faces[6] = glm::ivec3(c0[0], c1[1], c1[2]);
+		stencil.faces[7] = glm::ivec3(c1[0], c1[1], c1[2]);
+		stencil.weights[0] = sx * sy * sz;
+		stencil.weights[1] = t[0] * sy * sz;
+		stencil.weights[2] = sx * sy * t[2];
+		stencil.weights[3] = t[0] * sy * t[2];
+		stencil.weights[4] = sx * t[1] * sz;
+		stencil.weights[5] = t[0] * t[1] * sz;
+		stencil.weights[6] = sx * t[1] * t[2];
+		stencil.weights[7] = t[0] * t[1] * t[2];
+		return stencil;
+	}
+}
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+unsigned int CPU_Simulation::FaceIndex(int x, int y, int z) const
+{
+	int w = grid_dim_ + 1;
+	return x + y * w + z * w * w;
+}
+
+unsigned int CPU_Simulation::CellIndex(int x, int y, int z) const
+{
+	int n = grid_dim_;
+	return x + y * n + z * n * n;
+}
+
+void CPU_Simulation::Dispatch(const char* name, int count, int grain, const std::function<void(int begin, int end)>& body)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	thread_pool_.ParallelFor(count, grain, body);
+	kernel_ms_[name] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CPU_Simulation::ParticleToGrid(float delta)
+{
+	int face_count = (grid_dim_ + 1) * (grid_dim_ + 1) * (grid_dim_ + 1);
+	int num_particles = num_particles_sqrt_ * num_particles_sqrt_;
+
+	Dispatch("particle_to_grid", num_particles, 64, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 position = glm::vec3(particle_pos_[0][i], particle_pos_[1][i], particle_pos_[2][i]) / k_texture_precision_;
+			glm::vec3 velocity = glm::vec3(particle_vel_[0][i], particle_vel_[1][i], particle_vel_[2][i]) / k_texture_precision_;
+
+			// MoveParticle()
+			velocity = velocity + delta * force_;
+			position = position + delta * velocity;
+			for (int c = 0; c < 3; c++) {
+				if (position[c] < ws_lower_bound_particles_[c]) {
+					position[c] = ws_lower_bound_particles_[c];
+					velocity[c] = 0.0f;
+				}
+				if (position[c] > ws_upper_bound_particles_[c]) {
+					position[c] = ws_upper_bound_particles_[c];
+					velocity[c] = 0.0f;
+				}
+			}
+			for (int c = 0; c < 3; c++) {
+				particle_pos_[c][i] = (int)(position[c] * k_texture_precision_);
+				particle_vel_[c][i] = (int)(velocity[c] * k_texture_precision_);
+			}
+
+			// Count the particle in its cell
+			glm::ivec3 cell = glm::clamp(glm::ivec3((position - ws_lower_bound_grid_) / ws_grid_interval_), glm::ivec3(0), glm::ivec3(grid_dim_ - 1));
+			grid_accumulators_[6 * face_count + CellIndex(cell.x, cell.y, cell.z)].fetch_add(1, std::memory_order_relaxed);
+
+			// Splat the velocity onto the faces of every component
+			glm::vec3 ws_pos = glm::clamp(position - ws_lower_bound_grid_, glm::vec3(ws_grid_interval_), ws_upper_bound_grid_ - ws_lower_bound_grid_);
+			for (int component = 0; component < 3; component++) {
+				FaceStencil stencil = GetFaceStencil(ws_pos, component, ws_grid_interval_, grid_dim_);
+				float vel = velocity[component];
+				for (int k = 0; k < 8; k++) {
+					const glm::ivec3& face = stencil.faces[k];
+					unsigned int index = FaceIndex(face.x, face.y, face.z);
+					grid_accumulators_[component * face_count + index].fetch_add((int)(vel * stencil.weights[k] * k_texture_precision_), std::memory_order_relaxed);
+					grid_accumulators_[(3 + component) * face_count + index].fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+	});
+}
+
+void CPU_Simulation::AverageGrid()
+{
+	int w = grid_dim_ + 1;
+	int n = grid_dim_;
+	int face_count = w * w * w;
+
+	Dispatch("average_grid", face_count, 64, [&](int begin, int end) {
+		for (int index = begin; index < end; index++) {
+			int x = index % w;
+			int y = (index / w) % w;
+			int z = index / (w * w);
+			for (int component = 0; component < 3; component++) {
+				int sum = grid_accumulators_[component * face_count + index].exchange(0, std::memory_order_relaxed);
+				int count = grid_accumulators_[(3 + component) * face_count + index].exchange(0, std::memory_order_relaxed);
+				grid_old_vel_[component][index] = count != 0 ? sum / count : 0;
+			}
+
+			if (x < n && y < n && z < n) {
+				unsigned int cell = CellIndex(x, y, z);
+				int particles = grid_accumulators_[6 * face_count + cell].exchange(0, std::memory_order_relaxed);
+				// Solid cells stay solid
+				if (grid_cell_type_[cell] != SOLID) {
+					grid_cell_type_[cell] = particles > 0 ? FLUID : AIR;
+				}
+			}
+		}
+	});
+}
+
+void CPU_Simulation::PressureDivergence()
+{
+	int n = grid_dim_;
+	std::vector<float>& pressure = *pressure_;
+
+	Dispatch("pressure_divergence", n * n * n, 64, [&](int begin, int end) {
+		for (int cell = begin; cell < end; cell++) {
+			int x = cell % n;
+			int y = (cell / n) % n;
+			int z = cell / (n * n);
+
+			float divergence = 0.0f;
+			if (grid_cell_type_[cell] == FLUID) {
+				unsigned int face = FaceIndex(x, y, z);
+				float vel_x = grid_old_vel_[0][face] / k_texture_precision_;
+				float vel_y = grid_old_vel_[1][face] / k_texture_precision_;
+				float vel_z = grid_old_vel_[2][face] / k_texture_precision_;
+				float vel_x_pos = grid_old_vel_[0][FaceIndex(x + 1, y, z)] / k_texture_precision_;
+				float vel_y_pos = grid_old_vel_[1][FaceIndex(x, y + 1, z)] / k_texture_precision_;
+				float vel_z_pos = grid_old_vel_[2][FaceIndex(x, y, z + 1)] / k_texture_precision_;
+				divergence = vel_x_pos - vel_x + vel_y_pos - vel_y + vel_z_pos - vel_z;
+			}
+			else {
+				pressure[cell] = 0.0f;
+			}
+			grid_divergence_[cell] = divergence;
+		}
+	});
+}
+
+void CPU_Simulation::PressureSolveTile(const glm::ivec3& tile, int sweeps)
+{
+	const int T = k_pressure_tile_size_;
+	const int H = T + 2;
+	const int n = grid_dim_;
+	glm::ivec3 tile_origin = tile * T - glm::ivec3(1);
+	const std::vector<float>& pressure_in = *pressure_;
+	std::vector<float>& pressure_out = *pressure_scratch_;
+
+	// (1) Load the tile and its halo
+	float tile_pressure[H * H * H];
+	for (int i = 0; i < H * H * H; i++) {
+		glm::ivec3 grid_pos = tile_origin + glm::ivec3(i % H, (i / H) % H, i / (H * H));
+		bool in_grid = glm::all(glm::greaterThanEqual(grid_pos, glm::ivec3(0))) && glm::all(glm::lessThan(grid_pos, glm::ivec3(n)));
+		tile_pressure[i] = in_grid ? pressure_in[CellIndex(grid_pos.x, grid_pos.y, grid_pos.z)] : 0.0f;
+	}
+
+	// (2) Everything each cell needs which does not change between sweeps
+	struct CellSetup {
+		bool in_grid;
+		bool is_fluid_cell;
+		bool solve_cell;
+		unsigned int color;
+		float s_n[6];
+		float s;
+		float rhs;
+	};
+	CellSetup cells[T * T * T];
+	auto IsFluid = [&](const glm::ivec3& pos) {
+		if (glm::any(glm::lessThan(pos, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(pos, glm::ivec3(n)))) {
+			return 0.0f;
+		}
+		return (float)grid_is_fluid_[CellIndex(pos.x, pos.y, pos.z)];
+	};
+	for (int i = 0; i < T * T * T; i++) {
+		glm::ivec3 pos = tile * T + glm::ivec3(i % T, (i / T) % T, i / (T * T));
+		CellSetup& setup = cells[i];
+		setup.in_grid = glm::all(glm::lessThan(pos, glm::ivec3(n)));
+		setup.is_fluid_cell = setup.in_grid && grid_cell_type_[CellIndex(pos.x, pos.y, pos.z)] == FLUID;
+		setup.s_n[0] = IsFluid(pos + glm::ivec3(-1, 0, 0));
+		setup.s_n[1] = IsFluid(pos + glm::ivec3(1, 0, 0));
+		setup.s_n[2] = IsFluid(pos + glm::ivec3(0, -1, 0));
+		setup.s_n[3] = IsFluid(pos + glm::ivec3(0, 1, 0));
+		setup.s_n[4] = IsFluid(pos + glm::ivec3(0, 0, -1));
+		setup.s_n[5] = IsFluid(pos + glm::ivec3(0, 0, 1));
+		setup.s = setup.s_n[0] + setup.s_n[1] + setup.s_n[2] + setup.s_n[3] + setup.s_n[4] + setup.s_n[5];
+		setup.rhs = setup.in_grid ? grid_divergence_[CellIndex(pos.x, pos.y, pos.z)] : 0.0f;
+		setup.solve_cell = setup.is_fluid_cell && setup.s > 0.0f;
+		setup.color = (unsigned int)(pos.x + pos.y + pos.z) & 1u;
+	}
+
+	// (3) Red-black sweeps. Cells of one color only read the other color, so
+	// running them one after the other gives the same result as in parallel.
+	for (int sweep = 0; sweep < sweeps; sweep++) {
+		for (unsigned int pass = 0; pass < 2; pass++) {
+			for (int i = 0; i < T * T * T; i++) {
+				const CellSetup& setup = cells[i];
+				if (!setup.solve_cell || setup.color != pass) {
+					continue;
+				}
+				int local_index = ((i / (T * T) + 1) * H + ((i / T) % T + 1)) * H + (i % T + 1);
+				float sum = setup.s_n[0] * tile_pressure[local_index - 1]
+					+ setup.s_n[1] * tile_pressure[local_index + 1]
+					+ setup.s_n[2] * tile_pressure[local_index - H]
+					+ setup.s_n[3] * tile_pressure[local_index + H]
+					+ setup.s_n[4] * tile_pressure[local_index - H * H]
+					+ setup.s_n[5] * tile_pressure[local_index + H * H];
+				float p = (sum - setup.rhs) / setup.s;
+				// GLSL mix()
+				tile_pressure[local_index] = tile_pressure[local_index] * (1.0f - over_relaxation_) + p * over_relaxation_;
+			}
+		}
+	}
+
+	// (4) Write the interior of the tile back
+	for (int i = 0; i < T * T * T; i++) {
+		const CellSetup& setup = cells[i];
+		if (!setup.in_grid) {
+			continue;
+		}
+		glm::ivec3 local_pos(i % T, (i / T) % T, i / (T * T));
+		glm::ivec3 pos = tile * T + local_pos;
+		int local_index = ((local_pos.z + 1) * H + (local_pos.y + 1)) * H + (local_pos.x + 1);
+		pressure_out[CellIndex(pos.x, pos.y, pos.z)] = setup.is_fluid_cell ? tile_pressure[local_index] : 0.0f;
+	}
+}
+
+void CPU_Simulation::PressureSolveRedBlack()
+{
+	// Same dispatch plan as GPU_Simulation::SolvePressureRedBlack()
+	bool single_tile = grid_dim_ <= (unsigned int)k_pressure_tile_size_;
+	int sweeps = single_tile ? iterations_ : sweeps_per_dispatch_;
+	int dispatches = sweeps > 0 ? (iterations_ + sweeps - 1) / sweeps : 0;
+	int tiles = (grid_dim_ + k_pressure_tile_size_ - 1) / k_pressure_tile_size_;
+
+	for (int i = 0; i < dispatches; i++) {
+		Dispatch("pressure_solve_redblack", tiles * tiles * tiles, 1, [&](int begin, int end) {
+			for (int tile = begin; tile < end; tile++) {
+				PressureSolveTile(glm::ivec3(tile % tiles, (tile / tiles) % tiles, tile / (tiles * tiles)), sweeps);
+			}
+		});
+		std::vector<float>* temp = pressure_;
+		pressure_ = pressure_scratch_;
+		pressure_scratch_ = temp;
+	}
+}
+
+void CPU_Simulation::PressureApply()
+{
+	int w = grid_dim_ + 1;
+	int n = grid_dim_;
+	const std::vector<float>& pressure = *pressure_;
+
+	Dispatch("pressure_apply", w * w * w, 64, [&](int begin, int end) {
+		for (int index = begin; index < end; index++) {
+			glm::ivec3 face(index % w, (index / w) % w, index / (w * w));
+			for (int component = 0; component < 3; component++) {
+				glm::ivec3 axis(0);
+				axis[component] = 1;
+				glm::ivec3 lower_cell = face - axis;
+
+				int fixed_delta = 0;
+				if (!glm::any(glm::lessThan(lower_cell, glm::ivec3(0))) && !glm::any(glm::greaterThanEqual(face, glm::ivec3(n)))) {
+					unsigned int face_cell = CellIndex(face.x, face.y, face.z);
+					unsigned int lower = CellIndex(lower_cell.x, lower_cell.y, lower_cell.z);
+					if (grid_is_fluid_[lower] * grid_is_fluid_[face_cell] != 0) {
+						float gradient = pressure[face_cell] - pressure[lower];
+						// GLSL leaves which way round() breaks ties to the driver, the ones
+						// we run on round to even like nearbyint() does by default
+						fixed_delta = (int)std::nearbyint(gradient * k_texture_precision_);
+					}
+				}
+				grid_vel_[component][index] = grid_old_vel_[component][index] - fixed_delta;
+			}
+		}
+	});
+}
+
+void CPU_Simulation::GridToParticle()
+{
+	int n = grid_dim_;
+	int num_particles = num_particles_sqrt_ * num_particles_sqrt_;
+
+	// The cell type image reads 0 (solid) outside of the grid
+	auto IsValid = [&](const glm::ivec3& cell, const glm::ivec3& offset) {
+		glm::ivec3 other = cell + offset;
+		unsigned int other_type = glm::all(glm::lessThan(other, glm::ivec3(n))) ? grid_cell_type_[CellIndex(other.x, other.y, other.z)] : (unsigned int)SOLID;
+		return grid_cell_type_[CellIndex(cell.x, cell.y, cell.z)] != AIR || other_type != AIR ? 1.0f : 0.0f;
+	};
+
+	Dispatch("grid_to_particle", num_particles, 64, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 position = glm::vec3(particle_pos_[0][i], particle_pos_[1][i], particle_pos_[2][i]) / k_texture_precision_;
+			glm::vec3 velocity = glm::vec3(particle_vel_[0][i], particle_vel_[1][i], particle_vel_[2][i]) / k_texture_precision_;
+			glm::vec3 new_velocity = velocity;
+
+			glm::vec3 ws_pos = glm::clamp(position - ws_lower_bound_grid_, glm::vec3(ws_grid_interval_), ws_upper_bound_grid_ - ws_lower_bound_grid_);
+			for (int component = 0; component < 3; component++) {
+				FaceStencil stencil = GetFaceStencil(ws_pos, component, ws_grid_interval_, grid_dim_);
+				glm::ivec3 offset(0);
+				offset[component] = 1;
+
+				float valid[8];
+				float d = 0.0f;
+				for (int k = 0; k < 8; k++) {
+					valid[k] = IsValid(stencil.faces[k], offset);
+					d += valid[k] * stencil.weights[k];
+				}
+				if (d <= 0.0f) {
+					continue;
+				}
+
+				float pic_v = 0.0f;
+				float diff = 0.0f;
+				for (int k = 0; k < 8; k++) {
+					const glm::ivec3& face = stencil.faces[k];
+					unsigned int index = FaceIndex(face.x, face.y, face.z);
+					float v = grid_vel_[component][index] / k_texture_precision_;
+					float dv = v - grid_old_vel_[component][index] / k_texture_precision_;
+					pic_v += valid[k] * v * stencil.weights[k];
+					diff += valid[k] * dv * stencil.weights[k];
+				}
+				pic_v /= d;
+				diff /= d;
+
+				float flip_v = velocity[component] + diff;
+				new_velocity[component] = flip_ratio_ * flip_v + (1.0f - flip_ratio_) * pic_v;
+			}
+
+			for (int c = 0; c < 3; c++) {
+				particle_vel_[c][i] = (int)(new_velocity[c] * k_texture_precision_);
+			}
+		}
+	});
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+CPU_Simulation::CPU_Simulation(int num_particles_sqrt, int grid_dimen, int iteration, unsigned int num_threads) :
+	thread_pool_(num_threads),
+	grid_dim_(grid_dimen),
+	num_particles_sqrt_(num_particles_sqrt),
+	ws_grid_interval_(2.0f / grid_dimen), // the grid spans [-1, 1] on every axis
+	ws_lower_bound_grid_(glm::vec3(-1, -1, -1)),
+	ws_upper_bound_grid_(glm::vec3(1, 1, 1)),
+	ws_lower_bound_particles_(glm::vec3(-1, -1, -1)),
+	ws_upper_bound_particles_(glm::vec3(1, 1, 1)),
+	k_texture_precision_(1000),
+	iterations_(iteration),
+	flip_ratio_(0.1f),
+	over_relaxation_(1.5f),
+	force_(glm::vec3(0, -9.8, 0)),
+	sweeps_per_dispatch_(4),
+	grid_accumulators_(6 * (grid_dimen + 1) * (grid_dimen + 1) * (grid_dimen + 1) + grid_dimen * grid_dimen * grid_dimen),
+	step_count_(0),
+	grid_projected_(false)
+{
+	unsigned int num_particles = num_particles_sqrt_ * num_particles_sqrt_;
+	unsigned int grid_dim_cubed = grid_dim_ * grid_dim_ * grid_dim_;
+	unsigned int grid_dim_plus_one_cubed = (grid_dim_ + 1) * (grid_dim_ + 1) * (grid_dim_ + 1);
+
+	for (int c = 0; c < 3; c++) {
+		particle_pos_[c].assign(num_particles, 0);
+		particle_vel_[c].assign(num_particles, 0);
+		grid_vel_[c].assign(grid_dim_plus_one_cubed, 0);
+		grid_old_vel_[c].assign(grid_dim_plus_one_cubed, 0);
+	}
+
+	// Solid border, the inside starts as air
+	grid_is_fluid_.assign(grid_dim_cubed, 0);
+	grid_cell_type_.assign(grid_dim_cubed, SOLID);
+	for (int x = 1; x + 1 < grid_dimen; x++) {
+		for (int y = 1; y + 1 < grid_dimen; y++) {
+			for (int z = 1; z + 1 < grid_dimen; z++) {
+				grid_is_fluid_[CellIndex(x, y, z)] = 1;
+				grid_cell_type_[CellIndex(x, y, z)] = AIR;
+			}
+		}
+	}
+
+	grid_divergence_.assign(grid_dim_cubed, 0.0f);
+	grid_pressure_a_.assign(grid_dim_cubed, 0.0f);
+	grid_pressure_b_.assign(grid_dim_cubed, 0.0f);
+
+	for (std::atomic<int>& accumulator : grid_accumulators_) {
+		accumulator.store(0, std::memory_order_relaxed);
+	}
+}
+
+CPU_Simulation::~CPU_Simulation()
+{
+}
+
+void CPU_Simulation::SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float /*interval*/)
+{
+	// Like GPU_Simulation the particles form a square texture
+	num_particles_sqrt_ = (unsigned int)floor(sqrt(initial.size()));
+	unsigned int num_particles = num_particles_sqrt_ * num_particles_sqrt_;
+	for (int c = 0; c < 3; c++) {
+		particle_pos_[c].assign(num_particles, 0);
+		particle_vel_[c].assign(num_particles, 0);
+	}
+
+	// Same placement as GPU_Simulation: spread evenly inside the solid border
+	glm::vec3 grid_interval_magnitude(std::abs(ws_grid_interval_));
+	SeedParticles(ParticleEmitter(ParticleEmitter::REGULAR, lower_bound + grid_interval_magnitude, upper_bound - grid_interval_magnitude));
+
+	for (unsigned int i = 0; i < num_particles; i++) {
+		for (int c = 0; c < 3; c++) {
+			particle_vel_[c][i] = (int)(initial[i][c] * k_texture_precision_);
+		}
+	}
+	MarkDataChanged();
+}
+
+void CPU_Simulation::SeedParticles(const ParticleEmitter& emitter)
+{
+	unsigned int num_particles = num_particles_sqrt_ * num_particles_sqrt_;
+	unsigned int lattice_side = ParticleEmitter::GetLatticeSide(num_particles);
+	glm::ivec3 velocity = glm::ivec3(emitter.velocity * k_texture_precision_);
+
+	// "compute/seed_particles.comp", not timed since it isn't part of a step
+	thread_pool_.ParallelFor(num_particles, 256, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 position = emitter.GetPosition(i, lattice_side);
+			for (int c = 0; c < 3; c++) {
+				particle_pos_[c][i] = (int)(position[c] * k_texture_precision_);
+				particle_vel_[c][i] = velocity[c];
+			}
+		}
+	});
+	MarkDataChanged();
+}
+
+void CPU_Simulation::TimeStep(float delta)
+{
+	for (int phase = 0; phase < NUM_STEP_PHASES; phase++) {
+		TimeStepPhase((StepPhase)phase, delta);
+	}
+}
+
+bool CPU_Simulation::SupportsStepPhases()
+{
+	return true;
+}
+
+void CPU_Simulation::TimeStepPhase(StepPhase phase, float delta)
+{
+	switch (phase) {
+	case TRANSFER_TO_GRID:
+		++step_count_;
+		ParticleToGrid(delta);
+		AverageGrid();
+		grid_projected_ = false;
+		break;
+	case PRESSURE_PROJECTION:
+		PressureDivergence();
+		PressureSolveRedBlack();
+		PressureApply();
+		grid_projected_ = true;
+		break;
+	case TRANSFER_TO_PARTICLES:
+		GridToParticle();
+		break;
+	default:
+		break;
+	}
+	MarkDataChanged();
+}
+
+std::vector<glm::vec3>* CPU_Simulation::GetGridVelocities()
+{
+	// Same remapping as GPU_Simulation::GetGridVelocities()
+	const std::vector<int>* grid_vel = grid_projected_ ? grid_vel_ : grid_old_vel_;
+	unsigned int faces = grid_dim_ + 1;
+	grid_velocities_.assign(faces * faces * faces, glm::vec3(0.0f));
+	for (unsigned int x = 0; x < grid_dim_; x++) {
+		for (unsigned int y = 0; y < grid_dim_; y++) {
+			for (unsigned int z = 0; z < grid_dim_; z++) {
+				unsigned int texel = FaceIndex(x, y, z);
+				grid_velocities_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] =
+					glm::vec3(grid_vel[0][texel], grid_vel[1][texel], grid_vel[2][texel]) / k_texture_precision_;
+			}
+		}
+	}
+	return &grid_velocities_;
+}
+
+unsigned int CPU_Simulation::GetGridDimensions()
+{
+	return grid_dim_;
+}
+
+glm::vec3 CPU_Simulation::GetGridUpperBounds()
+{
+	return ws_upper_bound_grid_;
+}
+
+glm::vec3 CPU_Simulation::GetGridLowerBounds()
+{
+	return ws_lower_bound_grid_;
+}
+
+float CPU_Simulation::GetGridInterval()
+{
+	return ws_grid_interval_;
+}
+
+std::vector<float>* CPU_Simulation::GetGridPressures()
+{
+	grid_pressures_.resize(grid_dim_ * grid_dim_ * grid_dim_);
+	for (unsigned int x = 0; x < grid_dim_; x++) {
+		for (unsigned int y = 0; y < grid_dim_; y++) {
+			for (unsigned int z = 0; z < grid_dim_; z++) {
+				grid_pressures_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] = (*pressure_)[CellIndex(x, y, z)];
+			}
+		}
+	}
+	return &grid_pressures_;
+}
+
+std::vector<float>* CPU_Simulation::GetGridDyeDensities()
+{
+	return nullptr;
+}
+
+std::vector<float>* CPU_Simulation::GetGridFluidCells()
+{
+	grid_fluid_cells_.resize(grid_dim_ * grid_dim_ * grid_dim_);
+	for (unsigned int x = 0; x < grid_dim_; x++) {
+		for (unsigned int y = 0; y < grid_dim_; y++) {
+			for (unsigned int z = 0; z < grid_dim_; z++) {
+				grid_fluid_cells_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] =
+					grid_cell_type_[CellIndex(x, y, z)] == FLUID ? 1.0f : 0.0f;
+			}
+		}
+	}
+	return &grid_fluid_cells_;
+}
+
+std::vector<glm::vec3>* CPU_Simulation::GetParticleVelocities()
+{
+	particle_velocities_.resize(particle_vel_[0].size());
+	for (unsigned int i = 0; i < particle_velocities_.size(); i++) {
+		particle_velocities_[i] = glm::vec3(particle_vel_[0][i], particle_vel_[1][i], particle_vel_[2][i]) / k_texture_precision_;
+	}
+	return &particle_velocities_;
+}
+
+std::vector<glm::vec3>* CPU_Simulation::GetParticlePositions()
+{
+	particle_positions_.resize(particle_pos_[0].size());
+	for (unsigned int i = 0; i < particle_positions_.size(); i++) {
+		particle_positions_[i] = glm::vec3(particle_pos_[0][i], particle_pos_[1][i], particle_pos_[2][i]) / k_texture_precision_;
+	}
+	return &particle_positions_;
+}
+
+float CPU_Simulation::GetTexturePrecision()
+{
+	return k_texture_precision_;
+}
+
+unsigned int CPU_Simulation::GetThreadCount() const
+{
+	return thread_pool_.GetThreadCount();
+}
+
+std::map<std::string, double> CPU_Simulation::GetKernelTimes() const
+{
+	std::map<std::string, double> times;
+	for (const std::pair<const std::string, double>& kernel : kernel_ms_) {
+		times[kernel.first] = step_count_ > 0 ? kernel.second / step_count_ : 0.0;
+	}
+	return times;
+}
@@ -0,0 +1,175 @@
+#ifndef CPU_SIM_H
+#define CPU_SIM_H
+
+#include "sequential_simulation.hpp"
+#include "particle_emitter.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+
+/*
+* @brief
+* Runs the kernels of GPU_Simulation on the CPU. Every kernel is a C++ function
+* that does what its compute shader does, invocation for invocation, on the same
+* data: fixed point particle and face textures laid out like the GL textures
+* (x fastest), the same accumulator buffer, and the same tiled red-black pressure
+* solve. Dispatches become ThreadPool::ParallelFor() loops.
+*
+* This gives a way to run and profile the simulation logic on machines without
+* a GPU, and a reference to check kernel changes against. The results match the
+* GPU up to float rounding, which differs slightly between compilers and drivers.
+*
+* The multigrid solver is not emulated, the pressure is always solved with the
+* red-black sweeps.
+*/
+class CPU_Simulation : public Simulation {
+private:
+	enum CellType {
+		SOLID,
+		FLUID,
+		AIR
+	};
+
+	ThreadPool thread_pool_;
+
+	unsigned int grid_dim_;
+	unsigned int num_particles_sqrt_;
+	float ws_grid_interval_;
+	glm::vec3 ws_lower_bound_grid_;
+	glm::vec3 ws_upper_bound_grid_;
+	glm::vec3 ws_lower_bound_particles_;
+	glm::vec3 ws_upper_bound_particles_;
+
+	const float k_texture_precision_;
+	int iterations_;
+	float flip_ratio_;
+	float over_relaxation_;
+	glm::vec3 force_;
+
+	/// <summary>
+	/// Same as the GPU's, see GPU_Simulation. The tile size changes the result
+	/// of the pressure solve, so it must match k_pressure_tile_size_ there.
+	/// </summary>
+	static const int k_pressure_tile_size_ = 8;
+	int sweeps_per_dispatch_;
+
+	/// <summary>
+	/// Stand-ins for the textures of GPU_Simulation, with the same formats and
+	/// layout. Particles are num_particles_sqrt_^2 texels, faces (grid_dim_ + 1)^3
+	/// and cells grid_dim_^3.
+	/// </summary>
+	std::vector<int> particle_pos_[3];
+	std::vector<int> particle_vel_[3];
+
+	std::vector<int> grid_vel_[3];
+	std::vector<int> grid_old_vel_[3];
+
+	std::vector<unsigned int> grid_is_fluid_;
+	std::vector<unsigned int> grid_cell_type_;
+
+	std::vector<float> grid_divergence_;
+	std::vector<float> grid_pressure_a_;
+	std::vector<float> grid_pressure_b_;
+	std::vector<float>* pressure_ = &grid_pressure_a_;
+	std::vector<float>* pressure_scratch_ = &grid_pressure_b_;
+
+	/// <summary>
+	/// The accumulator SSBO of particle_to_grid, see "compute/particle_to_grid.comp".
+	/// </summary>
+	std::vector<std::atomic<int>> grid_accumulators_;
+
+	/// <summary>
+	/// The wall time spent in every kernel, summed over all steps.
+	/// </summary>
+	std::map<std::string, double> kernel_ms_;
+	long long step_count_;
+
+	/// <summary>
+	/// Whether grid_vel_ holds the projection of the current grid_old_vel_,
+	/// see GPU_Simulation.
+	/// </summary>
+	bool grid_projected_;
+
+	/// <summary>
+	/// The Get* results, laid out the same way as the ones of SequentialGridBased.
+	/// </summary>
+	std::vector<glm::vec3> particle_positions_;
+	std::vector<glm::vec3> particle_velocities_;
+	std::vector<glm::vec3> grid_velocities_;
+	std::vector<float> grid_pressures_;
+	std::vector<float> grid_fluid_cells_;
+
+	// Kernels, one per compute shader
+	void ParticleToGrid(float delta);
+	void AverageGrid();
+	void PressureDivergence();
+	void PressureSolveRedBlack();
+	void PressureApply();
+	void GridToParticle();
+
+	/*
+	* @brief
+	* Runs one work group of "compute/pressure_solve_redblack.comp".
+	*/
+	void PressureSolveTile(const glm::ivec3& tile, int sweeps);
+
+	/*
+	* @brief
+	* Runs a kernel over count items on the thread pool and adds its time to kernel_ms_.
+	*/
+	void Dispatch(const char* name, int count, int grain, const std::function<void(int begin, int end)>& body);
+
+	unsigned int FaceIndex(int x, int y, int z) const;
+	unsigned int CellIndex(int x, int y, int z) const;
+
+public:
+	/*
+	* @brief
+	* Takes the same arguments as GPU_Simulation.
+	*
+	* @param
+	* num_threads: The threads the kernels run on, 0 for one per hardware thread.
+	*/
+	CPU_Simulation(int num_particles_sqrt, int grid_dim, int iteration, unsigned int num_threads = 0);
+	~CPU_Simulation();
+
+	virtual void SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval);
+	virtual void TimeStep(float delta);
+	virtual bool SupportsStepPhases();
+	virtual void TimeStepPhase(StepPhase phase, float delta);
+	virtual std::vector<glm::vec3>* GetGridVelocities();
+	virtual unsigned int GetGridDimensions();
+	virtual glm::vec3 GetGridUpperBounds();
+	virtual glm::vec3 GetGridLowerBounds();
+	virtual float GetGridInterval();
+	virtual std::vector<float>* GetGridPressures();
+	/*
+	* @brief
+	* The particle simulations carry no dye, so this is always nullptr.
+	*/
+	virtual std::vector<float>* GetGridDyeDensities();
+	virtual std::vector<float>* GetGridFluidCells();
+	virtual std::vector<glm::vec3>* GetParticleVelocities();
+	virtual std::vector<glm::vec3>* GetParticlePositions();
+
+	float GetTexturePrecision();
+	unsigned int GetThreadCount() const;
+
+	/*
+	* @brief
+	* Same as GPU_Simulation::SeedParticles(), placing every particle with
+	* ParticleEmitter::GetPosition().
+	*/
+	void SeedParticles(const ParticleEmitter& emitter);
+
+	/*
+	* @brief
+	* The average wall time of every kernel per step, in milliseconds, keyed by
+	* the name of its compute shader.
+	*/
+	std::map<std::string, double> GetKernelTimes() const;
+};
+
+#endif // !CPU_SIM_H
@@ -1,5 +1,8 @@
 #include "debug_renderer.hpp"
 
+#include <algorithm>
+#include <cstdio>
+
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "sequential_simulation.hpp"
@@ -38,42 +41,32 @@ void ConstructAxisAlignedModelMat(glm::mat4& res, const glm::vec3& scale, const
 	res = glm::scale(glm::translate(glm::mat4(1.0f), start), scale);
 }
 
-void ConstructVectorAlignedModelMat(glm::mat4& res, const glm::vec3& scale, const glm::vec3& pos, const glm::vec3& forward, const glm::vec3& up, const glm::vec3& right) {
-	glm::mat4 rot_mat = glm::mat4(
-		right.x, right.y, right.z, 0.0,
-		up.x, up.y, up.z, 0.0,
-		forward.x, forward.y, forward.z, 0.0,
-		0.0, 0.0, 0.0, 1.0
-	);
-	
-	res = glm::translate(glm::mat4(1.0f), pos) * rot_mat * glm::scale(glm::mat4(1.0f), scale);
-}
-
 void DebugRenderer::UpdateGridLines()
 {
 	static const glm::vec3 grid_line_color = glm::vec3(156.0 / 256.0, 158.0 / 256.0, 136.0 / 256.0);
 	int grid_size = (ws_grid_upper_bound_.x - ws_grid_lower_bound_.x) / ws_grid_cell_size_ + 1;
 	const float k_line_thickness = 0.01f;
-	glm::vec3 line_scale = glm::vec3(k_line_thickness, ws_grid_cell_size_ / 3.0, k_line_thickness);
+	// Only every grid_stride_-th grid point is marked
+	const float step = ws_grid_cell_size_ * grid_stride_;
 
 	//printf("Updating grid lines\n   low bound: [%3.3f, %3.3f, %3.3f]\n   upper bound: [%3.3f, %3.3f, %3.3f]\n", ws_grid_lower_bound_.x, ws_grid_lower_bound_.y, ws_grid_lower_bound_.z, ws_grid_upper_bound_.x, ws_grid_upper_bound_.y, ws_grid_upper_bound_.z);
 	std::vector<glm::mat4> line_mats;
 	std::vector<glm::vec3> line_color;
-	for (float z = ws_grid_lower_bound_.z; z <= ws_grid_upper_bound_.z; z += ws_grid_cell_size_) {
-		for (float y = ws_grid_lower_bound_.y; y <= ws_grid_upper_bound_.y; y += ws_grid_cell_size_) {
-			for (float x = ws_grid_lower_bound_.x; x <= ws_grid_upper_bound_.x; x += ws_grid_cell_size_) {
+	for (float z = ws_grid_lower_bound_.z; z <= ws_grid_upper_bound_.z; z += step) {
+		for (float y = ws_grid_lower_bound_.y; y <= ws_grid_upper_bound_.y; y += step) {
+			for (float x = ws_grid_lower_bound_.x; x <= ws_grid_upper_bound_.x; x += step) {
 				glm::mat4 mat;
 				//printf("At grid ws pos: \n   [%3.3f, %3.3f, %3.3f] with upper bounds [%3.3f, %3.3f, %3.3f]\n", x, y, z, ws_grid_upper_bound_.x, ws_grid_upper_bound_.y, ws_grid_upper_bound_.z);
 				if (x < ws_grid_upper_bound_.x) {
 					//printf("   Drawing x line\n");
-					ConstructAxisAlignedModelMat(mat, glm::vec3(ws_grid_cell_size_ / 3.0, k_line_thickness, k_line_thickness), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(step / 3.0, k_line_thickness, k_line_thickness), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(1, 0, 0));
 				}
 
 				if (x > ws_grid_lower_bound_.x) {
-					ConstructAxisAlignedModelMat(mat, glm::vec3(-ws_grid_cell_size_ / 3.0, k_line_thickness, k_line_thickness), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(-step / 3.0, k_line_thickness, k_line_thickness), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(0, 1, 1));
@@ -81,14 +74,14 @@ void DebugRenderer::UpdateGridLines()
 
 				if (y < ws_grid_upper_bound_.y) {
 					//printf("   Drawing y line\n");
-					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, ws_grid_cell_size_ / 3.0, k_line_thickness), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, step / 3.0, k_line_thickness), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(0, 1, 0));
 				}
 
 				if (y > ws_grid_lower_bound_.y) {
-					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, -ws_grid_cell_size_ / 3.0, k_line_thickness), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, -step / 3.0, k_line_thickness), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(1, 0, 1));
@@ -96,14 +89,14 @@ void DebugRenderer::UpdateGridLines()
 
 				if (z < ws_grid_upper_bound_.z) {
 					//printf("   Drawing z line\n");
-					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, k_line_thickness, ws_grid_cell_size_ / 3.0), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, k_line_thickness, step / 3.0), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(0, 0, 1));
 				}
 
 				if (z > ws_grid_lower_bound_.z) {
-					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, k_line_thickness, -ws_grid_cell_size_ / 3.0), glm::vec3(x, y, z));
+					ConstructAxisAlignedModelMat(mat, glm::vec3(k_line_thickness, k_line_thickness, -step / 3.0), glm::vec3(x, y, z));
 					line_mats.push_back(mat);
 					line_color.push_back(grid_line_color);
 					//line_color.push_back(glm::vec3(1, 1, 0));
@@ -112,140 +105,76 @@ void DebugRenderer::UpdateGridLines()
 		}
 	}
 
-	glBindVertexArray(VAO_grid_lines_);
-	// load data into vertex buffers
+	// Only changes with the grid boundaries, so uploaded once at its exact size
 	grid_line_elements_ = line_mats.size();
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_line_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_LINES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, line_mats.size() * sizeof(glm::mat4), (void*)&line_mats[0]);
+	glBufferData(GL_ARRAY_BUFFER, line_mats.size() * sizeof(glm::mat4), line_mats.data(), GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_line_color_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_LINES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, line_color.size() * sizeof(glm::vec3), (void*)&line_color[0]);
+	glBufferData(GL_ARRAY_BUFFER, line_color.size() * sizeof(glm::vec3), line_color.data(), GL_STATIC_DRAW);
 
-	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void DebugRenderer::UpdateGridAxisVelocities(const std::vector<glm::vec3>& velocities, const unsigned int grid_dim)
+// Writes every stride-th cell of a grid stored as x * dim * dim + y * dim + z into
+// the stream, in the same order. Returns the number of cells written.
+template <typename T>
+static unsigned int WriteGridSamples(StreamingBuffer& stream, const std::vector<T>& grid, const unsigned int grid_dim, const unsigned int stride)
 {
-	std::vector<glm::mat4> arrow_mats;
-	std::vector<glm::vec3> arrow_colors;
-	const float thickness = 0.01f;
-
-	const glm::vec3 k_x_color = glm::vec3(0.8, 0.2, 0.2);
-	const glm::vec3 k_y_color = glm::vec3(0.2, 0.8, 0.2);
-	const glm::vec3 k_z_color = glm::vec3(0.2, 0.2, 0.8);
-	//arrow_mats.push_back(glm::scale(glm::mat4(1.0f), glm::vec3(thickness, 1.0f, thickness)));
-	//arrow_colors.push_back(glm::vec3(0.3, 0.4, 1.0));
-	for (int z = 0; z < grid_dim; z++) {
-		for (int y = 0; y < grid_dim; y++) {
-			for (int x = 0; x < grid_dim; x++) {
-				glm::vec3 x_pos = ws_grid_lower_bound_ + glm::vec3(x, y, z) * ws_grid_cell_size_ + glm::vec3(0.0, ws_grid_cell_size_ / 2.0, ws_grid_cell_size_ / 2.0);
-				glm::vec3 y_pos = ws_grid_lower_bound_ + glm::vec3(x, y, z) * ws_grid_cell_size_ + glm::vec3(ws_grid_cell_size_ / 2.0, 0.0, ws_grid_cell_size_ / 2.0);
-				glm::vec3 z_pos = ws_grid_lower_bound_ + glm::vec3(x, y, z) * ws_grid_cell_size_ + glm::vec3(ws_grid_cell_size_ / 2.0, ws_grid_cell_size_ / 2.0, 0.0);
-
-				glm::vec3 sample_vel = GetVelocityFrom3DGridCell(velocities, grid_dim, x, y, z);
-
-				glm::vec3 x_scale = glm::vec3(thickness, sample_vel.x, thickness);
-				glm::vec3 y_scale = glm::vec3(thickness, sample_vel.y, thickness);
-				glm::vec3 z_scale = glm::vec3(thickness, sample_vel.z, thickness);
-
-				glm::mat4 x_mat;
-				glm::mat4 y_mat;
-				glm::mat4 z_mat;
-
-				ConstructVectorAlignedModelMat(x_mat, x_scale, x_pos, glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1));
-				ConstructVectorAlignedModelMat(y_mat, y_scale, y_pos, glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
-				ConstructVectorAlignedModelMat(z_mat, z_scale, z_pos, glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0));
-
-				arrow_mats.push_back(x_mat);
-				arrow_mats.push_back(y_mat);
-				arrow_mats.push_back(z_mat);
-
-				arrow_colors.push_back(k_x_color);
-				arrow_colors.push_back(k_y_color);
-				arrow_colors.push_back(k_z_color);
+	unsigned int sample_dim = (grid_dim + stride - 1) / stride;
+	unsigned int count = sample_dim * sample_dim * sample_dim;
+	if (count == 0 || grid.size() < (size_t)grid_dim * grid_dim * grid_dim) {
+		return 0;
+	}
+	if (stride == 1) {
+		return stream.Write(grid.data(), count * sizeof(T)) ? count : 0;
+	}
+	T* dst = (T*)stream.BeginWrite(count * sizeof(T));
+	if (dst == nullptr) {
+		return 0;
+	}
+	for (unsigned int x = 0; x < grid_dim; x += stride) {
+		for (unsigned int y = 0; y < grid_dim; y += stride) {
+			for (unsigned int z = 0; z < grid_dim; z += stride) {
+				*dst++ = grid[(x * grid_dim + y) * grid_dim + z];
 			}
 		}
 	}
-	glBindVertexArray(VAO_grid_axis_arrows_);
-	// load data into vertex buffers
-	grid_axis_arrow_elements_ = arrow_mats.size();
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_axis_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_mats.size() * sizeof(glm::mat4), (void*)&arrow_mats[0]);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_axis_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_colors.size() * sizeof(glm::vec3), (void*)&arrow_colors[0]);
-
-	glBindVertexArray(0);
+	stream.EndWrite();
+	return count;
 }
 
-// TODO: remove prints
 void DebugRenderer::UpdateGridVelocities(const std::vector<glm::vec3>& velocities, const unsigned int grid_dim)
 {
-	std::vector<glm::mat4> arrow_mats;
-	std::vector<glm::vec3> arrow_colors;
-	const float thickness = 0.1f;
-	glm::vec3 k_arrow_color = glm::vec3(0.5, 0.7, 0.4);
-	for (int z = 0; z < grid_dim; z++) {
-		for (int y = 0; y < grid_dim; y++) {
-			for (int x = 0; x < grid_dim; x++) {
-				glm::vec3 pos = ws_grid_lower_bound_ + glm::vec3(x, y, z) * ws_grid_cell_size_ + glm::vec3(0.5, 0.5, 0.5) * ws_grid_cell_size_;
-
-				glm::vec3 vel = GetVelocityFrom3DGridCell(velocities, grid_dim, x, y, z);
-
-				//printf("Initial velocity at %d, %d, %d:\n", x, y, z);
-				//PrintVec3(vel);
-
-				glm::vec3 up = glm::normalize(vel);
-				glm::vec3 right = glm::cross(glm::vec3(1, 0, 0), vel);
-				glm::vec3 forward = glm::cross(right, vel);
-				right = glm::cross(vel, forward);
-
-				glm::vec3 scale = glm::vec3(thickness, glm::length(vel), thickness);
-
-				glm::mat4 mat;
-				//printf("   right:\n      ");
-				//PrintVec3(right);
-				//printf("   up:\n      ");
-				//PrintVec3(up);
-				//printf("   forward:\n      ");
-				//PrintVec3(forward);
-				ConstructVectorAlignedModelMat(mat, scale, pos, right, up, forward);
-				//printf("   final mat:\n");
-				//PrintMat4(mat);
-				
-				// ConstructVectorAlignedModelMat(mat, scale, pos, glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
-
-				arrow_mats.push_back(mat);
-
-				arrow_colors.push_back(k_arrow_color);
-			}
-		}
+	SetGridDimensions(grid_dim);
+	unsigned int count = WriteGridSamples(grid_velocities_stream_, velocities, grid_dim, grid_stride_);
+	if (count == 0) {
+		return;
 	}
-	glBindVertexArray(VAO_grid_arrows_);
-	// load data into vertex buffers
-	grid_arrow_elements_ = arrow_mats.size();
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_mats.size() * sizeof(glm::mat4), (void*)&arrow_mats[0]);
+	grid_arrow_elements_ = count;
+	grid_axis_arrow_elements_ = grid_arrow_elements_ * 3;
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_colors.size() * sizeof(glm::vec3), (void*)&arrow_colors[0]);
+	// The arrow shader finds the cell of each velocity from its index, so the
+	// sampling goes with the data in case it changes before the next upload
+	debug_arrow_shader_.SetUniform1ui("sample_dim", (grid_dim + grid_stride_ - 1) / grid_stride_);
+	debug_arrow_shader_.SetUniform1ui("sample_stride", grid_stride_);
 
+	glBindVertexArray(VAO_grid_arrows_);
+	grid_velocities_stream_.BindVertexBuffer(1, sizeof(glm::vec3));
+	glBindVertexArray(VAO_grid_axis_arrows_);
+	grid_velocities_stream_.BindVertexBuffer(1, sizeof(glm::vec3));
 	glBindVertexArray(0);
 }
 
 void DebugRenderer::UpdateGridCells(const unsigned int grid_dim)
 {
+	// One cube per sampled cell, covering the cells skipped after it
 	std::vector<glm::mat4> model_mats;
-	for (int x = 0; x < grid_dim; x++) {
-		for (int y = 0; y < grid_dim; y++) {
-			for (int z = 0; z < grid_dim; z++) {
-				glm::vec3 scale = glm::vec3(ws_grid_cell_size_);
+	for (int x = 0; x < grid_dim; x += grid_stride_) {
+		for (int y = 0; y < grid_dim; y += grid_stride_) {
+			for (int z = 0; z < grid_dim; z += grid_stride_) {
+				glm::vec3 span = glm::min(glm::vec3(grid_stride_), glm::vec3(grid_dim - x, grid_dim - y, grid_dim - z));
+				glm::vec3 scale = span * ws_grid_cell_size_;
 				glm::vec3 pos = glm::vec3(x, y, z) * ws_grid_cell_size_ + ws_grid_lower_bound_;
 				glm::mat4 mat;
 				ConstructAxisAlignedModelMat(mat, scale, pos);
@@ -254,31 +183,251 @@ void DebugRenderer::UpdateGridCells(const unsigned int grid_dim)
 		}
 	}
 
-	glBindVertexArray(VAO_grid_cell_);
-	// load data into vertex buffers
+	// Only changes with the grid boundaries, so uploaded once at its exact size
 	grid_cell_elements_ = model_mats.size();
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_cell_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_CELLS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, model_mats.size() * sizeof(glm::mat4), (void*)&model_mats[0]);
+	glBufferData(GL_ARRAY_BUFFER, model_mats.size() * sizeof(glm::mat4), model_mats.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
+void DebugRenderer::UpdateGridCellFloats(const std::vector<float>& floats, const unsigned int grid_dim)
+{
+	// The cubes are made in the order the simulation stores the cells (x * dim * dim + y * dim + z),
+	// so the values are sampled in that order too
+	SetGridDimensions(grid_dim);
+	unsigned int count = WriteGridSamples(grid_cell_values_stream_, floats, grid_dim, grid_stride_);
+	if (count == 0) {
+		return;
+	}
+	grid_cell_value_elements_ = count;
+	glBindVertexArray(VAO_grid_cell_);
+	grid_cell_values_stream_.BindVertexBuffer(1, sizeof(float));
 	glBindVertexArray(0);
 }
 
-void DebugRenderer::UpdateGridCellFloats(const std::vector<float>& floats, const unsigned int grid_dim)
+unsigned int DebugRenderer::GetAutomaticGridStride(const unsigned int grid_dim)
+{
+	unsigned int stride = 1;
+	while (true) {
+		unsigned int sample_dim = (grid_dim + stride - 1) / stride;
+		if (sample_dim * sample_dim * sample_dim <= MAX_DEBUG_GRID_SAMPLES) {
+			return stride;
+		}
+		++stride;
+	}
+}
+
+void DebugRenderer::SetGridDimensions(const unsigned int grid_dim)
+{
+	if (grid_dim == grid_dim_) {
+		return;
+	}
+	grid_dim_ = grid_dim;
+	UpdateGridStride(true);
+}
+
+void DebugRenderer::UpdateGridStride(bool force_rebuild)
+{
+	unsigned int stride = grid_sample_stride_ == 0 ? GetAutomaticGridStride(grid_dim_) : grid_sample_stride_;
+	stride = glm::clamp(stride, 1u, glm::max(grid_dim_, 1u));
+	if (stride == grid_stride_ && !force_rebuild) {
+		return;
+	}
+	grid_stride_ = stride;
+	UpdateGridLines();
+	UpdateGridCells(grid_dim_);
+	// The texture views sample the grid themselves
+	unsigned int sample_dim = (grid_dim_ + grid_stride_ - 1) / grid_stride_;
+	debug_arrow_texture_shader_.SetUniform1ui("sample_dim", sample_dim);
+	debug_arrow_texture_shader_.SetUniform1ui("sample_stride", grid_stride_);
+	debug_grid_cell_texture_shader_.SetUniform1ui("grid_dim", grid_dim_);
+	debug_grid_cell_texture_shader_.SetUniform1ui("sample_dim", sample_dim);
+	debug_grid_cell_texture_shader_.SetUniform1ui("sample_stride", grid_stride_);
+	// The cell values were sampled for the old cubes. Arrows carry their own sampling.
+	grid_cell_value_elements_ = 0;
+	InvalidateGridData();
+}
+
+void DebugRenderer::InvalidateGridData()
+{
+	uploaded_versions_[Simulation::GRID_VELOCITY_DATA] = k_stale_version_;
+	uploaded_versions_[Simulation::GRID_PRESSURE_DATA] = k_stale_version_;
+	uploaded_versions_[Simulation::GRID_DYE_DATA] = k_stale_version_;
+	uploaded_versions_[Simulation::GRID_FLUID_CELL_DATA] = k_stale_version_;
+}
+
+bool DebugRenderer::NeedsUpload(Simulation::DataField field)
+{
+	unsigned int version = simulation_->GetDataVersion(field);
+	if (version == uploaded_versions_[field]) {
+		return false;
+	}
+	uploaded_versions_[field] = version;
+	return true;
+}
+
+bool DebugRenderer::GetCellViewField(Simulation::DataField& field) const
+{
+	switch (active_cell_view_) {
+	case DYE:
+		field = Simulation::GRID_DYE_DATA;
+		return true;
+	case PRESSURE:
+		field = Simulation::GRID_PRESSURE_DATA;
+		return true;
+	case IS_FLUID:
+		field = Simulation::GRID_FLUID_CELL_DATA;
+		return true;
+	default:
+		return false;
+	}
+}
+
+std::vector<float>* DebugRenderer::ReadCellValues(Simulation::DataField field)
+{
+	std::vector<float>* values = nullptr;
+	switch (field) {
+	case Simulation::GRID_DYE_DATA:
+		values = simulation_->GetGridDyeDensities();
+		break;
+	case Simulation::GRID_PRESSURE_DATA:
+		values = simulation_->GetGridPressures();
+		break;
+	case Simulation::GRID_FLUID_CELL_DATA:
+		values = simulation_->GetGridFluidCells();
+		break;
+	default:
+		break;
+	}
+	missing_fields_[field] = values == nullptr;
+	return values;
+}
+
+void DebugRenderer::BindFieldTextures(Shader& shader, unsigned int texture_bits)
+{
+	GPU_Simulation::FieldTextures textures = gpu_simulation_->GetFieldTextures();
+	// Samplers of different types can't share a texture unit, so every one gets its own
+	const char* k_axes[3] = { "x", "y", "z" };
+	for (int c = 0; c < 3; c++) {
+		if (texture_bits & GRID_VELOCITY_TEXTURES) {
+			shader.SetUniformTexture3D(std::string("grid_vel_") + k_axes[c], *textures.grid_velocities[c], GL_TEXTURE0 + c);
+		}
+		if (texture_bits & PARTICLE_POSITION_TEXTURES) {
+			shader.SetUniformTexture2D(std::string("particle_pos_") + k_axes[c], *textures.particle_positions[c], GL_TEXTURE5 + c);
+		}
+		if (texture_bits & PARTICLE_VELOCITY_TEXTURES) {
+			shader.SetUniformTexture2D(std::string("particle_vel_") + k_axes[c], *textures.particle_velocities[c], GL_TEXTURE8 + c);
+		}
+	}
+	if (texture_bits & CELL_TEXTURES) {
+		shader.SetUniformTexture3D("grid_pressures", *textures.grid_pressures, GL_TEXTURE3);
+		shader.SetUniformTexture3D("grid_cell_types", *textures.grid_cell_types, GL_TEXTURE4);
+		shader.SetUniform1ui("fluid_cell_type", textures.fluid_cell_type);
+	}
+	else {
+		shader.SetUniform1fv("texture_precision", gpu_simulation_->GetTexturePrecision());
+	}
+}
+
+unsigned int DebugRenderer::GetGridSampleCount() const
+{
+	unsigned int sample_dim = (grid_dim_ + grid_stride_ - 1) / grid_stride_;
+	return sample_dim * sample_dim * sample_dim;
+}
+
+void DebugRenderer::RefreshView(DebugView view, bool enable_particles)
 {
-	std::vector<float> final_floats;
-	for (int x = 0; x < grid_dim; x++) {
-		for (int y = 0; y < grid_dim; y++) {
-			for (int z = 0; z < grid_dim; z++) {
-				final_floats.push_back(GetFloatValFrom3DGridCell(floats, grid_dim, x, y, z));
+	if (simulation_ == nullptr) {
+		return;
+	}
+	// Drawn straight from the textures. The volume maps its values by their range, so it is still read back.
+	if (gpu_simulation_ != nullptr && view != GRID_VOLUME) {
+		return;
+	}
+	switch (view) {
+	case GRID_VELOCITIES:
+	case GRID_AXIS_VELOCITIES:
+		if (NeedsUpload(Simulation::GRID_VELOCITY_DATA)) {
+			std::vector<glm::vec3>* velocities = simulation_->GetGridVelocities();
+			if (velocities != nullptr) {
+				SetGridVelocities(*velocities, simulation_->GetGridDimensions());
 			}
 		}
+		break;
+	case GRID_CELL: {
+		Simulation::DataField field;
+		if (!GetCellViewField(field)) {
+			break;
+		}
+		if (missing_fields_[field]) {
+			grid_cell_value_elements_ = 0;
+			break;
+		}
+		if (!NeedsUpload(field)) {
+			break;
+		}
+		// Only one of the cell fields is uploaded at a time
+		for (Simulation::DataField other : { Simulation::GRID_PRESSURE_DATA, Simulation::GRID_DYE_DATA, Simulation::GRID_FLUID_CELL_DATA }) {
+			if (other != field) {
+				uploaded_versions_[other] = k_stale_version_;
+			}
+		}
+		std::vector<float>* values = ReadCellValues(field);
+		if (values != nullptr) {
+			UpdateGridCellFloats(*values, simulation_->GetGridDimensions());
+		}
+		else {
+			grid_cell_value_elements_ = 0;
+		}
+		break;
+	}
+	case GRID_VOLUME: {
+		// Kept apart from the cell view, which uploads a sampled copy of the same field
+		Simulation::DataField field;
+		if (!GetCellViewField(field)) {
+			break;
+		}
+		if (missing_fields_[field]) {
+			has_volume_data_ = false;
+			break;
+		}
+		unsigned int version = simulation_->GetDataVersion(field);
+		if (field == volume_field_ && version == volume_version_) {
+			break;
+		}
+		volume_field_ = field;
+		volume_version_ = version;
+		std::vector<float>* values = ReadCellValues(field);
+		if (values != nullptr) {
+			SetGridVolume(*values, simulation_->GetGridDimensions());
+		}
+		else {
+			has_volume_data_ = false;
+		}
+		break;
+	}
+	case PARTICLES:
+	case PARTICLE_VELOCITIES:
+		if (!enable_particles) {
+			break;
+		}
+		// The arrows start at the particle positions
+		if (NeedsUpload(Simulation::PARTICLE_POSITION_DATA)) {
+			std::vector<glm::vec3>* positions = simulation_->GetParticlePositions();
+			if (positions != nullptr) {
+				SetParticlePositions(*positions);
+			}
+		}
+		if (view == PARTICLE_VELOCITIES && NeedsUpload(Simulation::PARTICLE_VELOCITY_DATA)) {
+			std::vector<glm::vec3>* velocities = simulation_->GetParticleVelocities();
+			if (velocities != nullptr) {
+				SetParticleVelocities(*velocities);
+			}
+		}
+		break;
+	default:
+		break;
 	}
-	glBindVertexArray(VAO_grid_cell_);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_cell_float_val_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_CELLS * sizeof(float), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, final_floats.size() * sizeof(float), (void*)&final_floats[0]);
-	glBindVertexArray(0);
 }
 
 void DebugRenderer::SetVariableDefaults()
@@ -286,9 +435,20 @@ void DebugRenderer::SetVariableDefaults()
 	ws_grid_lower_bound_ = glm::vec3(-1.0f, -1.0f, -1.0f);
 	ws_grid_upper_bound_ = glm::vec3(1.0f, 1.0f, 1.0f);
 	ws_grid_cell_size_ = 1.0f;
+	grid_dim_ = 0;
+	grid_sample_stride_ = 0;
+	grid_stride_ = 1;
 
 	active_cell_view_ = NONE;
 
+	simulation_ = nullptr;
+	for (unsigned int& version : uploaded_versions_) {
+		version = k_stale_version_;
+	}
+	for (bool& missing : missing_fields_) {
+		missing = false;
+	}
+
 	cached_view_ = glm::mat4(1.0f);
 	cached_proj_ = glm::mat4(1.0f);
 
@@ -305,27 +465,41 @@ void DebugRenderer::SetVariableDefaults()
 	VBO_line_color_ = 0;
 	grid_line_elements_ = 0;
 
-	// Grid arrows
+	// Arrows
 	grid_arrow_instance_num_ = 0; // Number of verts in the arrow instance
+	VBO_arrow_instance_ = 0;
+
+	// Grid arrows
 	VAO_grid_arrows_ = 0;
-	VBO_grid_arrow_instance_ = 0;
-	VBO_grid_arrow_mats_ = 0;
-	VBO_grid_arrow_colors_ = 0;
 	grid_arrow_elements_ = 0;
 
 	// Axis aligned grid arrows
 	VAO_grid_axis_arrows_ = 0;
-	VBO_grid_axis_arrow_instance_ = 0;
-	VBO_grid_axis_arrow_mats_ = 0;
-	VBO_grid_axis_arrow_colors_ = 0;
 	grid_axis_arrow_elements_ = 0;
 
+	// Particle arrows
+	VAO_particle_arrows_ = 0;
+	particle_arrow_elements_ = 0;
+
 	// Cell fluid visualization
 	VAO_grid_cell_ = 0;
 	VBO_grid_cell_instance_ = 0;
 	VBO_grid_cell_mats_ = 0;
-	VBO_grid_cell_float_val_ = 0;
 	grid_cell_elements_ = 0;
+	grid_cell_value_elements_ = 0;
+
+	// Cell volume
+	VAO_volume_ = 0;
+	VBO_volume_quad_ = 0;
+	has_volume_data_ = false;
+	volume_field_ = Simulation::NUM_DATA_FIELDS;
+	volume_version_ = k_stale_version_;
+
+	// Views from simulation textures
+	gpu_simulation_ = nullptr;
+	VAO_texture_arrows_ = 0;
+	VAO_texture_cells_ = 0;
+	VAO_texture_particles_ = 0;
 }
 
 void DebugRenderer::SetupOriginBuffers() {
@@ -392,12 +566,12 @@ void DebugRenderer::SetupGridLineBuffers() {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_line_color_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_LINES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_SAMPLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_line_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_LINES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_SAMPLES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
 
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
@@ -417,90 +591,49 @@ void DebugRenderer::SetupGridLineBuffers() {
 	glBindVertexArray(0);
 }
 
-void DebugRenderer::SetupGridVelocityBuffers() 
+// Sets up the format of a streamed attribute. Its buffer is bound with
+// StreamingBuffer::BindVertexBuffer() after every write, at binding point = location.
+static void SetupStreamedAttrib(GLuint location, GLint size, GLuint divisor)
 {
-	// Setup for the arrows
-	glGenVertexArrays(1, &VAO_grid_arrows_);
-	glGenBuffers(1, &VBO_grid_arrow_instance_);
-	glGenBuffers(1, &VBO_grid_arrow_colors_);
-	glGenBuffers(1, &VBO_grid_arrow_mats_);
-
+	glEnableVertexAttribArray(location);
+	glVertexAttribFormat(location, size, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribBinding(location, location);
+	glVertexBindingDivisor(location, divisor);
+}
 
-	std::vector<glm::vec3> instance_arrow_verts;
-	MakeInstanceArrow(instance_arrow_verts);
+void DebugRenderer::SetupArrowVAO(GLuint& vao, GLuint vector_divisor, bool has_origins)
+{
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
 
-	glBindVertexArray(VAO_grid_arrows_);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_arrow_instance_);
-	glBufferData(GL_ARRAY_BUFFER, instance_arrow_verts.size() * sizeof(glm::vec3), &instance_arrow_verts[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_arrow_instance_);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glVertexAttribDivisor(0, 0); // Reuse on each instance
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	SetupStreamedAttrib(1, 3, vector_divisor);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(5);
-	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-	glVertexAttribDivisor(0, 0); // Reuse on each instance
-	glVertexAttribDivisor(1, 1); // Unique to each instance
-	glVertexAttribDivisor(2, 1); // Unique ...
-	glVertexAttribDivisor(3, 1);
-	glVertexAttribDivisor(4, 1);
-	glVertexAttribDivisor(5, 1);
+	// Grid arrows find their origin from the instance index instead
+	if (has_origins) {
+		SetupStreamedAttrib(2, 3, 1);
+	}
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void DebugRenderer::SetupGridAxisVelocityBuffers()
+void DebugRenderer::SetupGridVelocityBuffers() 
 {
-	// Setup for the arrows
-	glGenVertexArrays(1, &VAO_grid_axis_arrows_);
-	glGenBuffers(1, &VBO_grid_axis_arrow_instance_);
-	glGenBuffers(1, &VBO_grid_axis_arrow_colors_);
-	glGenBuffers(1, &VBO_grid_axis_arrow_mats_);
-
-
+	// The arrow model is shared by every arrow view
 	std::vector<glm::vec3> instance_arrow_verts;
 	MakeInstanceArrow(instance_arrow_verts);
 
-	glBindVertexArray(VAO_grid_axis_arrows_);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_axis_arrow_instance_);
+	glGenBuffers(1, &VBO_arrow_instance_);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_arrow_instance_);
 	glBufferData(GL_ARRAY_BUFFER, instance_arrow_verts.size() * sizeof(glm::vec3), &instance_arrow_verts[0], GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_axis_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_axis_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(5);
-	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-	glVertexAttribDivisor(0, 0); // Reuse on each instance
-	glVertexAttribDivisor(1, 1); // Unique to each instance
-	glVertexAttribDivisor(2, 1); // Unique ...
-	glVertexAttribDivisor(3, 1);
-	glVertexAttribDivisor(4, 1);
-	glVertexAttribDivisor(5, 1);
-	glBindVertexArray(0);
+	SetupArrowVAO(VAO_grid_arrows_, 1, false);
+	// Three arrows (x, y, z) per velocity
+	SetupArrowVAO(VAO_grid_axis_arrows_, 3, false);
 }
 
 void DebugRenderer::SetupGridCellBuffers()
@@ -508,7 +641,6 @@ void DebugRenderer::SetupGridCellBuffers()
 	// Setup for the arrows
 	glGenVertexArrays(1, &VAO_grid_cell_);
 	glGenBuffers(1, &VBO_grid_cell_instance_);
-	glGenBuffers(1, &VBO_grid_cell_float_val_);
 	glGenBuffers(1, &VBO_grid_cell_mats_);
 
 	glBindVertexArray(VAO_grid_cell_);
@@ -517,13 +649,10 @@ void DebugRenderer::SetupGridCellBuffers()
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_cell_float_val_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_CELLS * sizeof(float), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	SetupStreamedAttrib(1, 1, 1);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_grid_cell_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_CELLS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_SAMPLES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
 	glEnableVertexAttribArray(3);
@@ -534,23 +663,54 @@ void DebugRenderer::SetupGridCellBuffers()
 	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
 
 	glVertexAttribDivisor(0, 0); // Reuse on each instance
-	glVertexAttribDivisor(1, 1); // Unique to each instance
-	glVertexAttribDivisor(2, 1); // Unique ...
+	glVertexAttribDivisor(2, 1); // Unique to each instance
 	glVertexAttribDivisor(3, 1);
 	glVertexAttribDivisor(4, 1);
 	glVertexAttribDivisor(5, 1);
 	glBindVertexArray(0);
 }
 
+void DebugRenderer::SetupVolumeBuffers()
+{
+	// A quad over the whole screen, the rays are found in "debug/volume_raymarch.frag"
+	glGenVertexArrays(1, &VAO_volume_);
+	glGenBuffers(1, &VBO_volume_quad_);
+
+	glBindVertexArray(VAO_volume_);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_volume_quad_);
+	glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec3), &k_square_verts[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindVertexArray(0);
+}
+
+void DebugRenderer::SetupMeshVAO(GLuint& vao, GLuint mesh_vbo)
+{
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DebugRenderer::SetupTextureViewBuffers()
+{
+	// Reuse the meshes of the other views, everything else comes from the textures
+	SetupMeshVAO(VAO_texture_arrows_, VBO_arrow_instance_);
+	SetupMeshVAO(VAO_texture_cells_, VBO_grid_cell_instance_);
+	SetupMeshVAO(VAO_texture_particles_, VBO_particle_sprite_instance_);
+}
+
 void DebugRenderer::SetupParticleSpriteBuffers()
 {
 	particle_sprite_elements_ = 0;
 	debug_particle_shader_.SetUniform1fv("particle_radius", 0.05f);
+	debug_particle_texture_shader_.SetUniform1fv("particle_radius", 0.05f);
 
 	glGenVertexArrays(1, &VAO_particle_sprite_);
 	glGenBuffers(1, &VBO_particle_sprite_instance_);
-	glGenBuffers(1, &VBO_particle_sprite_pos_);
-	glGenBuffers(1, &VBO_particle_sprite_color_);
 
 	glBindVertexArray(VAO_particle_sprite_);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_sprite_instance_);
@@ -558,80 +718,30 @@ void DebugRenderer::SetupParticleSpriteBuffers()
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_sprite_pos_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	std::vector<glm::vec3> particle_colors;
-	for (int i = 0; i < MAX_DEBUG_PARTICLES; i++) {
-		particle_colors.push_back(glm::vec3(
-			((float)(rand() % 100) / 100.0f), 
-			((float)(rand() % 100) / 100.0f), 
-			((float)(rand() % 100) / 100.0f))
-		);
-	}
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_sprite_color_);
-	glBufferData(GL_ARRAY_BUFFER, particle_colors.size() * sizeof(glm::vec3), &particle_colors[0], GL_STATIC_DRAW);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	SetupStreamedAttrib(1, 3, 1);
 
+	// The colors are hashed from the instance index in "debug/particle.vert", so any number of particles can be drawn
 	glVertexAttribDivisor(0, 0); // Reuse on each instance
-	glVertexAttribDivisor(1, 1); // Unique to each instance
-	glVertexAttribDivisor(2, 1); // Unique ...
 	glBindVertexArray(0);
 }
 
 void DebugRenderer::SetupParticleVelocityBuffers()
 {
-	// Setup for the arrows
-	glGenVertexArrays(1, &VAO_particle_arrows_);
-	glGenBuffers(1, &VBO_particle_arrow_instance_);
-	glGenBuffers(1, &VBO_particle_arrow_colors_);
-	glGenBuffers(1, &VBO_particle_arrow_mats_);
-
-	std::vector<glm::vec3> instance_arrow_verts;
-	MakeInstanceArrow(instance_arrow_verts);
-
-	glBindVertexArray(VAO_particle_arrows_);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_arrow_instance_);
-	glBufferData(GL_ARRAY_BUFFER, instance_arrow_verts.size() * sizeof(glm::vec3), &instance_arrow_verts[0], GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_AXIS_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-	glEnableVertexAttribArray(5);
-	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-	glVertexAttribDivisor(0, 0); // Reuse on each instance
-	glVertexAttribDivisor(1, 1); // Unique to each instance
-	glVertexAttribDivisor(2, 1); // Unique ...
-	glVertexAttribDivisor(3, 1);
-	glVertexAttribDivisor(4, 1);
-	glVertexAttribDivisor(5, 1);
-
-	glBindVertexArray(0);
+	SetupArrowVAO(VAO_particle_arrows_, 1, true);
 }
 
 DebugRenderer::DebugRenderer() :
+	frame_time_display_("0.0 ms/frame"),
+	profiler_(nullptr),
 	debug_instance_shader_("debug/simple_instance.vert", "debug/simple_instance.frag"),
+	debug_arrow_shader_("debug/arrow_instance.vert", "debug/simple_instance.frag"),
 	debug_grid_cell_shader_("debug/cell_visualization.vert", "debug/cell_visualization.frag"),
-	debug_particle_shader_("debug/particle.vert", "debug/particle.frag"),
-	frame_time_display_("0.0 ms/frame")
+	debug_volume_shader_("screen_quad.vert", "debug/volume_raymarch.frag"),
+	volume_texture_(glm::ivec3(1), StorageType::TEX_FLOAT, ChannelType::R32F),
+	debug_arrow_texture_shader_("debug/arrow_instance.vert", "debug/simple_instance.frag", { { "SIM_TEXTURES", "1" } }),
+	debug_grid_cell_texture_shader_("debug/cell_visualization.vert", "debug/cell_visualization.frag", { { "SIM_TEXTURES", "1" } }),
+	debug_particle_texture_shader_("debug/particle.vert", "debug/particle.frag", { { "SIM_TEXTURES", "1" } }),
+	debug_particle_shader_("debug/particle.vert", "debug/particle.frag")
 {
 	//printf("Enter\n");
 	SetVariableDefaults();
@@ -642,13 +752,15 @@ DebugRenderer::DebugRenderer() :
 	//printf("Grid Lines Done\n");
 	SetupGridVelocityBuffers();
 	//printf("Grid Velocity Done\n");
-	SetupGridAxisVelocityBuffers();
-	//printf("Grid Axis Done\n");
 	SetupGridCellBuffers();
 	//printf("Grid Cells Done\n");
 	SetupParticleSpriteBuffers();
 	//printf("Grid Sprites Done\n");
 	SetupParticleVelocityBuffers();
+	SetupVolumeBuffers();
+	SetupTextureViewBuffers();
+	// Every simulation has fluid cells
+	SetDebugCellView(IS_FLUID);
 
 	//ToggleDebugView(GRID_VELOCITIES);
 	ToggleDebugView(FRAME_TIME);
@@ -661,20 +773,37 @@ DebugRenderer::~DebugRenderer()
 	glDeleteBuffers(1, &VBO_line_mats_);
 	glDeleteBuffers(1, &VBO_line_color_);
 
-	glDeleteBuffers(1, &VAO_grid_arrows_);
-	glDeleteBuffers(1, &VBO_grid_arrow_instance_);
-	glDeleteBuffers(1, &VBO_grid_arrow_mats_);
-	glDeleteBuffers(1, &VBO_grid_arrow_colors_);
-
-	glDeleteBuffers(1, &VAO_grid_axis_arrows_);
-	glDeleteBuffers(1, &VBO_grid_axis_arrow_instance_);
-	glDeleteBuffers(1, &VBO_grid_axis_arrow_mats_);
-	glDeleteBuffers(1, &VBO_grid_axis_arrow_colors_);
+	glDeleteVertexArrays(1, &VAO_grid_arrows_);
+	glDeleteVertexArrays(1, &VAO_grid_axis_arrows_);
+	glDeleteVertexArrays(1, &VAO_particle_arrows_);
+	glDeleteBuffers(1, &VBO_arrow_instance_);
 
 	glDeleteBuffers(1, &VAO_particle_sprite_);
 	glDeleteBuffers(1, &VBO_particle_sprite_instance_);
-	glDeleteBuffers(1, &VBO_particle_sprite_pos_);
-	glDeleteBuffers(1, &VBO_particle_sprite_color_);
+
+	glDeleteVertexArrays(1, &VAO_volume_);
+	glDeleteBuffers(1, &VBO_volume_quad_);
+
+	glDeleteVertexArrays(1, &VAO_texture_arrows_);
+	glDeleteVertexArrays(1, &VAO_texture_cells_);
+	glDeleteVertexArrays(1, &VAO_texture_particles_);
+
+	for (DisplayText* line : profile_display_) {
+		delete line;
+	}
+}
+
+void DebugRenderer::SetSimulation(Simulation* simulation)
+{
+	simulation_ = simulation;
+	gpu_simulation_ = dynamic_cast<GPU_Simulation*>(simulation);
+	for (unsigned int& version : uploaded_versions_) {
+		version = k_stale_version_;
+	}
+	for (bool& missing : missing_fields_) {
+		missing = false;
+	}
+	volume_version_ = k_stale_version_;
 }
 
 void DebugRenderer::SetGridBoundaries(const glm::vec3& low_bound, const glm::vec3& high_bound, const float interval)
@@ -682,22 +811,28 @@ void DebugRenderer::SetGridBoundaries(const glm::vec3& low_bound, const glm::vec
 	ws_grid_lower_bound_ = low_bound;
 	ws_grid_upper_bound_ = high_bound;
 	ws_grid_cell_size_ = interval;
-	UpdateGridLines();
-	UpdateGridCells((high_bound.x - low_bound.x) / interval);
+	debug_arrow_shader_.SetUniform3fv("ws_grid_lower_bound", ws_grid_lower_bound_);
+	debug_arrow_shader_.SetUniform1fv("ws_grid_cell_size", ws_grid_cell_size_);
+	debug_volume_shader_.SetUniform3fv("ws_grid_lower_bound", ws_grid_lower_bound_);
+	debug_volume_shader_.SetUniform3fv("ws_grid_upper_bound", ws_grid_upper_bound_);
+	debug_volume_shader_.SetUniform1fv("ws_grid_cell_size", ws_grid_cell_size_);
+	debug_arrow_texture_shader_.SetUniform3fv("ws_grid_lower_bound", ws_grid_lower_bound_);
+	debug_arrow_texture_shader_.SetUniform1fv("ws_grid_cell_size", ws_grid_cell_size_);
+	debug_grid_cell_texture_shader_.SetUniform3fv("ws_grid_lower_bound", ws_grid_lower_bound_);
+	debug_grid_cell_texture_shader_.SetUniform1fv("ws_grid_cell_size", ws_grid_cell_size_);
+	grid_dim_ = 0;
+	SetGridDimensions((high_bound.x - low_bound.x) / interval);
 }
 
 void DebugRenderer::SetGridVelocities(const std::vector<glm::vec3>& grid_velocities, const unsigned int grid_dimensions)
 {
 	UpdateGridVelocities(grid_velocities, grid_dimensions);
-	UpdateGridAxisVelocities(grid_velocities, grid_dimensions);
 }
 
 void DebugRenderer::SetGridPressures(const std::vector<float>& grid_pressures, const unsigned int grid_dim)
 {
 	if (active_cell_view_ != PRESSURE) {
-		active_cell_view_ = PRESSURE;
-		debug_grid_cell_shader_.SetUniform3fv("empty_color", glm::vec3(0.2, 0.2, 0.9));
-		debug_grid_cell_shader_.SetUniform3fv("full_color", glm::vec3(0.9, 0.25, 0.1));
+		SetDebugCellView(PRESSURE);
 	}
 	UpdateGridCellFloats(grid_pressures, grid_dim);
 }
@@ -705,9 +840,7 @@ void DebugRenderer::SetGridPressures(const std::vector<float>& grid_pressures, c
 void DebugRenderer::SetGridDyeDensities(const std::vector<float>& grid_dyes, const unsigned int grid_dim)
 {
 	if (active_cell_view_ != DYE) {
-		active_cell_view_ = DYE;
-		debug_grid_cell_shader_.SetUniform3fv("empty_color", glm::vec3(0.0, 0.2, 0.9));
-		debug_grid_cell_shader_.SetUniform3fv("full_color", glm::vec3(0.0, 0.25, 0.1));
+		SetDebugCellView(DYE);
 	}
 	UpdateGridCellFloats(grid_dyes, grid_dim);
 }
@@ -715,63 +848,64 @@ void DebugRenderer::SetGridDyeDensities(const std::vector<float>& grid_dyes, con
 void DebugRenderer::SetGridFluidCells(const std::vector<float>& grid_fluid, const unsigned int grid_dim)
 {
 	if (active_cell_view_ != IS_FLUID) {
-		active_cell_view_ = IS_FLUID;
-		debug_grid_cell_shader_.SetUniform3fv("empty_color", glm::vec3(0.4, 0.4, 0.4));
-		debug_grid_cell_shader_.SetUniform3fv("full_color", glm::vec3(0.3, 0.3, 0.9));
+		SetDebugCellView(IS_FLUID);
 	}
 	UpdateGridCellFloats(grid_fluid, grid_dim);
 }
 
+void DebugRenderer::SetGridVolume(const std::vector<float>& values, const unsigned int grid_dim)
+{
+	unsigned int num_cells = grid_dim * grid_dim * grid_dim;
+	if (num_cells == 0 || values.size() < num_cells) {
+		return;
+	}
+	std::pair<std::vector<float>::const_iterator, std::vector<float>::const_iterator> range =
+		std::minmax_element(values.begin(), values.begin() + num_cells);
+	debug_volume_shader_.SetUniform1fv("value_min", *range.first);
+	debug_volume_shader_.SetUniform1fv("value_max", *range.second);
+
+	// Uploaded in the order the simulation stores the cells, so the texture is
+	// indexed (z, y, x) and the shader swizzles
+	GLuint previous_texture = volume_texture_.GetTextureId();
+	volume_texture_.SetNewData(glm::ivec3(grid_dim), values.data());
+	if (volume_texture_.GetTextureId() != previous_texture) {
+		// Filtered between the cells, which keeps the volume smooth when close up
+		glBindTexture(GL_TEXTURE_3D, volume_texture_.GetTextureId());
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_3D, 0);
+	}
+	has_volume_data_ = true;
+}
+
 void DebugRenderer::SetParticlePositions(const std::vector<glm::vec3>& particle_pos)
 {
-	glBindVertexArray(VAO_particle_sprite_);
-	// load data into vertex buffers
+	// Copied straight from the simulation into the mapped stream
+	if (particle_pos.empty() || !particle_positions_stream_.Write(particle_pos.data(), particle_pos.size() * sizeof(glm::vec3))) {
+		return;
+	}
 	particle_sprite_elements_ = particle_pos.size();
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_sprite_pos_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, particle_pos.size() * sizeof(glm::vec3), (void*)&particle_pos[0]);
 
+	// Both the sprites and the velocity arrows are placed by the positions
+	glBindVertexArray(VAO_particle_sprite_);
+	particle_positions_stream_.BindVertexBuffer(1, sizeof(glm::vec3));
+	glBindVertexArray(VAO_particle_arrows_);
+	particle_positions_stream_.BindVertexBuffer(2, sizeof(glm::vec3));
 	glBindVertexArray(0);
 }
 
-// TODO
-void DebugRenderer::SetParticleVelocities(const std::vector<glm::vec3>& particle_pos, const std::vector<glm::vec3>& particle_vel)
+void DebugRenderer::SetParticleVelocities(const std::vector<glm::vec3>& particle_vel)
 {
-	std::vector<glm::mat4> arrow_mats;
-	std::vector<glm::vec3> arrow_colors;
-	const float thickness = 0.01f;
-	glm::vec3 k_arrow_color = glm::vec3(0.4, 0.5, 0.7);
-
-	for (int i = 0; i < particle_vel.size(); ++i) {
-		glm::vec3 pos = particle_pos[i];
-		glm::vec3 vel = particle_vel[i];
-
-		glm::vec3 up = glm::normalize(vel);
-		glm::vec3 right = glm::cross(glm::vec3(1, 0, 0), vel);
-		glm::vec3 forward = glm::cross(right, vel);
-		right = glm::cross(vel, forward);
-
-		glm::vec3 scale = glm::vec3(thickness, glm::length(vel), thickness);
-
-		glm::mat4 mat;
-		ConstructVectorAlignedModelMat(mat, scale, pos, right, up, forward);
-
-		arrow_mats.push_back(mat);
-
-		arrow_colors.push_back(k_arrow_color);
+	if (particle_vel.empty() || !particle_velocities_stream_.Write(particle_vel.data(), particle_vel.size() * sizeof(glm::vec3))) {
+		return;
 	}
+	particle_arrow_elements_ = particle_vel.size();
 
 	glBindVertexArray(VAO_particle_arrows_);
-	// load data into vertex buffers
-	// particle_sprite_elements_ = arrow_mats.size(); // TODO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_arrow_mats_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_mats.size() * sizeof(glm::mat4), (void*)&arrow_mats[0]);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_arrow_colors_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_DEBUG_GRID_ARROWS * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, arrow_colors.size() * sizeof(glm::vec3), (void*)&arrow_colors[0]);
-
+	particle_velocities_stream_.BindVertexBuffer(1, sizeof(glm::vec3));
 	glBindVertexArray(0);
 }
 
@@ -780,10 +914,18 @@ bool DebugRenderer::SetView(const glm::mat4& view)
 	cached_view_ = view;
 	// Update the uniforms for shaders
 	debug_instance_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_arrow_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
 	debug_grid_cell_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
 	debug_particle_shader_.SetUniform3fv("ws_camera_right", { view[0][0], view[1][0], view[2][0] });
 	debug_particle_shader_.SetUniform3fv("ws_camera_up", { view[0][1], view[1][1], view[2][1] });
+	debug_particle_texture_shader_.SetUniform3fv("ws_camera_right", { view[0][0], view[1][0], view[2][0] });
+	debug_particle_texture_shader_.SetUniform3fv("ws_camera_up", { view[0][1], view[1][1], view[2][1] });
 	debug_particle_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_arrow_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_grid_cell_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_particle_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_volume_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_volume_shader_.SetUniformMatrix4fv("inv_proj_view", glm::inverse(cached_proj_ * cached_view_));
 
 	return true;
 }
@@ -793,8 +935,14 @@ bool DebugRenderer::SetProjection(const glm::mat4& proj)
 	cached_proj_ = proj;
 	// Update the uniforms for shaders
 	debug_instance_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_arrow_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
 	debug_grid_cell_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
 	debug_particle_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_arrow_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_grid_cell_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_particle_texture_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_volume_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	debug_volume_shader_.SetUniformMatrix4fv("inv_proj_view", glm::inverse(cached_proj_ * cached_view_));
 
 	return true;
 }
@@ -816,6 +964,31 @@ bool DebugRenderer::IsDebugViewActive(DebugView view)
 void DebugRenderer::SetDebugCellView(GridCellView view)
 {
 	active_cell_view_ = view;
+
+	glm::vec3 empty_color;
+	glm::vec3 full_color;
+	switch (view) {
+	case DYE:
+		empty_color = glm::vec3(0.0, 0.2, 0.9);
+		full_color = glm::vec3(0.0, 0.25, 0.1);
+		break;
+	case PRESSURE:
+		empty_color = glm::vec3(0.2, 0.2, 0.9);
+		full_color = glm::vec3(0.9, 0.25, 0.1);
+		break;
+	case IS_FLUID:
+		empty_color = glm::vec3(0.4, 0.4, 0.4);
+		full_color = glm::vec3(0.3, 0.3, 0.9);
+		break;
+	default:
+		return;
+	}
+	debug_grid_cell_shader_.SetUniform3fv("empty_color", empty_color);
+	debug_grid_cell_shader_.SetUniform3fv("full_color", full_color);
+	debug_grid_cell_texture_shader_.SetUniform3fv("empty_color", empty_color);
+	debug_grid_cell_texture_shader_.SetUniform3fv("full_color", full_color);
+	debug_volume_shader_.SetUniform3fv("empty_color", empty_color);
+	debug_volume_shader_.SetUniform3fv("full_color", full_color);
 }
 
 bool DebugRenderer::IsCellViewActive(GridCellView view)
@@ -823,6 +996,17 @@ bool DebugRenderer::IsCellViewActive(GridCellView view)
 	return active_cell_view_ == view;
 }
 
+void DebugRenderer::SetGridSampleStride(unsigned int stride)
+{
+	grid_sample_stride_ = stride;
+	UpdateGridStride(false);
+}
+
+unsigned int DebugRenderer::GetGridSampleStride() const
+{
+	return grid_stride_;
+}
+
 DebugRenderer::GridCellView DebugRenderer::GetCellViewActive()
 {
 	return active_cell_view_;
@@ -830,7 +1014,17 @@ DebugRenderer::GridCellView DebugRenderer::GetCellViewActive()
 
 bool DebugRenderer::Draw(bool enable_particles)
 {
+	// The views of a GPU_Simulation draw from its textures, see SetSimulation()
+	bool from_textures = gpu_simulation_ != nullptr;
+	Shader& arrow_shader = from_textures ? debug_arrow_texture_shader_ : debug_arrow_shader_;
+	int num_texture_particles = 0;
+	if (from_textures) {
+		glm::ivec2 particle_dim = gpu_simulation_->GetTexParticlePositions_X()->GetDimensions();
+		num_texture_particles = particle_dim.x * particle_dim.y;
+	}
+
 	for (auto& view : active_views_) {
+		RefreshView(view, enable_particles);
 		switch (view) {
 		case ORIGIN:
 			debug_instance_shader_.SetActive();
@@ -846,42 +1040,111 @@ bool DebugRenderer::Draw(bool enable_particles)
 			glBindVertexArray(0);
 			break;
 		case GRID_AXIS_VELOCITIES:
-			debug_instance_shader_.SetActive();
-			glBindVertexArray(VAO_grid_axis_arrows_);
-			glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, grid_axis_arrow_elements_);
+			arrow_shader.SetUniform1ui("arrow_source", ARROWS_FROM_GRID_AXIS);
+			arrow_shader.SetUniform1fv("arrow_thickness", 0.01f);
+			arrow_shader.SetActive();
+			if (from_textures) {
+				BindFieldTextures(arrow_shader, GRID_VELOCITY_TEXTURES | PARTICLE_POSITION_TEXTURES | PARTICLE_VELOCITY_TEXTURES);
+				glBindVertexArray(VAO_texture_arrows_);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, GetGridSampleCount() * 3);
+			}
+			else {
+				glBindVertexArray(VAO_grid_axis_arrows_);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, grid_axis_arrow_elements_);
+			}
 			glBindVertexArray(0);
 			break;
 		case GRID_VELOCITIES:
-			debug_instance_shader_.SetActive();
-			glBindVertexArray(VAO_grid_arrows_);
-			glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, grid_arrow_elements_);
+			arrow_shader.SetUniform1ui("arrow_source", ARROWS_FROM_GRID);
+			arrow_shader.SetUniform1fv("arrow_thickness", 0.02f);
+			arrow_shader.SetUniform3fv("arrow_color", glm::vec3(0.5, 0.7, 0.4));
+			arrow_shader.SetActive();
+			if (from_textures) {
+				BindFieldTextures(arrow_shader, GRID_VELOCITY_TEXTURES | PARTICLE_POSITION_TEXTURES | PARTICLE_VELOCITY_TEXTURES);
+				glBindVertexArray(VAO_texture_arrows_);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, GetGridSampleCount());
+			}
+			else {
+				glBindVertexArray(VAO_grid_arrows_);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, grid_arrow_elements_);
+			}
 			glBindVertexArray(0);
 			break;
 		case GRID_CELL:
-			debug_grid_cell_shader_.SetActive();
-			glBindVertexArray(VAO_grid_cell_);
-			glDrawArraysInstanced(GL_TRIANGLES, 0, 36, grid_cell_elements_);
+			if (from_textures) {
+				// The GPU simulation has no dye
+				if (active_cell_view_ == PRESSURE || active_cell_view_ == IS_FLUID) {
+					debug_grid_cell_texture_shader_.SetUniform1ui("cell_source", active_cell_view_ == PRESSURE ? 0 : 1);
+					debug_grid_cell_texture_shader_.SetActive();
+					BindFieldTextures(debug_grid_cell_texture_shader_, CELL_TEXTURES);
+					glBindVertexArray(VAO_texture_cells_);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 36, grid_cell_elements_);
+				}
+			}
+			else {
+				debug_grid_cell_shader_.SetActive();
+				glBindVertexArray(VAO_grid_cell_);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, 36, glm::min(grid_cell_elements_, grid_cell_value_elements_));
+			}
 			glBindVertexArray(0);
 			break;
 		case PARTICLES:
 			if (enable_particles) {
-				debug_particle_shader_.SetActive();
-				glBindVertexArray(VAO_particle_sprite_);
-				glDrawArraysInstanced(GL_TRIANGLES, 0, 6, particle_sprite_elements_);
+				if (from_textures) {
+					debug_particle_texture_shader_.SetActive();
+					BindFieldTextures(debug_particle_texture_shader_, PARTICLE_POSITION_TEXTURES);
+					glBindVertexArray(VAO_texture_particles_);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 6, num_texture_particles);
+				}
+				else {
+					debug_particle_shader_.SetActive();
+					glBindVertexArray(VAO_particle_sprite_);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 6, particle_sprite_elements_);
+				}
 				glBindVertexArray(0);
 			}
 			break;
 		case PARTICLE_VELOCITIES:
 			if (enable_particles) {
-				debug_instance_shader_.SetActive();
-				glBindVertexArray(VAO_particle_arrows_);
-				glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, particle_sprite_elements_);
+				arrow_shader.SetUniform1ui("arrow_source", ARROWS_FROM_PARTICLES);
+				arrow_shader.SetUniform1fv("arrow_thickness", 0.01f);
+				arrow_shader.SetUniform3fv("arrow_color", glm::vec3(0.4, 0.5, 0.7));
+				arrow_shader.SetActive();
+				if (from_textures) {
+					BindFieldTextures(arrow_shader, GRID_VELOCITY_TEXTURES | PARTICLE_POSITION_TEXTURES | PARTICLE_VELOCITY_TEXTURES);
+					glBindVertexArray(VAO_texture_arrows_);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, num_texture_particles);
+				}
+				else {
+					glBindVertexArray(VAO_particle_arrows_);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, grid_arrow_instance_num_, glm::min(particle_arrow_elements_, particle_sprite_elements_));
+				}
 				glBindVertexArray(0);
 			}
 			break;
+		case GRID_VOLUME:
+			if (has_volume_data_ && active_cell_view_ != NONE) {
+				debug_volume_shader_.SetUniformTexture3D("volume", volume_texture_, GL_TEXTURE0);
+				debug_volume_shader_.SetActive();
+				// Blended over the scene (premultiplied), but the depth is only tested
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+				glDepthMask(GL_FALSE);
+				glBindVertexArray(VAO_volume_);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+				glBindVertexArray(0);
+				glDepthMask(GL_TRUE);
+				glDisable(GL_BLEND);
+			}
+			break;
 		case FRAME_TIME:
 			frame_time_display_.Draw();
 			break;
+		case GPU_PROFILE:
+			for (DisplayText* line : profile_display_) {
+				line->Draw();
+			}
+			break;
 		}
 	}
 
@@ -892,6 +1155,41 @@ void DebugRenderer::UpdateFrameTime(float frame_time) {
 	frame_time_display_.SetText(std::to_string(frame_time) + " ms/frame");
 }
 
+void DebugRenderer::SetProfiler(GPUProfiler* profiler) {
+	profiler_ = profiler;
+}
+
+void DebugRenderer::UpdateProfileDisplay() {
+	if (profiler_ == nullptr) {
+		return;
+	}
+	const float k_line_scale = 0.05f;
+	std::vector<GPUProfiler::Result> results = profiler_->GetResults();
+
+	std::vector<std::string> lines;
+	lines.push_back(profiler_->IsEnabled() ? "GPU ms (avg / last)" : "GPU profiling unavailable");
+	for (const GPUProfiler::Result& result : results) {
+		char line[64];
+		snprintf(line, sizeof(line), "%-26.26s %6.2f %6.2f", result.name.c_str(), result.average_ms, result.last_ms);
+		lines.push_back(line);
+	}
+
+	// Lines go down from the top left corner
+	while (profile_display_.size() < lines.size()) {
+		DisplayText* text = new DisplayText(lines[profile_display_.size()]);
+		text->SetScale(k_line_scale);
+		text->SetPosition(glm::vec2(-1.0f, 1.0f - k_line_scale * profile_display_.size()));
+		profile_display_.push_back(text);
+	}
+	while (profile_display_.size() > lines.size()) {
+		delete profile_display_.back();
+		profile_display_.pop_back();
+	}
+	for (unsigned int i = 0; i < lines.size(); i++) {
+		profile_display_[i]->SetText(lines[i]);
+	}
+}
+
 // TODO: change method name
 void DebugRenderer::ResetActiveViews() {
 	active_views_.clear();
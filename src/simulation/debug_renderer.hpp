@@ -7,13 +7,15 @@
 #include "../rendering/shader.hpp"
 #include "../rendering/texture.hpp"
 #include "../rendering/display_text.hpp"
+#include "../rendering/gpu_profiler.hpp"
+#include "../rendering/streaming_buffer.hpp"
 #include "../simulation/water_particle_renderer.hpp"
+#include "../simulation/sequential_simulation.hpp"
+#include "../simulation/gpu_simulation.hpp"
 
-#define MAX_DEBUG_GRID_ARROWS 4096
-#define MAX_DEBUG_AXIS_GRID_ARROWS 4096
-#define MAX_DEBUG_GRID_LINES 4096
-#define MAX_DEBUG_GRID_CELLS 1024
-#define MAX_DEBUG_PARTICLES (512 * 512)
+// Grid views sample every n-th cell along each axis so no more than this many
+// cells are drawn, which keeps their cost the same at any grid size
+#define MAX_DEBUG_GRID_SAMPLES 4096
 
 class DebugRenderer {
 public:
@@ -25,7 +27,9 @@ public:
 		GRID_CELL,
 		PARTICLES,
 		PARTICLE_VELOCITIES,
+		GRID_VOLUME,
 		FRAME_TIME,
+		GPU_PROFILE,
 	};
 	enum GridCellView {
 		NONE,
@@ -85,15 +89,42 @@ private:
 	glm::vec3 ws_grid_lower_bound_;
 	glm::vec3 ws_grid_upper_bound_;
 	float ws_grid_cell_size_;
+	unsigned int grid_dim_;
+	/// <summary>
+	/// The stride asked for with SetGridSampleStride(), 0 for automatic.
+	/// </summary>
+	unsigned int grid_sample_stride_;
+	/// <summary>
+	/// The stride the grid views are sampled with.
+	/// </summary>
+	unsigned int grid_stride_;
 
 	std::set<DebugView> active_views_; // If contained in the set, the view is active
 	GridCellView active_cell_view_;
 
+	// The simulation the active views read their data from in Draw(), see SetSimulation()
+	Simulation* simulation_;
+	/// <summary>
+	/// The Simulation::GetDataVersion() of the data uploaded for each field,
+	/// k_stale_version_ when it has to be read again.
+	/// </summary>
+	unsigned int uploaded_versions_[Simulation::NUM_DATA_FIELDS];
+	static const unsigned int k_stale_version_ = 0xFFFFFFFF;
+	/// <summary>
+	/// The cell fields the simulation has no data for (its getter returned nullptr).
+	/// The cell views show nothing for them and they are not read again until SetSimulation().
+	/// </summary>
+	bool missing_fields_[Simulation::NUM_DATA_FIELDS];
+
 	glm::mat4 cached_view_;
 	glm::mat4 cached_proj_;
 
 	DisplayText frame_time_display_;
 
+	// One line of text per profiled GPU section, refreshed by UpdateProfileDisplay()
+	GPUProfiler* profiler_;
+	std::vector<DisplayText*> profile_display_;
+
 	// This shader is used for all instanced debug models
 	// It does a simple color shading and world-placement based on a given model matrix.
 	Shader debug_instance_shader_;
@@ -111,19 +142,25 @@ private:
 	GLuint VBO_line_color_;
 	int grid_line_elements_;
 
-	// Grid arrows
+	// Arrows only upload the vector they show (12 bytes each). "debug/arrow_instance.vert"
+	// builds the orientation and scale, and finds the origin from the instance index
+	// (grid arrows) or the particle positions already uploaded for the sprites.
+	enum ArrowSource {
+		ARROWS_FROM_GRID,
+		ARROWS_FROM_GRID_AXIS,
+		ARROWS_FROM_PARTICLES,
+	};
+	Shader debug_arrow_shader_;
 	int grid_arrow_instance_num_; // Number of verts in the arrow instance
+	GLuint VBO_arrow_instance_;
+
+	// Grid arrows, both views read the same velocities
+	StreamingBuffer grid_velocities_stream_;
 	GLuint VAO_grid_arrows_;
-	GLuint VBO_grid_arrow_instance_;
-	GLuint VBO_grid_arrow_mats_;
-	GLuint VBO_grid_arrow_colors_;
 	int grid_arrow_elements_;
 
 	// Axis aligned grid arrows
 	GLuint VAO_grid_axis_arrows_;
-	GLuint VBO_grid_axis_arrow_instance_;
-	GLuint VBO_grid_axis_arrow_mats_;
-	GLuint VBO_grid_axis_arrow_colors_;
 	int grid_axis_arrow_elements_;
 
 	// Cell fluid visualization
@@ -133,61 +170,137 @@ private:
 	GLuint VAO_grid_cell_;
 	GLuint VBO_grid_cell_instance_;
 	GLuint VBO_grid_cell_mats_;
-	GLuint VBO_grid_cell_float_val_; 
+	StreamingBuffer grid_cell_values_stream_;
 	int grid_cell_elements_;
+	int grid_cell_value_elements_;
+
+	// The same field as the cell view, raymarched through the whole grid in one
+	// full-screen pass. The grid is uploaded once into a 3D texture, unsampled.
+	Shader debug_volume_shader_;
+	GLuint VAO_volume_;
+	GLuint VBO_volume_quad_;
+	Texture3D volume_texture_;
+	bool has_volume_data_;
+	Simulation::DataField volume_field_;
+	unsigned int volume_version_;
+
+	// The views of a GPU_Simulation read its textures directly, with the SIM_TEXTURES
+	// variants of the shaders placing every instance from its index. Nothing is read
+	// back or uploaded, so the VAOs only hold the meshes.
+	enum FieldTextureBits {
+		GRID_VELOCITY_TEXTURES = 1,
+		CELL_TEXTURES = 2,
+		PARTICLE_POSITION_TEXTURES = 4,
+		PARTICLE_VELOCITY_TEXTURES = 8,
+	};
+	GPU_Simulation* gpu_simulation_;
+	Shader debug_arrow_texture_shader_;
+	Shader debug_grid_cell_texture_shader_;
+	Shader debug_particle_texture_shader_;
+	GLuint VAO_texture_arrows_;
+	GLuint VAO_texture_cells_;
+	GLuint VAO_texture_particles_;
 
 	// Cell particle sprite visualization
 	Shader debug_particle_shader_;
 	GLuint VAO_particle_sprite_;
 	GLuint VBO_particle_sprite_instance_;
-	GLuint VBO_particle_sprite_pos_;
-	GLuint VBO_particle_sprite_color_;
+	StreamingBuffer particle_positions_stream_;
 	int particle_sprite_elements_;
 
-	// Particle velocities (arrows)
+	// Particle velocities (arrows), placed at particle_positions_stream_
 	GLuint VAO_particle_arrows_;
-	GLuint VBO_particle_arrow_instance_;
-	GLuint VBO_particle_arrow_mats_;
-	GLuint VBO_particle_arrow_colors_;
+	StreamingBuffer particle_velocities_stream_;
+	int particle_arrow_elements_;
 
+	static unsigned int GetAutomaticGridStride(const unsigned int grid_dim);
+	void SetGridDimensions(const unsigned int grid_dim);
+	void UpdateGridStride(bool force_rebuild);
 	void UpdateGridLines();
-	void UpdateGridAxisVelocities(const std::vector<glm::vec3>& velocities, const unsigned int grid_dim);
 	void UpdateGridVelocities(const std::vector<glm::vec3>& velocities, const unsigned int grid_dim);
 	void UpdateGridCells(const unsigned int grid_dim);
 	void UpdateGridCellFloats(const std::vector<float>& floats, const unsigned int grid_dim);
 
+	void InvalidateGridData();
+	bool NeedsUpload(Simulation::DataField field);
+	bool GetCellViewField(Simulation::DataField& field) const;
+	void BindFieldTextures(Shader& shader, unsigned int texture_bits);
+	unsigned int GetGridSampleCount() const;
+	std::vector<float>* ReadCellValues(Simulation::DataField field);
+	void RefreshView(DebugView view, bool enable_particles);
+
 	void SetVariableDefaults();
 	void SetupOriginBuffers();
 	void SetupGridLineBuffers();
 	void MakeInstanceArrow(std::vector<glm::vec3>& verts);
+	void SetupArrowVAO(GLuint& vao, GLuint vector_divisor, bool has_origins);
 	void SetupGridVelocityBuffers();
-	void SetupGridAxisVelocityBuffers();
 	void SetupGridCellBuffers();
 	void SetupParticleSpriteBuffers();
 	void SetupParticleVelocityBuffers();
+	void SetupVolumeBuffers();
+	void SetupMeshVAO(GLuint& vao, GLuint mesh_vbo);
+	void SetupTextureViewBuffers();
 
 public:
 	DebugRenderer();
 	~DebugRenderer();
 	
+	/*
+	* @brief
+	* Lets the active views read their data from the simulation when they are drawn.
+	* A view only reads and uploads data again once the simulation reports a new
+	* version of it (Simulation::GetDataVersion()), so inactive views cost nothing.
+	* The views of a GPU_Simulation draw from its textures instead, except for
+	* GRID_VOLUME, which still reads the values back.
+	* The Set* methods below still upload data by hand. Pass nullptr before the
+	* simulation is deleted.
+	*/
+	void SetSimulation(Simulation* simulation);
 	void SetGridBoundaries(const glm::vec3& ws_low_bound, const glm::vec3& ws_upper_bound, const float interval);
 	void SetGridVelocities(const std::vector<glm::vec3>& grid_velocities, const unsigned int grid_dimensions);
 	void SetGridPressures(const std::vector<float>& grid_pressures, const unsigned int grid_dimensions);
 	void SetGridDyeDensities(const std::vector<float>& grid_dyes, const unsigned int grid_dimensions);
 	void SetGridFluidCells(const std::vector<float>& grid_fluid, const unsigned int grid_dimensions);
+	/*
+	* @brief
+	* Uploads every cell value for the GRID_VOLUME view, which shows them with the
+	* colors of the active cell view. The values are mapped from their minimum to
+	* their maximum.
+	*
+	* @param
+	* values: One value per cell, at x * grid_dim^2 + y * grid_dim + z
+	*/
+	void SetGridVolume(const std::vector<float>& values, const unsigned int grid_dimensions);
 
 	void SetParticlePositions(const std::vector<glm::vec3>& particle_pos);
-	void SetParticleVelocities(const std::vector<glm::vec3>& particle_pos, const std::vector<glm::vec3>& particle_vel);
+	// The arrows start at the positions given to SetParticlePositions()
+	void SetParticleVelocities(const std::vector<glm::vec3>& particle_vel);
 
 	bool SetView(const glm::mat4& view);
 	bool SetProjection(const glm::mat4& proj);
 
 	void ToggleDebugView(DebugView view_toggle);
 	bool IsDebugViewActive(DebugView view);
+	/*
+	* @brief
+	* Picks the field shown by the GRID_CELL and GRID_VOLUME views.
+	*/
 	void SetDebugCellView(GridCellView view);
+	/*
+	* @brief
+	* Draws the grid views (lines, velocities and cells) at every stride-th cell
+	* along each axis. 0 picks the smallest stride that stays within
+	* MAX_DEBUG_GRID_SAMPLES cells. Without a simulation (see SetSimulation()) the
+	* grid data has to be set again afterwards.
+	*/
+	void SetGridSampleStride(unsigned int stride);
+	unsigned int GetGridSampleStride() const;
 	bool IsCellViewActive(GridCellView view);
 	GridCellView GetCellViewActive();
 	void UpdateFrameTime(float frame_time);
+	void SetProfiler(GPUProfiler* profiler);
+	void UpdateProfileDisplay();
 	void ResetActiveViews();
 
 	bool Draw(bool enable_particles);
@@ -1,24 +1,412 @@
 #include "gpu_simulation.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+// The number of work groups needed to cover size with work groups of local_size^3
+static glm::ivec3 WorkGroupCount(const glm::ivec3& size, int local_size)
+{
+	return (size + glm::ivec3(local_size - 1)) / local_size;
+}
+
+// A float as a GLSL literal that survives the round trip
+static std::string FloatLiteral(float value)
+{
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	std::string literal(text);
+	if (literal.find_first_of(".eEn") == std::string::npos) {
+		literal += ".0";
+	}
+	return literal;
+}
+
+static std::string Vec3Literal(const glm::vec3& value)
+{
+	return FloatLiteral(value.x) + ", " + FloatLiteral(value.y) + ", " + FloatLiteral(value.z);
+}
+
+ShaderDefines GPU_Simulation::GetShaderDefines(const glm::ivec3& local_size) const
+{
+	ShaderDefines defines;
+	defines["GRID_DIM"] = std::to_string(grid_dim_) + "u";
+	defines["WS_GRID_INTERVAL"] = FloatLiteral(ws_grid_interval_);
+	defines["WS_LOWER_BOUND"] = Vec3Literal(ws_lower_bound_grid_);
+	defines["WS_UPPER_BOUND"] = Vec3Literal(ws_upper_bound_grid_);
+	defines["WS_PARTICLE_LOWER_BOUND"] = Vec3Literal(ws_lower_bound_particles_);
+	defines["WS_PARTICLE_UPPER_BOUND"] = Vec3Literal(ws_upper_bound_particles_);
+	defines["TEXTURE_PRECISION"] = FloatLiteral(k_texture_precision_);
+	defines["LOCAL_SIZE_X"] = std::to_string(local_size.x);
+	defines["LOCAL_SIZE_Y"] = std::to_string(local_size.y);
+	defines["LOCAL_SIZE_Z"] = std::to_string(local_size.z);
+	defines["TILE_SIZE"] = std::to_string(k_pressure_tile_size_);
+	return defines;
+}
+
+void GPU_Simulation::ProjectPressure()
+{
+	{
+		GPUProfiler::Scope scope(profiler_, "pressure_divergence");
+		ComputeDivergence();
+	}
+	{
+		GPUProfiler::Scope scope(profiler_, pressure_solver_ == MULTIGRID ? "pressure_solve (multigrid)" : "pressure_solve (red-black)");
+		switch (pressure_solver_) {
+		case RED_BLACK:
+			SolvePressureRedBlack();
+			break;
+		case MULTIGRID:
+			SolvePressureMultigrid();
+			break;
+		}
+	}
+	{
+		GPUProfiler::Scope scope(profiler_, "pressure_apply");
+		ApplyPressureGradient();
+	}
+}
+
+void GPU_Simulation::ComputeDivergence()
+{
+	pressure_divergence_shader_.SetActive();
+	old_x_->BindImageTexture(0);
+	old_y_->BindImageTexture(1);
+	old_z_->BindImageTexture(2);
+	grid_cell_type.BindImageTexture(3);
+	grid_divergence_.BindImageTexture(4);
+	pressure_->BindImageTexture(5);
+	pressure_divergence_shader_.Dispatch();
+	pressure_divergence_shader_.Barrier();
+}
+
+void GPU_Simulation::SolvePressureRedBlack()
+{
+	// Everything except the ping-ponged pressure stays bound for all of the dispatches.
+	bool single_tile = grid_dim_ <= (unsigned int)k_pressure_tile_size_;
+	int sweeps = single_tile ? iterations_ : sweeps_per_dispatch_;
+	int dispatches = sweeps > 0 ? (iterations_ + sweeps - 1) / sweeps : 0;
+
+	pressure_solve_shader_.SetUniform1ui("sweeps", sweeps);
+	pressure_solve_shader_.SetActive();
+	grid_divergence_.BindImageTexture(2);
+	grid_is_fluid.BindImageTexture(3);
+	grid_cell_type.BindImageTexture(4);
+	for (int i = 0; i < dispatches; i++) {
+		pressure_->BindImageTexture(0);
+		pressure_scratch_->BindImageTexture(1);
+		pressure_solve_shader_.Dispatch();
+		pressure_solve_shader_.Barrier();
+		Texture3D* temp = pressure_;
+		pressure_ = pressure_scratch_;
+		pressure_scratch_ = temp;
+	}
+}
+
+void GPU_Simulation::SolvePressureMultigrid()
+{
+	mg_levels_[0].pressure = pressure_;
+
+	// (1) Cell types of the coarse levels follow the fluid cells of this step
+	for (unsigned int level = 1; level < mg_levels_.size(); level++) {
+		mg_restrict_cells_shader_.SetUniform1ui("fine_dim", mg_levels_[level - 1].dim);
+		mg_restrict_cells_shader_.SetUniform1ui("coarse_dim", mg_levels_[level].dim);
+		mg_restrict_cells_shader_.SetActive();
+		mg_levels_[level - 1].cell_type->BindImageTexture(0);
+		mg_levels_[level].cell_type->BindImageTexture(1);
+		mg_restrict_cells_shader_.Dispatch(WorkGroupCount(glm::ivec3(mg_levels_[level].dim), k_pressure_tile_size_));
+		mg_restrict_cells_shader_.Barrier();
+	}
+
+	// (2) Reset the convergence state and re-arm the dispatches of every level
+	GLuint zero_state[4] = { 0, 0, 0, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mg_state_buffer_);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero_state), zero_state);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mg_dispatch_args_buffer_);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mg_dispatch_args_.size() * sizeof(GLuint), &mg_dispatch_args_[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// (3) V-cycles until the residual target is met. All of them are queued up front;
+	// once converged the remaining ones dispatch zero work groups.
+	MultigridResidual(0, true);
+	MultigridCheckConvergence();
+	for (int cycle = 0; cycle < max_v_cycles_; cycle++) {
+		MultigridVCycle(0);
+		MultigridResidual(0, true);
+		MultigridCheckConvergence();
+	}
+	mg_has_solved_ = true;
+}
+
+void GPU_Simulation::ApplyPressureGradient()
+{
+	pressure_apply_shader_.SetActive();
+	old_x_->BindImageTexture(0);
+	old_y_->BindImageTexture(1);
+	old_z_->BindImageTexture(2);
+	new_x_->BindImageTexture(3);
+	new_y_->BindImageTexture(4);
+	new_z_->BindImageTexture(5);
+	grid_is_fluid.BindImageTexture(6);
+	pressure_->BindImageTexture(7);
+	pressure_apply_shader_.Dispatch();
+	// grid_to_particle reads the new and old velocities through samplers
+	pressure_apply_shader_.Barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void GPU_Simulation::SetupMultigrid()
+{
+	unsigned int dim = grid_dim_;
+	while (true) {
+		MultigridLevel level;
+		level.dim = dim;
+		if (mg_levels_.empty()) {
+			level.pressure = pressure_;
+			level.rhs = &grid_divergence_;
+			level.cell_type = &grid_cell_type;
+		}
+		else {
+			level.pressure = new Texture3D(glm::ivec3(dim), StorageType::TEX_FLOAT, ChannelType::R32F);
+			level.rhs = new Texture3D(glm::ivec3(dim), StorageType::TEX_FLOAT, ChannelType::R32F);
+			level.cell_type = new Texture3D(glm::ivec3(dim), StorageType::TEX_INT, ChannelType::R32UI);
+			mg_owned_textures_.emplace_back(level.pressure);
+			mg_owned_textures_.emplace_back(level.rhs);
+			mg_owned_textures_.emplace_back(level.cell_type);
+		}
+		level.residual = new Texture3D(glm::ivec3(dim), StorageType::TEX_FLOAT, ChannelType::R32F);
+		mg_owned_textures_.emplace_back(level.residual);
+		mg_levels_.push_back(level);
+
+		// Indirect work group counts of this level (xyz, w unused)
+		glm::ivec3 groups = WorkGroupCount(glm::ivec3(dim), k_pressure_tile_size_);
+		mg_dispatch_args_.push_back(groups.x);
+		mg_dispatch_args_.push_back(groups.y);
+		mg_dispatch_args_.push_back(groups.z);
+		mg_dispatch_args_.push_back(0);
+
+		if (dim <= k_mg_coarsest_dim_) {
+			break;
+		}
+		dim = (dim + 1) / 2;
+	}
+
+	glGenBuffers(1, &mg_state_buffer_);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mg_state_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	glGenBuffers(1, &mg_dispatch_args_buffer_);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mg_dispatch_args_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, mg_dispatch_args_.size() * sizeof(GLuint), &mg_dispatch_args_[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	mg_check_shader_.SetUniform1ui("num_levels", (unsigned int)mg_levels_.size());
+	mg_check_shader_.SetUniform1fv("residual_target", residual_target_);
+}
+
+void GPU_Simulation::MultigridVCycle(unsigned int level)
+{
+	if (level + 1 == mg_levels_.size()) {
+		MultigridSmooth(level, mg_coarse_sweeps_);
+		return;
+	}
+
+	const MultigridLevel& fine = mg_levels_[level];
+	const MultigridLevel& coarse = mg_levels_[level + 1];
+	GLintptr coarse_args = (level + 1) * 4 * sizeof(GLuint);
+
+	MultigridSmooth(level, mg_pre_sweeps_);
+	MultigridResidual(level, false);
+
+	// Restrict the residual to the coarse right-hand side
+	mg_restrict_shader_.SetUniform1ui("fine_dim", fine.dim);
+	mg_restrict_shader_.SetUniform1ui("coarse_dim", coarse.dim);
+	mg_restrict_shader_.SetActive();
+	fine.residual->BindImageTexture(0);
+	coarse.cell_type->BindImageTexture(1);
+	coarse.rhs->BindImageTexture(2);
+	coarse.pressure->BindImageTexture(3);
+	mg_restrict_shader_.DispatchIndirect(mg_dispatch_args_buffer_, coarse_args);
+	mg_restrict_shader_.Barrier();
+
+	MultigridVCycle(level + 1);
+
+	// Correct the fine level with the coarse solution
+	mg_prolong_shader_.SetUniform1ui("fine_dim", fine.dim);
+	mg_prolong_shader_.SetUniform1ui("coarse_dim", coarse.dim);
+	mg_prolong_shader_.SetActive();
+	fine.pressure->BindImageTexture(0);
+	fine.cell_type->BindImageTexture(1);
+	coarse.pressure->BindImageTexture(2);
+	coarse.cell_type->BindImageTexture(3);
+	mg_prolong_shader_.DispatchIndirect(mg_dispatch_args_buffer_, level * 4 * sizeof(GLuint));
+	mg_prolong_shader_.Barrier();
+
+	MultigridSmooth(level, mg_post_sweeps_);
+}
+
+void GPU_Simulation::MultigridSmooth(unsigned int level, int sweeps)
+{
+	const MultigridLevel& l = mg_levels_[level];
+	mg_smooth_shader_.SetUniform1ui("grid_dim", l.dim);
+	mg_smooth_shader_.SetActive();
+	l.pressure->BindImageTexture(0);
+	l.rhs->BindImageTexture(1);
+	l.cell_type->BindImageTexture(2);
+	for (int i = 0; i < sweeps; i++) {
+		for (unsigned int color = 0; color < 2; color++) {
+			mg_smooth_shader_.SetUniform1ui("color", color);
+			mg_smooth_shader_.DispatchIndirect(mg_dispatch_args_buffer_, level * 4 * sizeof(GLuint));
+			mg_smooth_shader_.Barrier();
+		}
+	}
+}
+
+void GPU_Simulation::MultigridResidual(unsigned int level, bool record_max)
+{
+	const MultigridLevel& l = mg_levels_[level];
+	mg_residual_shader_.SetUniform1ui("grid_dim", l.dim);
+	mg_residual_shader_.SetUniform1ui("record_max", record_max ? 1 : 0);
+	mg_residual_shader_.SetActive();
+	l.pressure->BindImageTexture(0);
+	l.rhs->BindImageTexture(1);
+	l.cell_type->BindImageTexture(2);
+	l.residual->BindImageTexture(3);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mg_state_buffer_);
+	mg_residual_shader_.DispatchIndirect(mg_dispatch_args_buffer_, level * 4 * sizeof(GLuint));
+	mg_residual_shader_.Barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GPU_Simulation::MultigridCheckConvergence()
+{
+	mg_check_shader_.SetActive();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mg_state_buffer_);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mg_dispatch_args_buffer_);
+	mg_check_shader_.Dispatch(glm::ivec3(1));
+	// The dispatch arguments are read as commands by the next indirect dispatch
+	mg_check_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+unsigned int GPU_Simulation::GetReadbackSize(ReadbackField field)
+{
+	glm::ivec2 particle_dim = particle_pos_x.GetDimensions();
+	unsigned int num_particles = particle_dim.x * particle_dim.y;
+	unsigned int num_cells = grid_dim_ * grid_dim_ * grid_dim_;
+	unsigned int num_faces = (grid_dim_ + 1) * (grid_dim_ + 1) * (grid_dim_ + 1);
+	switch (field) {
+	case PARTICLE_POSITIONS:
+	case PARTICLE_VELOCITIES:
+		return 3 * num_particles * sizeof(GLint);
+	case GRID_VELOCITIES:
+		return 3 * num_faces * sizeof(GLint);
+	case GRID_PRESSURES:
+		return num_cells * sizeof(GLfloat);
+	case GRID_FLUID_CELLS:
+		return num_cells * sizeof(GLuint);
+	default:
+		return 0;
+	}
+}
+
+std::vector<AsyncReadback::Source> GPU_Simulation::GetReadbackSources(ReadbackField field)
+{
+	glm::ivec2 particle_dim = particle_pos_x.GetDimensions();
+	unsigned int particles_size = particle_dim.x * particle_dim.y * sizeof(GLint);
+	unsigned int faces_size = (grid_dim_ + 1) * (grid_dim_ + 1) * (grid_dim_ + 1) * sizeof(GLint);
+	unsigned int cells_size = grid_dim_ * grid_dim_ * grid_dim_ * sizeof(GLuint);
+
+	std::vector<AsyncReadback::Source> sources;
+	switch (field) {
+	case PARTICLE_POSITIONS:
+		sources.push_back({ GL_TEXTURE_2D, particle_pos_x.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		sources.push_back({ GL_TEXTURE_2D, particle_pos_y.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		sources.push_back({ GL_TEXTURE_2D, particle_pos_z.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		break;
+	case PARTICLE_VELOCITIES:
+		sources.push_back({ GL_TEXTURE_2D, particle_vel_x.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		sources.push_back({ GL_TEXTURE_2D, particle_vel_y.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		sources.push_back({ GL_TEXTURE_2D, particle_vel_z.GetTextureId(), GL_RED_INTEGER, GL_INT, particles_size });
+		break;
+	case GRID_VELOCITIES:
+		// The projected velocities, which are what grid_to_particle used,
+		// or the transferred ones when stopped before the projection
+		sources.push_back({ GL_TEXTURE_3D, (grid_projected_ ? new_x_ : old_x_)->GetTextureId(), GL_RED_INTEGER, GL_INT, faces_size });
+		sources.push_back({ GL_TEXTURE_3D, (grid_projected_ ? new_y_ : old_y_)->GetTextureId(), GL_RED_INTEGER, GL_INT, faces_size });
+		sources.push_back({ GL_TEXTURE_3D, (grid_projected_ ? new_z_ : old_z_)->GetTextureId(), GL_RED_INTEGER, GL_INT, faces_size });
+		break;
+	case GRID_PRESSURES:
+		sources.push_back({ GL_TEXTURE_3D, pressure_->GetTextureId(), GL_RED, GL_FLOAT, cells_size });
+		break;
+	case GRID_FLUID_CELLS:
+		sources.push_back({ GL_TEXTURE_3D, grid_cell_type.GetTextureId(), GL_RED_INTEGER, GL_UNSIGNED_INT, cells_size });
+		break;
+	default:
+		break;
+	}
+	return sources;
+}
+
+bool GPU_Simulation::RequestReadback(ReadbackField field)
+{
+	// The textures were last written by image stores
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	return readbacks_[field].Request(GetReadbackSources(field), phase_count_);
+}
+
+bool GPU_Simulation::UpdateReadback(ReadbackField field)
+{
+	AsyncReadback& readback = readbacks_[field];
+	bool updated = readback.Poll(false);
+	bool requested = readback.GetLastRequested() >= phase_count_ || RequestReadback(field);
+
+	if (blocking_readback_ && readback.GetTag() < phase_count_) {
+		updated |= readback.Poll(true);
+		// Every buffer was in flight, so the current step could only be queued now
+		if (!requested && RequestReadback(field)) {
+			updated |= readback.Poll(true);
+		}
+	}
+	if (updated) {
+		++readback_versions_[field];
+	}
+	return updated;
+}
+
+void GPU_Simulation::UnpackParticleReadback(ReadbackField field, std::vector<glm::vec3>& out)
+{
+	const std::vector<unsigned char>& data = readbacks_[field].GetData();
+	glm::ivec2 particle_dim = particle_pos_x.GetDimensions();
+	unsigned int num_particles = particle_dim.x * particle_dim.y;
+	const GLint* x = (const GLint*)&data[0];
+	const GLint* y = x + num_particles;
+	const GLint* z = y + num_particles;
+
+	out.resize(num_particles);
+	for (unsigned int i = 0; i < num_particles; i++) {
+		out[i] = glm::vec3(x[i], y[i], z[i]) / k_texture_precision_;
+	}
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
 GPU_Simulation::GPU_Simulation(int num_particles_sqrt, int grid_dimen, int iteration) :
-	copy_new_to_old_shader_("compute/copy_new_to_old.comp", glm::ivec3(grid_dimen + 1)),
-	init_grid_shader_("compute/init_grid.comp", glm::ivec3(grid_dimen + 1, grid_dimen + 1, grid_dimen + 1)),
-	move_particles_shader_("compute/move_particles.comp", glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1)),
-	particle_to_grid_shader_("compute/particle_to_grid.comp", glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1)),
-	average_grid_shader_("compute/average_grid.comp", glm::ivec3(grid_dimen, grid_dimen, grid_dimen)),
-	grid_incompressability_shader_("compute/grid_incompressability.comp", glm::ivec3(grid_dimen, grid_dimen, grid_dimen)),
-	grid_to_particle_shader_("compute/grid_to_particle.comp", glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1)),
+	profiler_(nullptr),
 	grid_vel_x(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I), 
 	grid_vel_y(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I), 
 	grid_vel_z(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I),
 	grid_old_vel_x(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I),
 	grid_old_vel_y(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I),
 	grid_old_vel_z(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32I), 
-	grid_count_x(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32UI),
-	grid_count_y(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32UI),
-	grid_count_z(glm::ivec3(grid_dimen + 1), StorageType::TEX_INT, ChannelType::R32UI),
 	grid_is_fluid(glm::ivec3(grid_dimen), StorageType::TEX_INT, ChannelType::R32UI),
 	grid_cell_type(glm::ivec3(grid_dimen), StorageType::TEX_INT, ChannelType::R32UI),
+	grid_divergence_(glm::ivec3(grid_dimen), StorageType::TEX_FLOAT, ChannelType::R32F),
+	grid_pressure_a_(glm::ivec3(grid_dimen), StorageType::TEX_FLOAT, ChannelType::R32F),
+	grid_pressure_b_(glm::ivec3(grid_dimen), StorageType::TEX_FLOAT, ChannelType::R32F),
 	particle_pos_x(glm::ivec2(num_particles_sqrt, num_particles_sqrt), StorageType::TEX_INT, ChannelType::R32I),
 	particle_pos_y(glm::ivec2(num_particles_sqrt, num_particles_sqrt), StorageType::TEX_INT, ChannelType::R32I),
 	particle_pos_z(glm::ivec2(num_particles_sqrt, num_particles_sqrt), StorageType::TEX_INT, ChannelType::R32I),
@@ -26,37 +414,56 @@ GPU_Simulation::GPU_Simulation(int num_particles_sqrt, int grid_dimen, int itera
 	particle_vel_y(glm::ivec2(num_particles_sqrt, num_particles_sqrt), StorageType::TEX_INT, ChannelType::R32I),
 	particle_vel_z(glm::ivec2(num_particles_sqrt, num_particles_sqrt), StorageType::TEX_INT, ChannelType::R32I),
 	grid_dim_(grid_dimen),
-	ws_grid_interval_(0.5f),
+	ws_grid_interval_(2.0f / grid_dimen), // the grid spans [-1, 1] on every axis
 	ws_lower_bound_grid_(glm::vec3(-1, -1, -1)),
 	ws_upper_bound_grid_(glm::vec3(1, 1, 1)),
 	ws_lower_bound_particles_(glm::vec3(-1, -1, -1)),
 	ws_upper_bound_particles_(glm::vec3(1, 1, 1)),
 	k_texture_precision_(1000),
 	iterations_(iteration),
-	flip_ratio_(0.1)
+	flip_ratio_(0.1),
+	particle_to_grid_shader_("compute/particle_to_grid.comp", WorkGroupCount(glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1), k_particle_group_size_),
+		GetShaderDefines(glm::ivec3(k_particle_group_size_, k_particle_group_size_, 1))),
+	average_grid_shader_("compute/average_grid.comp", WorkGroupCount(glm::ivec3(grid_dimen + 1), k_face_group_size_),
+		GetShaderDefines(glm::ivec3(k_face_group_size_))),
+	pressure_divergence_shader_("compute/pressure_divergence.comp", WorkGroupCount(glm::ivec3(grid_dimen), k_pressure_tile_size_),
+		GetShaderDefines(glm::ivec3(k_pressure_tile_size_))),
+	pressure_solve_shader_("compute/pressure_solve_redblack.comp", WorkGroupCount(glm::ivec3(grid_dimen), k_pressure_tile_size_),
+		GetShaderDefines(glm::ivec3(k_pressure_tile_size_))),
+	pressure_apply_shader_("compute/pressure_apply.comp", WorkGroupCount(glm::ivec3(grid_dimen + 1), k_pressure_tile_size_),
+		GetShaderDefines(glm::ivec3(k_pressure_tile_size_))),
+	mg_restrict_cells_shader_("compute/multigrid/mg_restrict_cells.comp", glm::ivec3(1)),
+	mg_smooth_shader_("compute/multigrid/mg_smooth.comp", glm::ivec3(1)),
+	mg_residual_shader_("compute/multigrid/mg_residual.comp", glm::ivec3(1)),
+	mg_restrict_shader_("compute/multigrid/mg_restrict.comp", glm::ivec3(1)),
+	mg_prolong_shader_("compute/multigrid/mg_prolong.comp", glm::ivec3(1)),
+	mg_check_shader_("compute/multigrid/mg_check_convergence.comp", glm::ivec3(1)),
+	grid_to_particle_shader_("compute/grid_to_particle.comp", WorkGroupCount(glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1), k_particle_group_size_),
+		GetShaderDefines(glm::ivec3(k_particle_group_size_, k_particle_group_size_, 1))),
+	seed_particles_shader_("compute/seed_particles.comp", WorkGroupCount(glm::ivec3(num_particles_sqrt, num_particles_sqrt, 1), k_particle_group_size_),
+		GetShaderDefines(glm::ivec3(k_particle_group_size_, k_particle_group_size_, 1))),
+	sweeps_per_dispatch_(4),
+	over_relaxation_(1.5f),
+	pressure_solver_(RED_BLACK),
+	residual_target_(1.0f / 1000.0f),
+	max_v_cycles_(8),
+	mg_pre_sweeps_(2),
+	mg_post_sweeps_(2),
+	mg_coarse_sweeps_(16),
+	mg_state_buffer_(0),
+	mg_dispatch_args_buffer_(0),
+	mg_has_solved_(false),
+	grid_accumulators_(0),
+	phase_count_(0),
+	grid_projected_(false),
+	blocking_readback_(false)
 {
 	// Setup the compute shaders
-	move_particles_shader_.SetUniform1fv("delta_time", 0.0f);
-	move_particles_shader_.SetUniform3fv("force", glm::vec3(0, -9.8, 0));
-	move_particles_shader_.SetUniform3fv("ws_lower_bound", ws_lower_bound_particles_);
-	move_particles_shader_.SetUniform3fv("ws_upper_bound", ws_upper_bound_particles_);
-	move_particles_shader_.SetUniform1fv("texture_precision", k_texture_precision_);
-
-	particle_to_grid_shader_.SetUniform1ui("grid_dim", grid_dim_);
-	particle_to_grid_shader_.SetUniform1fv("ws_grid_interval", ws_grid_interval_);
-	particle_to_grid_shader_.SetUniform3fv("ws_lower_bound", ws_lower_bound_grid_);
-	particle_to_grid_shader_.SetUniform3fv("ws_upper_bound", ws_upper_bound_grid_);
-	particle_to_grid_shader_.SetUniform1fv("texture_precision", k_texture_precision_);
-
-	average_grid_shader_.SetUniform1fv("texture_precision", k_texture_precision_);
-
-	grid_incompressability_shader_.SetUniform1fv("texture_precision", k_texture_precision_);
-
-	grid_to_particle_shader_.SetUniform1ui("grid_dim", grid_dim_);
-	grid_to_particle_shader_.SetUniform1fv("ws_grid_interval", ws_grid_interval_);
-	grid_to_particle_shader_.SetUniform3fv("ws_lower_bound", ws_lower_bound_grid_);
-	grid_to_particle_shader_.SetUniform3fv("ws_upper_bound", ws_upper_bound_grid_);
-	grid_to_particle_shader_.SetUniform1fv("texture_precision", k_texture_precision_);
+	particle_to_grid_shader_.SetUniform1fv("delta_time", 0.0f);
+	particle_to_grid_shader_.SetUniform3fv("force", glm::vec3(0, -9.8, 0));
+
+	pressure_solve_shader_.SetUniform1fv("over_relaxation", over_relaxation_);
+
 	grid_to_particle_shader_.SetUniform1fv("flip_ratio", flip_ratio_);
 	
 	// Setting grid
@@ -64,7 +471,6 @@ GPU_Simulation::GPU_Simulation(int num_particles_sqrt, int grid_dimen, int itera
 	unsigned int grid_dim_plus_one_cubed = (grid_dim_ + 1) * (grid_dim_ + 1) * (grid_dim_ + 1);
 
 	std::vector<int> zero_data_int(grid_dim_plus_one_cubed); // zero-filled vector
-	std::vector<unsigned int> zero_data_uint(grid_dim_plus_one_cubed); // zero-filled vector
 	std::vector<unsigned int> grid_is_fluid_data(grid_dim_cubed);
 	std::vector<unsigned int> grid_cell_type_data(grid_dim_cubed);
 	for (int x = 0; x < grid_dim_; x++) {
@@ -88,191 +494,211 @@ GPU_Simulation::GPU_Simulation(int num_particles_sqrt, int grid_dimen, int itera
 	grid_old_vel_x.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_int[0]);
 	grid_old_vel_y.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_int[0]);
 	grid_old_vel_z.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_int[0]);
-	grid_count_x.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_uint[0]);
-	grid_count_y.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_uint[0]);
-	grid_count_z.SetNewData(glm::ivec3(grid_dim_ + 1), (const void*)&zero_data_uint[0]);
 	grid_is_fluid.SetNewData(glm::ivec3(grid_dim_), (const void*)&grid_is_fluid_data[0]);
 	grid_cell_type.SetNewData(glm::ivec3(grid_dim_), (const void*)&grid_cell_type_data[0]);
+
+	std::vector<float> zero_data_float(grid_dim_cubed);
+	grid_divergence_.SetNewData(glm::ivec3(grid_dim_), (const void*)&zero_data_float[0]);
+	grid_pressure_a_.SetNewData(glm::ivec3(grid_dim_), (const void*)&zero_data_float[0]);
+	grid_pressure_b_.SetNewData(glm::ivec3(grid_dim_), (const void*)&zero_data_float[0]);
+
+	// Starts zeroed, afterwards average_grid clears it as it goes
+	std::vector<int> zero_accumulators(6 * grid_dim_plus_one_cubed + grid_dim_cubed);
+	grid_accumulators_ = GPUPrimitives::GenerateBuffer((unsigned int)zero_accumulators.size(), &zero_accumulators[0]);
+
+	SetupMultigrid();
+
+	for (int field = 0; field < NUM_READBACK_FIELDS; field++) {
+		readbacks_[field].Resize(GetReadbackSize((ReadbackField)field));
+	}
 }
 
 GPU_Simulation::~GPU_Simulation()
 {
+	glDeleteBuffers(1, &grid_accumulators_);
+	glDeleteBuffers(1, &mg_state_buffer_);
+	glDeleteBuffers(1, &mg_dispatch_args_buffer_);
 }
 
-void GPU_Simulation::SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval)
+void GPU_Simulation::SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float /*interval*/)
 {
-	// Setting velocities
-	std::vector<int> particle_vel_data_x(initial.size());
-	std::vector<int> particle_vel_data_y(initial.size());
-	std::vector<int> particle_vel_data_z(initial.size());
-
-	for (const glm::vec3& vel : initial) {
-		particle_vel_data_x.push_back((int)(vel.x * k_texture_precision_));
-		particle_vel_data_y.push_back((int)(vel.y * k_texture_precision_));
-		particle_vel_data_z.push_back((int)(vel.z * k_texture_precision_));
+	// The particles form a square texture
+	glm::ivec2 particle_dim = glm::ivec2(floor(sqrt(initial.size())));
+	if (particle_dim != particle_pos_x.GetDimensions()) {
+		for (Texture2D* texture : { &particle_pos_x, &particle_pos_y, &particle_pos_z, &particle_vel_x, &particle_vel_y, &particle_vel_z }) {
+			texture->SetNewData(particle_dim, nullptr);
+		}
 	}
+	unsigned int num_particles = particle_dim.x * particle_dim.y;
 
-	particle_vel_x.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_vel_data_x[0]);
-	particle_vel_y.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_vel_data_y[0]);
-	particle_vel_z.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_vel_data_z[0]);
-
-
-
-	// Creating positions (currently spreads it evenly across the grid)
-	// TODO: under the assumption that all sides are equal
-	std::vector<glm::vec3> particle_pos(initial.size());
-	float particles_per_side = floor(cbrt(initial.size()));
-	int particles_per_side_squared = particles_per_side * particles_per_side;
-
-	int index = 0;
+	// Spread evenly inside the solid border of the grid
 	glm::vec3 grid_interval_magnitude(std::abs(ws_grid_interval_));
-	glm::vec3 adjusted_lower = lower_bound + grid_interval_magnitude;
-	glm::vec3 adjusted_upper = upper_bound - grid_interval_magnitude;
-	float delta = (std::fabs(adjusted_lower.x) + std::fabs(adjusted_upper.x)) / particles_per_side;
-
-	for (float z = adjusted_lower.z; z < adjusted_upper.z && index < particle_pos.size(); z += delta) {
-		for (float y = adjusted_lower.y; y < adjusted_upper.y && index < particle_pos.size(); y += delta) {
-			for (float x = adjusted_lower.x; x < adjusted_upper.x && index < particle_pos.size(); x += delta) {
-				particle_pos[index] = glm::vec3(x, y, z);
-				++index;
-				//printf("Particle pos at [%f, %f, %f]\n", x, y, z);
-			}
+	ParticleEmitter emitter(ParticleEmitter::REGULAR, lower_bound + grid_interval_magnitude, upper_bound - grid_interval_magnitude);
+
+	// Usually every particle starts with the same velocity, which the seeding writes
+	bool uniform_velocity = true;
+	for (unsigned int i = 1; i < num_particles && uniform_velocity; i++) {
+		uniform_velocity = initial[i] == initial[0];
+	}
+	if (num_particles > 0 && uniform_velocity) {
+		emitter.velocity = initial[0];
+	}
+	SeedParticles(emitter);
+
+	if (!uniform_velocity) {
+		std::vector<int> particle_vel_data_x(num_particles);
+		std::vector<int> particle_vel_data_y(num_particles);
+		std::vector<int> particle_vel_data_z(num_particles);
+		for (unsigned int i = 0; i < num_particles; i++) {
+			particle_vel_data_x[i] = (int)(initial[i].x * k_texture_precision_);
+			particle_vel_data_y[i] = (int)(initial[i].y * k_texture_precision_);
+			particle_vel_data_z[i] = (int)(initial[i].z * k_texture_precision_);
 		}
+		particle_vel_x.SetNewData(particle_dim, (const void*)&particle_vel_data_x[0], &upload_ring_);
+		particle_vel_y.SetNewData(particle_dim, (const void*)&particle_vel_data_y[0], &upload_ring_);
+		particle_vel_z.SetNewData(particle_dim, (const void*)&particle_vel_data_z[0], &upload_ring_);
 	}
+}
 
-	// Setting positions
-	std::vector<int> particle_pos_data_x(initial.size());
-	std::vector<int> particle_pos_data_y(initial.size());
-	std::vector<int> particle_pos_data_z(initial.size());
+void GPU_Simulation::SeedParticles(const ParticleEmitter& emitter)
+{
+	GPUProfiler::Scope scope(profiler_, "seed_particles");
+	glm::ivec2 particle_dim = particle_pos_x.GetDimensions();
+
+	seed_particles_shader_.SetUniform1ui("emitter_shape", emitter.shape);
+	seed_particles_shader_.SetUniform3fv("emitter_lower_bound", emitter.lower_bound);
+	seed_particles_shader_.SetUniform3fv("emitter_upper_bound", emitter.upper_bound);
+	seed_particles_shader_.SetUniform3fv("emitter_velocity", emitter.velocity);
+	seed_particles_shader_.SetUniform1ui("emitter_seed", emitter.seed);
+	seed_particles_shader_.SetUniform1ui("lattice_side", ParticleEmitter::GetLatticeSide(particle_dim.x * particle_dim.y));
+	seed_particles_shader_.SetActive();
+	particle_pos_x.BindImageTexture(0);
+	particle_pos_y.BindImageTexture(1);
+	particle_pos_z.BindImageTexture(2);
+	particle_vel_x.BindImageTexture(3);
+	particle_vel_y.BindImageTexture(4);
+	particle_vel_z.BindImageTexture(5);
+	seed_particles_shader_.Dispatch(WorkGroupCount(glm::ivec3(particle_dim, 1), k_particle_group_size_));
+	// Read by the simulation kernels as images, by the renderer through samplers
+	// and by the readbacks, and overwritten by uploads of velocities
+	seed_particles_shader_.Barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	// Anything read back so far belongs to the old particles
+	readbacks_[PARTICLE_POSITIONS].Resize(GetReadbackSize(PARTICLE_POSITIONS));
+	readbacks_[PARTICLE_VELOCITIES].Resize(GetReadbackSize(PARTICLE_VELOCITIES));
+}
 
-	for (const glm::vec3& pos : particle_pos) {
-		particle_pos_data_x.push_back((int)(pos.x * k_texture_precision_));
-		particle_pos_data_y.push_back((int)(pos.y * k_texture_precision_));
-		particle_pos_data_z.push_back((int)(pos.z * k_texture_precision_));
-		//printf("Pushing particle pos of [%d %d %d]\n", (int)(pos.x * k_texture_precision_), (int)(pos.y * k_texture_precision_), (int)(pos.z * k_texture_precision_));
+void GPU_Simulation::TimeStep(float delta)
+{
+	GPUProfiler::Scope step_scope(profiler_, "simulation step");
+	for (int phase = 0; phase < NUM_STEP_PHASES; phase++) {
+		TimeStepPhase((StepPhase)phase, delta);
 	}
+}
 
-	particle_pos_x.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_pos_data_x[0]);
-	particle_pos_y.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_pos_data_y[0]);
-	particle_pos_z.SetNewData(glm::ivec2(floor(sqrt(initial.size()))), (const void*)&particle_pos_data_z[0]);
-	//printf("Tex dim are %d %d\n", glm::ivec2(floor(sqrt(initial.size()))).x, glm::ivec2(floor(sqrt(initial.size()))).y);
+bool GPU_Simulation::SupportsStepPhases()
+{
+	return true;
 }
 
-void GPU_Simulation::TimeStep(float delta)
+void GPU_Simulation::TimeStepPhase(StepPhase phase, float delta)
 {
-	// init_grid
-	init_grid_shader_.SetActive();
-	new_x_->ActiveBind(GL_TEXTURE0);
-	new_y_->ActiveBind(GL_TEXTURE1);
-	new_z_->ActiveBind(GL_TEXTURE2);
-	grid_count_x.ActiveBind(GL_TEXTURE3);
-	grid_count_y.ActiveBind(GL_TEXTURE4);
-	grid_count_z.ActiveBind(GL_TEXTURE5);
-	init_grid_shader_.Dispatch();
-	init_grid_shader_.Barrier();
-
-	// init_particles
-	move_particles_shader_.SetUniform1fv("delta_time", delta);
-	move_particles_shader_.SetActive();
-	particle_pos_x.ActiveBind(GL_TEXTURE0);
-	particle_pos_y.ActiveBind(GL_TEXTURE1);
-	particle_pos_z.ActiveBind(GL_TEXTURE2);
-	particle_vel_x.ActiveBind(GL_TEXTURE3);
-	particle_vel_y.ActiveBind(GL_TEXTURE4);
-	particle_vel_z.ActiveBind(GL_TEXTURE5);
-	move_particles_shader_.Dispatch();
-	move_particles_shader_.Barrier();
-
-	// particle_to_grid
-	particle_to_grid_shader_.SetUniformTexture2D("particle_positions_x", particle_pos_x, GL_TEXTURE8);
-	particle_to_grid_shader_.SetUniformTexture2D("particle_positions_y", particle_pos_y, GL_TEXTURE9);
-	particle_to_grid_shader_.SetUniformTexture2D("particle_positions_z", particle_pos_z, GL_TEXTURE10);
-	particle_to_grid_shader_.SetUniformTexture2D("particle_velocities_x", particle_vel_x, GL_TEXTURE11);
-	particle_to_grid_shader_.SetUniformTexture2D("particle_velocities_y", particle_vel_y, GL_TEXTURE12);
-	particle_to_grid_shader_.SetUniformTexture2D("particle_velocities_z", particle_vel_z, GL_TEXTURE13);
-	particle_to_grid_shader_.SetActive();
-	new_x_->ActiveBind(GL_TEXTURE0);
-	new_y_->ActiveBind(GL_TEXTURE1);
-	new_z_->ActiveBind(GL_TEXTURE2);
-	grid_count_x.ActiveBind(GL_TEXTURE3);
-	grid_count_y.ActiveBind(GL_TEXTURE4);
-	grid_count_z.ActiveBind(GL_TEXTURE5);
-	grid_is_fluid.ActiveBind(GL_TEXTURE6);
-	grid_cell_type.ActiveBind(GL_TEXTURE7);
-	particle_to_grid_shader_.Dispatch();
-	particle_to_grid_shader_.Barrier();
-
-	// average_grid
-	average_grid_shader_.SetActive();
-	new_x_->ActiveBind(GL_TEXTURE0);
-	new_y_->ActiveBind(GL_TEXTURE1);
-	new_z_->ActiveBind(GL_TEXTURE2);
-	grid_count_x.ActiveBind(GL_TEXTURE3);
-	grid_count_y.ActiveBind(GL_TEXTURE4);
-	grid_count_z.ActiveBind(GL_TEXTURE5);
-	average_grid_shader_.Dispatch();
-	average_grid_shader_.Barrier();
-
-
-	// grid_incompressability
-	for (int i = 0; i < iterations_; i++) {
-		grid_incompressability_shader_.SetActive();
-		new_x_->ActiveBind(GL_TEXTURE0);
-		new_y_->ActiveBind(GL_TEXTURE1);
-		new_z_->ActiveBind(GL_TEXTURE2);
-		old_x_->ActiveBind(GL_TEXTURE3);
-		old_y_->ActiveBind(GL_TEXTURE4);
-		old_z_->ActiveBind(GL_TEXTURE5);
-		grid_is_fluid.ActiveBind(GL_TEXTURE6);
-		grid_cell_type.ActiveBind(GL_TEXTURE7);
-		grid_incompressability_shader_.Dispatch();
-		grid_incompressability_shader_.Barrier();
-		Texture3D* temp_x = new_x_;
-		Texture3D* temp_y = new_y_;
-		Texture3D* temp_z = new_z_;
-		new_x_ = old_x_;
-		new_y_ = old_y_;
-		new_z_ = old_z_;
-		old_x_ = temp_x;
-		old_y_ = temp_y;
-		old_z_ = temp_z;
-	}
+	switch (phase) {
+	case TRANSFER_TO_GRID:
+		// particle_to_grid (moves the particles, then splats them into the accumulators)
+		{
+			GPUProfiler::Scope scope(profiler_, "particle_to_grid");
+			particle_to_grid_shader_.SetUniform1fv("delta_time", delta);
+			particle_to_grid_shader_.SetActive();
+			particle_pos_x.BindImageTexture(0);
+			particle_pos_y.BindImageTexture(1);
+			particle_pos_z.BindImageTexture(2);
+			particle_vel_x.BindImageTexture(3);
+			particle_vel_y.BindImageTexture(4);
+			particle_vel_z.BindImageTexture(5);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, grid_accumulators_);
+			// SetInitialVelocities() can resize the particle textures
+			particle_to_grid_shader_.Dispatch(WorkGroupCount(glm::ivec3(particle_pos_x.GetDimensions(), 1), k_particle_group_size_));
+			// The positions are final for this step and are sampled when the particles are drawn
+			particle_to_grid_shader_.Barrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
 
-	// grid_to_particle
-	grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_x", *new_x_, GL_TEXTURE8);
-	grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_y", *new_y_, GL_TEXTURE9);
-	grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_z", *new_z_, GL_TEXTURE10);
-	grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_x", *old_x_, GL_TEXTURE11);
-	grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_y", *old_y_, GL_TEXTURE12);
-	grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_z", *old_z_, GL_TEXTURE13);
-	grid_to_particle_shader_.SetActive();
-	grid_is_fluid.ActiveBind(GL_TEXTURE0);
-	grid_cell_type.ActiveBind(GL_TEXTURE1);
-	particle_pos_x.ActiveBind(GL_TEXTURE2);
-	particle_pos_y.ActiveBind(GL_TEXTURE3);
-	particle_pos_z.ActiveBind(GL_TEXTURE4);
-	particle_vel_x.ActiveBind(GL_TEXTURE5);
-	particle_vel_y.ActiveBind(GL_TEXTURE6);
-	particle_vel_z.ActiveBind(GL_TEXTURE7);
-	grid_to_particle_shader_.Dispatch();
-	grid_to_particle_shader_.Barrier();
-
-	// copy_new_to_old
-	copy_new_to_old_shader_.SetActive();
-	new_x_->ActiveBind(0);
-	new_y_->ActiveBind(1);
-	new_z_->ActiveBind(2);
-	old_x_->ActiveBind(3);
-	old_y_->ActiveBind(4);
-	old_z_->ActiveBind(5);
-	copy_new_to_old_shader_.Dispatch();
-	copy_new_to_old_shader_.Barrier();
+		// average_grid (writes the transferred velocities to old_ and clears the accumulators)
+		{
+			GPUProfiler::Scope scope(profiler_, "average_grid");
+			average_grid_shader_.SetActive();
+			old_x_->BindImageTexture(0);
+			old_y_->BindImageTexture(1);
+			old_z_->BindImageTexture(2);
+			grid_cell_type.BindImageTexture(3);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, grid_accumulators_);
+			average_grid_shader_.Dispatch();
+			// The cleared accumulators are read again by the next step's particle_to_grid
+			average_grid_shader_.Barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		grid_projected_ = false;
+		break;
+
+	case PRESSURE_PROJECTION:
+		// old_ -> new_
+		ProjectPressure();
+		grid_projected_ = true;
+		break;
+
+	case TRANSFER_TO_PARTICLES:
+		// grid_to_particle
+		{
+			GPUProfiler::Scope scope(profiler_, "grid_to_particle");
+			grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_x", *new_x_, GL_TEXTURE8);
+			grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_y", *new_y_, GL_TEXTURE9);
+			grid_to_particle_shader_.SetUniformTexture3D("grid_velocities_z", *new_z_, GL_TEXTURE10);
+			grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_x", *old_x_, GL_TEXTURE11);
+			grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_y", *old_y_, GL_TEXTURE12);
+			grid_to_particle_shader_.SetUniformTexture3D("grid_old_velocities_z", *old_z_, GL_TEXTURE13);
+			grid_to_particle_shader_.SetActive();
+			grid_is_fluid.BindImageTexture(0);
+			grid_cell_type.BindImageTexture(1);
+			particle_pos_x.BindImageTexture(2);
+			particle_pos_y.BindImageTexture(3);
+			particle_pos_z.BindImageTexture(4);
+			particle_vel_x.BindImageTexture(5);
+			particle_vel_y.BindImageTexture(6);
+			particle_vel_z.BindImageTexture(7);
+			grid_to_particle_shader_.Dispatch(WorkGroupCount(glm::ivec3(particle_pos_x.GetDimensions(), 1), k_particle_group_size_));
+			grid_to_particle_shader_.Barrier();
+		}
+		break;
+
+	default:
+		break;
+	}
+	++phase_count_;
 }
 
 std::vector<glm::vec3>* GPU_Simulation::GetGridVelocities()
 {
-	printf("GPU_Simulation::GetGridVelocities() not implemented yet.\n");
-	return nullptr;
+	if (UpdateReadback(GRID_VELOCITIES)) {
+		// Face (x, y, z) of the textures is at x + y * faces + z * faces^2, while the
+		// CPU side follows SequentialGridBased and puts cell (x, y, z) at x * n^2 + y * n + z
+		const std::vector<unsigned char>& data = readbacks_[GRID_VELOCITIES].GetData();
+		unsigned int faces = grid_dim_ + 1;
+		unsigned int num_faces = faces * faces * faces;
+		const GLint* vel_x = (const GLint*)&data[0];
+		const GLint* vel_y = vel_x + num_faces;
+		const GLint* vel_z = vel_y + num_faces;
+
+		grid_velocities_.assign(num_faces, glm::vec3(0.0f));
+		for (unsigned int x = 0; x < grid_dim_; x++) {
+			for (unsigned int y = 0; y < grid_dim_; y++) {
+				for (unsigned int z = 0; z < grid_dim_; z++) {
+					unsigned int texel = x + y * faces + z * faces * faces;
+					grid_velocities_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] =
+						glm::vec3(vel_x[texel], vel_y[texel], vel_z[texel]) / k_texture_precision_;
+				}
+			}
+		}
+	}
+	return readbacks_[GRID_VELOCITIES].GetTag() >= 0 ? &grid_velocities_ : nullptr;
 }
 
 unsigned int GPU_Simulation::GetGridDimensions()
@@ -297,8 +723,19 @@ float GPU_Simulation::GetGridInterval()
 
 std::vector<float>* GPU_Simulation::GetGridPressures()
 {
-	printf("GPU_Simulation::GetGridPressures() not implemented yet.\n");
-	return nullptr;
+	if (UpdateReadback(GRID_PRESSURES)) {
+		const float* pressures = (const float*)&readbacks_[GRID_PRESSURES].GetData()[0];
+		grid_pressures_.resize(grid_dim_ * grid_dim_ * grid_dim_);
+		for (unsigned int x = 0; x < grid_dim_; x++) {
+			for (unsigned int y = 0; y < grid_dim_; y++) {
+				for (unsigned int z = 0; z < grid_dim_; z++) {
+					grid_pressures_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] =
+						pressures[x + y * grid_dim_ + z * grid_dim_ * grid_dim_];
+				}
+			}
+		}
+	}
+	return readbacks_[GRID_PRESSURES].GetTag() >= 0 ? &grid_pressures_ : nullptr;
 }
 
 std::vector<float>* GPU_Simulation::GetGridDyeDensities()
@@ -309,20 +746,61 @@ std::vector<float>* GPU_Simulation::GetGridDyeDensities()
 
 std::vector<float>* GPU_Simulation::GetGridFluidCells()
 {
-	printf("GPU_Simulation::GetGridFluidCells() not implemented yet.\n");
-	return nullptr;
+	// 1 for the cells that held particles in the step, 0 for air and solid cells
+	if (UpdateReadback(GRID_FLUID_CELLS)) {
+		const GLuint* cell_types = (const GLuint*)&readbacks_[GRID_FLUID_CELLS].GetData()[0];
+		grid_fluid_cells_.resize(grid_dim_ * grid_dim_ * grid_dim_);
+		for (unsigned int x = 0; x < grid_dim_; x++) {
+			for (unsigned int y = 0; y < grid_dim_; y++) {
+				for (unsigned int z = 0; z < grid_dim_; z++) {
+					grid_fluid_cells_[x * grid_dim_ * grid_dim_ + y * grid_dim_ + z] =
+						cell_types[x + y * grid_dim_ + z * grid_dim_ * grid_dim_] == FLUID ? 1.0f : 0.0f;
+				}
+			}
+		}
+	}
+	return readbacks_[GRID_FLUID_CELLS].GetTag() >= 0 ? &grid_fluid_cells_ : nullptr;
 }
 
 std::vector<glm::vec3>* GPU_Simulation::GetParticleVelocities()
 {
-	printf("GPU_Simulation::GetParticleVelocities() not implemented yet.\n");
-	return nullptr;
+	if (UpdateReadback(PARTICLE_VELOCITIES)) {
+		UnpackParticleReadback(PARTICLE_VELOCITIES, particle_velocities_);
+	}
+	return readbacks_[PARTICLE_VELOCITIES].GetTag() >= 0 ? &particle_velocities_ : nullptr;
 }
 
 std::vector<glm::vec3>* GPU_Simulation::GetParticlePositions()
 {
-	printf("GPU_Simulation::GetParticlePositions() not implemented yet.\n");
-	return nullptr;
+	if (UpdateReadback(PARTICLE_POSITIONS)) {
+		UnpackParticleReadback(PARTICLE_POSITIONS, particle_positions_);
+	}
+	return readbacks_[PARTICLE_POSITIONS].GetTag() >= 0 ? &particle_positions_ : nullptr;
+}
+
+unsigned int GPU_Simulation::GetDataVersion(DataField field)
+{
+	// The accessors unpack whatever arrived, which bumps the version of the readback
+	switch (field) {
+	case GRID_VELOCITY_DATA:
+		GetGridVelocities();
+		return readback_versions_[GRID_VELOCITIES];
+	case GRID_PRESSURE_DATA:
+		GetGridPressures();
+		return readback_versions_[GRID_PRESSURES];
+	case GRID_FLUID_CELL_DATA:
+		GetGridFluidCells();
+		return readback_versions_[GRID_FLUID_CELLS];
+	case PARTICLE_POSITION_DATA:
+		GetParticlePositions();
+		return readback_versions_[PARTICLE_POSITIONS];
+	case PARTICLE_VELOCITY_DATA:
+		GetParticleVelocities();
+		return readback_versions_[PARTICLE_VELOCITIES];
+	default:
+		// No dye on the GPU, so it never changes
+		return 0;
+	}
 }
 
 Texture2D* GPU_Simulation::GetTexParticlePositions_X()
@@ -345,6 +823,85 @@ float GPU_Simulation::GetTexturePrecision()
 	return k_texture_precision_;
 }
 
+GPU_Simulation::FieldTextures GPU_Simulation::GetFieldTextures()
+{
+	// Same choice of velocities as GetReadbackSources()
+	FieldTextures textures;
+	textures.grid_velocities[0] = grid_projected_ ? new_x_ : old_x_;
+	textures.grid_velocities[1] = grid_projected_ ? new_y_ : old_y_;
+	textures.grid_velocities[2] = grid_projected_ ? new_z_ : old_z_;
+	textures.grid_pressures = pressure_;
+	textures.grid_cell_types = &grid_cell_type;
+	textures.fluid_cell_type = FLUID;
+	textures.particle_positions[0] = &particle_pos_x;
+	textures.particle_positions[1] = &particle_pos_y;
+	textures.particle_positions[2] = &particle_pos_z;
+	textures.particle_velocities[0] = &particle_vel_x;
+	textures.particle_velocities[1] = &particle_vel_y;
+	textures.particle_velocities[2] = &particle_vel_z;
+
+	// The textures were last written by image stores
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	return textures;
+}
+
+GPUPrimitives* GPU_Simulation::GetPrimitives()
+{
+	return &primitives_;
+}
+
+void GPU_Simulation::SetProfiler(GPUProfiler* profiler)
+{
+	profiler_ = profiler;
+}
+
+void GPU_Simulation::SetPressureSolver(PressureSolver solver)
+{
+	pressure_solver_ = solver;
+}
+
+GPU_Simulation::PressureSolver GPU_Simulation::GetPressureSolver() const
+{
+	return pressure_solver_;
+}
+
+void GPU_Simulation::SetMultigridTarget(float residual_target, int max_v_cycles)
+{
+	residual_target_ = residual_target;
+	max_v_cycles_ = max_v_cycles;
+	mg_check_shader_.SetUniform1fv("residual_target", residual_target_);
+}
+
+bool GPU_Simulation::GetLastMultigridStats(int& v_cycles, float& residual)
+{
+	if (!mg_has_solved_ || pressure_solver_ != MULTIGRID) {
+		return false;
+	}
+	GLuint state[4];
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mg_state_buffer_);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(state), state);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// cycles counts the measurements that were above the target, which is one more
+	// than the V-cycles run when the cap was hit
+	v_cycles = std::min((int)state[1], max_v_cycles_);
+	memcpy(&residual, &state[3], sizeof(float));
+	return true;
+}
+
+void GPU_Simulation::SetBlockingReadback(bool blocking)
+{
+	blocking_readback_ = blocking;
+}
+
+int GPU_Simulation::GetReadbackLatency(ReadbackField field) const
+{
+	long long tag = readbacks_[field].GetTag();
+	// In whole steps, data read in between phases counts as the step it was read in
+	return tag >= 0 ? (int)((phase_count_ - tag + NUM_STEP_PHASES - 1) / NUM_STEP_PHASES) : -1;
+}
+
 void GPU_Simulation::Draw()
 {
 	// TODO: do somehow
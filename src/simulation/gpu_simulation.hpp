@@ -1,10 +1,43 @@
 #ifndef GPU_SIM_H
 #define GPU_SIM_H
 
+#include <memory>
+
 #include "sequential_simulation.hpp"
+#include "particle_emitter.hpp"
 #include "rendering/compute_shader.hpp"
+#include "rendering/gpu_primitives.hpp"
+#include "rendering/gpu_profiler.hpp"
+#include "rendering/async_readback.hpp"
+#include "rendering/pixel_upload_ring.hpp"
 
 class GPU_Simulation : public Simulation {
+public:
+	/*
+	* @brief
+	* The solvers available for the pressure projection.
+	* 
+	* RED_BLACK runs a fixed number of red-black Gauss-Seidel sweeps on shared memory tiles.
+	* MULTIGRID runs geometric multigrid V-cycles until the residual target is reached.
+	*/
+	enum PressureSolver {
+		RED_BLACK,
+		MULTIGRID
+	};
+
+	/*
+	* @brief
+	* The data that can be read back to the CPU through the Get* accessors.
+	*/
+	enum ReadbackField {
+		PARTICLE_POSITIONS,
+		PARTICLE_VELOCITIES,
+		GRID_VELOCITIES,
+		GRID_PRESSURES,
+		GRID_FLUID_CELLS,
+		NUM_READBACK_FIELDS
+	};
+
 private:
 	enum CellType {
 		SOLID,
@@ -12,13 +45,16 @@ private:
 		AIR
 	};
 
-	ComputeShader copy_new_to_old_shader_;
-	ComputeShader init_grid_shader_;
-	ComputeShader move_particles_shader_;
-	ComputeShader particle_to_grid_shader_;
-	ComputeShader average_grid_shader_;
-	ComputeShader grid_incompressability_shader_;
-	ComputeShader grid_to_particle_shader_;
+	/// <summary>
+	/// Scan / sort / compaction building blocks shared by the passes of
+	/// the simulation (particle binning, active cell lists, ...).
+	/// </summary>
+	GPUPrimitives primitives_;
+
+	/// <summary>
+	/// Times the passes of TimeStep() when set. Not owned.
+	/// </summary>
+	GPUProfiler* profiler_;
 
 	Texture3D grid_vel_x;
 	Texture3D grid_vel_y;
@@ -28,13 +64,20 @@ private:
 	Texture3D grid_old_vel_y;
 	Texture3D grid_old_vel_z;
 
-	Texture3D grid_count_x;
-	Texture3D grid_count_y;
-	Texture3D grid_count_z;
-
 	Texture3D grid_is_fluid;
 	Texture3D grid_cell_type;
 
+	/// <summary>
+	/// Scalar fields of the pressure projection (R32F, one value per cell).
+	/// The pressure is kept between steps as the initial guess of the next solve,
+	/// and ping-pongs between the two textures while solving.
+	/// </summary>
+	Texture3D grid_divergence_;
+	Texture3D grid_pressure_a_;
+	Texture3D grid_pressure_b_;
+	Texture3D* pressure_ = &grid_pressure_a_;
+	Texture3D* pressure_scratch_ = &grid_pressure_b_;
+
 
 	Texture2D particle_pos_x;
 	Texture2D particle_pos_y;
@@ -44,6 +87,11 @@ private:
 	Texture2D particle_vel_y;
 	Texture2D particle_vel_z;
 
+	/// <summary>
+	/// old_ holds the velocities transferred from the particles (written by average_grid),
+	/// new_ the same velocities after the pressure projection (written by pressure_apply).
+	/// The projection reads one and writes the other, so no copy between them is needed.
+	/// </summary>
 	Texture3D* old_x_ = &grid_old_vel_x;
 	Texture3D* old_y_ = &grid_old_vel_y;
 	Texture3D* old_z_ = &grid_old_vel_z;
@@ -63,12 +111,193 @@ private:
 	int iterations_;
 	float flip_ratio_;
 
+	/// <summary>
+	/// The edge length of the tiles the pressure solve works on, which is also
+	/// the local size of the other per-cell kernels. Injected as TILE_SIZE /
+	/// LOCAL_SIZE_* so that the shaders and the dispatches always agree.
+	/// </summary>
+	static const int k_pressure_tile_size_ = 8;
+
+	/// <summary>
+	/// The local sizes of the particle kernels (k_particle_group_size_^2 particles)
+	/// and of average_grid (k_face_group_size_^3 faces).
+	/// </summary>
+	static const int k_particle_group_size_ = 8;
+	static const int k_face_group_size_ = 4;
+
+	/// <summary>
+	/// Declared after the configuration above, which the kernels are compiled
+	/// with (see GetShaderDefines()).
+	/// </summary>
+	ComputeShader particle_to_grid_shader_;
+	ComputeShader average_grid_shader_;
+	ComputeShader pressure_divergence_shader_;
+	ComputeShader pressure_solve_shader_;
+	ComputeShader pressure_apply_shader_;
+	ComputeShader mg_restrict_cells_shader_;
+	ComputeShader mg_smooth_shader_;
+	ComputeShader mg_residual_shader_;
+	ComputeShader mg_restrict_shader_;
+	ComputeShader mg_prolong_shader_;
+	ComputeShader mg_check_shader_;
+	ComputeShader grid_to_particle_shader_;
+	ComputeShader seed_particles_shader_;
+
+
+	/// <summary>
+	/// The number of red-black sweeps done in shared memory per dispatch when the
+	/// grid spans several tiles. Halos are refreshed between dispatches. When the
+	/// grid fits in one tile, all iterations_ sweeps are done in a single dispatch.
+	/// </summary>
+	int sweeps_per_dispatch_;
+	float over_relaxation_;
+
+	/// <summary>
+	/// One level of the multigrid hierarchy. Level 0 is the simulation grid and
+	/// shares its pressure, divergence and cell types; every further level has
+	/// half the resolution of the one before it.
+	/// </summary>
+	struct MultigridLevel {
+		unsigned int dim;
+		Texture3D* pressure;
+		Texture3D* rhs;
+		Texture3D* residual;
+		Texture3D* cell_type;
+	};
+
+	/// <summary>
+	/// Levels stop being added once they are this small. The coarsest level is
+	/// solved with mg_coarse_sweeps_ red-black sweeps.
+	/// </summary>
+	static const unsigned int k_mg_coarsest_dim_ = 4;
+
+	PressureSolver pressure_solver_;
+	std::vector<MultigridLevel> mg_levels_;
+	// The textures of the coarser levels, the finest level uses those of the simulation
+	std::vector<std::unique_ptr<Texture3D>> mg_owned_textures_;
+	float residual_target_;
+	int max_v_cycles_;
+	int mg_pre_sweeps_;
+	int mg_post_sweeps_;
+	int mg_coarse_sweeps_;
+
+	/// <summary>
+	/// mg_state_buffer_ holds the residual measurement and convergence flag
+	/// (see "compute/multigrid/mg_check_convergence.comp"). mg_dispatch_args_buffer_
+	/// holds the indirect work group count of every level, which is zeroed on the
+	/// GPU once the solve has converged.
+	/// </summary>
+	GLuint mg_state_buffer_;
+	GLuint mg_dispatch_args_buffer_;
+	std::vector<GLuint> mg_dispatch_args_;
+	bool mg_has_solved_;
+
+	/// <summary>
+	/// The SSBO particle_to_grid splats into: fixed point velocity sums and particle
+	/// counts of every face, then the particle count of every cell
+	/// (see "compute/particle_to_grid.comp"). average_grid turns it into the old
+	/// velocities and clears it again for the next step.
+	/// </summary>
+	GLuint grid_accumulators_;
+
+	/// <summary>
+	/// The number of step phases run so far (NUM_STEP_PHASES per TimeStep()).
+	/// Readbacks are tagged with it, so data read in between phases is told
+	/// apart from data read at the end of the step.
+	/// </summary>
+	long long phase_count_;
+
+	/// <summary>
+	/// Whether new_ holds the projection of the current old_. Until the
+	/// projection phase has run, GRID_VELOCITIES reads old_ instead.
+	/// </summary>
+	bool grid_projected_;
+
+	/// <summary>
+	/// One readback ring per field, only used once the field is asked for.
+	/// The results are unpacked into the CPU side copies below, which are
+	/// laid out the same way as the ones of SequentialGridBased.
+	/// </summary>
+	AsyncReadback readbacks_[NUM_READBACK_FIELDS];
+	bool blocking_readback_;
+	/// <summary>
+	/// Counts the readbacks unpacked per field, see GetDataVersion().
+	/// </summary>
+	unsigned int readback_versions_[NUM_READBACK_FIELDS] = {};
+
+	/// <summary>
+	/// Stages the particle velocities of SetInitialVelocities() when they
+	/// differ between particles, so they upload into the existing textures
+	/// without waiting on the copies.
+	/// </summary>
+	PixelUploadRing upload_ring_;
+
+	std::vector<glm::vec3> particle_positions_;
+	std::vector<glm::vec3> particle_velocities_;
+	std::vector<glm::vec3> grid_velocities_;
+	std::vector<float> grid_pressures_;
+	std::vector<float> grid_fluid_cells_;
+
+	/*
+	* @brief
+	* Projects the transferred velocities (old_x_, old_y_, old_z_) to be divergence
+	* free, writing the result to new_x_, new_y_, new_z_. Computes the divergence,
+	* solves for the pressure with the selected solver and subtracts the pressure
+	* gradient from the faces.
+	*/
+	void ProjectPressure();
+
+	void ComputeDivergence();
+	void SolvePressureRedBlack();
+	void SolvePressureMultigrid();
+	void ApplyPressureGradient();
+
+	// Multigrid helpers
+	void SetupMultigrid();
+	void MultigridVCycle(unsigned int level);
+	void MultigridSmooth(unsigned int level, int sweeps);
+	void MultigridResidual(unsigned int level, bool record_max);
+	void MultigridCheckConvergence();
+
+	/*
+	* @brief
+	* The constants the simulation kernels are specialized for: grid size, world
+	* bounds, texture precision and the local work group size. Called while the
+	* kernels are constructed, so it only uses the members declared before them.
+	*/
+	ShaderDefines GetShaderDefines(const glm::ivec3& local_size) const;
+
+	// Readback helpers
+	unsigned int GetReadbackSize(ReadbackField field);
+	std::vector<AsyncReadback::Source> GetReadbackSources(ReadbackField field);
+	bool RequestReadback(ReadbackField field);
+
+	/*
+	* @brief
+	* Polls the readback of a field and queues a copy of the current step if
+	* there isn't one yet. Waits for the copy when blocking_readback_ is set.
+	*
+	* @return
+	* Returns true if newer data arrived, which then needs to be unpacked.
+	*/
+	bool UpdateReadback(ReadbackField field);
+	void UnpackParticleReadback(ReadbackField field, std::vector<glm::vec3>& out);
+
 public:
 	GPU_Simulation(int num_particles_sqrt, int grid_dim, int iteration);
 	~GPU_Simulation();
 
+	/*
+	* @brief
+	* Seeds initial.size() particles (rounded down to a square texture) on a regular
+	* lattice inside the solid border of the bounds. Positions are placed on the GPU
+	* (see SeedParticles()); the velocities are only uploaded when they differ
+	* between particles.
+	*/
 	virtual void SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval);
 	virtual void TimeStep(float delta);
+	virtual bool SupportsStepPhases();
+	virtual void TimeStepPhase(StepPhase phase, float delta);
 	virtual std::vector<glm::vec3>* GetGridVelocities();
 	virtual unsigned int GetGridDimensions();
 	virtual glm::vec3 GetGridUpperBounds();
@@ -80,12 +309,114 @@ public:
 	virtual std::vector<glm::vec3>* GetParticleVelocities();
 	virtual std::vector<glm::vec3>* GetParticlePositions();
 
+	/*
+	* @brief
+	* Versions follow the readbacks rather than the steps, so a field only changes
+	* version once a newer copy of it has arrived. Asking for the version of a field
+	* polls its readback like the Get* accessor does.
+	*/
+	virtual unsigned int GetDataVersion(DataField field);
+
 	Texture2D* GetTexParticlePositions_X();
 	Texture2D* GetTexParticlePositions_Y();
 	Texture2D* GetTexParticlePositions_Z();
 
 	float GetTexturePrecision();
 
+	/*
+	* @brief
+	* The textures behind the Get* accessors, to draw from without reading them back.
+	* Velocities and positions are fixed point, scaled by GetTexturePrecision().
+	* Particle i is at texel (i % width, i / width). Grid velocities are per face,
+	* face (x, y, z) at texel (x, y, z), and cells are at the texel of their index.
+	*/
+	struct FieldTextures {
+		Texture3D* grid_velocities[3];
+		Texture3D* grid_pressures;
+		Texture3D* grid_cell_types;
+		unsigned int fluid_cell_type;
+		Texture2D* particle_positions[3];
+		Texture2D* particle_velocities[3];
+	};
+
+	/*
+	* @brief
+	* Returns the textures of the state the last step or phase left, the same the
+	* Get* accessors read back, and makes the image stores to them visible to
+	* texture fetches. Only valid until the next step or phase.
+	*/
+	FieldTextures GetFieldTextures();
+
+	/*
+	* @brief
+	* Places every particle inside the emitter and sets its velocity to the emitter's,
+	* all in one dispatch without touching host memory. The number of particles
+	* stays the same.
+	*/
+	void SeedParticles(const ParticleEmitter& emitter);
+
+	/*
+	* @brief
+	* The GPU scan, radix sort and stream compaction primitives owned by
+	* this simulation. They operate on SSBOs and can be used by anything
+	* that runs in the same context.
+	*/
+	GPUPrimitives* GetPrimitives();
+
+	/*
+	* @brief
+	* Records the GPU time of every pass of TimeStep() into the given profiler.
+	* Pass nullptr to stop profiling. The profiler must outlive the simulation
+	* or be unset first.
+	*/
+	void SetProfiler(GPUProfiler* profiler);
+
+	/*
+	* @brief
+	* Selects the solver used for the pressure projection.
+	* RED_BLACK is driven by the iteration count given to the constructor,
+	* MULTIGRID by the residual target and the V-cycle cap.
+	*/
+	void SetPressureSolver(PressureSolver solver);
+	PressureSolver GetPressureSolver() const;
+
+	/*
+	* @brief
+	* Sets when the multigrid solver stops: once the largest residual of the
+	* fluid cells is at most residual_target, or after max_v_cycles V-cycles.
+	* The residual is measured in the units of the divergence (velocity per cell).
+	*/
+	void SetMultigridTarget(float residual_target, int max_v_cycles);
+
+	/*
+	* @brief
+	* Reads back how the last multigrid solve went. This waits for the GPU,
+	* so only use it for debugging and profiling.
+	* 
+	* @return
+	* Returns false if the last solve was not a multigrid solve.
+	*/
+	bool GetLastMultigridStats(int& v_cycles, float& residual);
+
+	/*
+	* @brief
+	* By default the Get* accessors never wait for the GPU: they return the most
+	* recent copy that has arrived (or nullptr before the first one does) and queue
+	* a copy of the current step for later calls. With blocking readback on they
+	* wait for the current step instead, which is what tests and comparisons want.
+	*/
+	void SetBlockingReadback(bool blocking);
+
+	/*
+	* @brief
+	* How stale the data returned by the accessor of a field is.
+	*
+	* @return
+	* The number of steps taken since the data was copied, 0 if it is current,
+	* or -1 if nothing has been read back yet.
+	*/
+	int GetReadbackLatency(ReadbackField field) const;
+
 	// Rendering
 	void Draw();
 };
@@ -0,0 +1,99 @@
+#include "particle_emitter.hpp"
+
+#include <cmath>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+// The PCG hash, same as Hash() in "compute/seed_particles.comp"
+static unsigned int Hash(unsigned int value)
+{
+	unsigned int state = value * 747796405u + 2891336453u;
+	unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// A uniform number in [0, 1) with 24 bits, which floats hold exactly
+static float Random(unsigned int& state)
+{
+	state = Hash(state);
+	return (float)(state >> 8) / 16777216.0f;
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+ParticleEmitter::ParticleEmitter(Shape shape, glm::vec3 lower_bound, glm::vec3 upper_bound, glm::vec3 velocity, unsigned int seed)
+	: shape(shape), lower_bound(lower_bound), upper_bound(upper_bound), velocity(velocity), seed(seed)
+{
+}
+
+unsigned int ParticleEmitter::GetLatticeSide(unsigned int count)
+{
+	unsigned int side = (unsigned int)std::cbrt((double)count);
+	// cbrt can land just below a whole number
+	while (side * side * side < count) {
+		++side;
+	}
+	return side;
+}
+
+glm::vec3 ParticleEmitter::GetPosition(unsigned int index, unsigned int lattice_side) const
+{
+	glm::vec3 extent = upper_bound - lower_bound;
+	unsigned int state = Hash(index ^ Hash(seed));
+
+	switch (shape) {
+	case REGULAR:
+	case JITTERED: {
+		glm::vec3 spacing = extent / (float)lattice_side;
+		glm::vec3 lattice_pos = glm::vec3(
+			(float)(index % lattice_side),
+			(float)((index / lattice_side) % lattice_side),
+			(float)(index / (lattice_side * lattice_side)));
+		if (shape == JITTERED) {
+			lattice_pos.x += Random(state);
+			lattice_pos.y += Random(state);
+			lattice_pos.z += Random(state);
+		}
+		return lower_bound + lattice_pos * spacing;
+	}
+	case BOX: {
+		glm::vec3 offset;
+		offset.x = Random(state);
+		offset.y = Random(state);
+		offset.z = Random(state);
+		return lower_bound + offset * extent;
+	}
+	case SPHERE: {
+		// Uniform in volume: the radius goes with the cube root of a uniform number
+		float radius = 0.5f * std::fmin(extent.x, std::fmin(extent.y, extent.z));
+		float cos_theta = 2.0f * Random(state) - 1.0f;
+		float phi = 6.28318530718f * Random(state);
+		float r = radius * std::cbrt(Random(state));
+		float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+		glm::vec3 direction(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+		return 0.5f * (lower_bound + upper_bound) + r * direction;
+	}
+	default:
+		return lower_bound;
+	}
+}
+
+const char* ParticleEmitter::GetShapeName(Shape shape)
+{
+	switch (shape) {
+	case REGULAR:
+		return "REGULAR";
+	case JITTERED:
+		return "JITTERED";
+	case BOX:
+		return "BOX";
+	case SPHERE:
+		return "SPHERE";
+	default:
+		return "UNKNOWN";
+	}
+}
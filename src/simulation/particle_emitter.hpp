@@ -0,0 +1,58 @@
+#ifndef PARTICLE_EMITTER_H
+#define PARTICLE_EMITTER_H
+
+#include <glm/glm.hpp>
+
+/*
+* @brief
+* Describes where the particles of a simulation start and how fast. Used by
+* GPU_Simulation::SeedParticles(), which places every particle on the GPU with
+* "compute/seed_particles.comp", and by CPU_Simulation::SeedParticles(), which
+* runs GetPosition() instead. The two must stay in step.
+*
+* REGULAR:	a lattice of particles spanning the bounds (the initial scene)
+* JITTERED:	the same lattice with every particle moved randomly within its lattice cell
+* BOX:		random positions filling the bounds
+* SPHERE:	random positions filling the largest sphere that fits in the bounds
+*
+* The random shapes hash the particle index with the seed, so the same emitter
+* always places the particles the same way.
+*/
+struct ParticleEmitter {
+	enum Shape {
+		REGULAR,
+		JITTERED,
+		BOX,
+		SPHERE,
+		NUM_SHAPES
+	};
+
+	Shape shape;
+	glm::vec3 lower_bound;
+	glm::vec3 upper_bound;
+	glm::vec3 velocity;
+	unsigned int seed;
+
+	ParticleEmitter(Shape shape = REGULAR, glm::vec3 lower_bound = glm::vec3(-1.0f), glm::vec3 upper_bound = glm::vec3(1.0f),
+		glm::vec3 velocity = glm::vec3(0.0f), unsigned int seed = 0);
+
+	/*
+	* @brief
+	* The number of particles along each side of the lattice of REGULAR and
+	* JITTERED, the smallest that has room for count particles.
+	*/
+	static unsigned int GetLatticeSide(unsigned int count);
+
+	/*
+	* @brief
+	* Where the particle with the given index starts, in world space.
+	*
+	* @param
+	* lattice_side: GetLatticeSide() of the number of particles seeded.
+	*/
+	glm::vec3 GetPosition(unsigned int index, unsigned int lattice_side) const;
+
+	static const char* GetShapeName(Shape shape);
+};
+
+#endif // !PARTICLE_EMITTER_H
@@ -395,6 +395,7 @@ void SequentialGridBased::SetInitialVelocities(const std::vector<glm::vec3>& ini
 				}
 			}
 		}
+		MarkDataChanged();
 	}
 }
 
@@ -404,6 +405,7 @@ void SequentialGridBased::TimeStep(float delta)
 	SolveIncompressability(delta);
 	BorderConditionUpdate();
 	AdvectVelocity(delta);
+	MarkDataChanged();
 }
 
 std::vector<glm::vec3>* SequentialGridBased::GetGridVelocities()
@@ -1008,6 +1010,7 @@ void SequentialParticleBased::SetInitialVelocities(const std::vector<glm::vec3>&
 
 	//printf("Set initial particle positions of size: %d\n", particle_pos_.size());
 	//printf("Set initial particle velocities of size: %d\n", particle_vel_.size());
+	MarkDataChanged();
 }
 
 void SequentialParticleBased::TimeStep(float delta)
@@ -1021,6 +1024,7 @@ void SequentialParticleBased::TimeStep(float delta)
 	TransferVelocitiesToParticles(0.1);
 	BorderConditionUpdate();
 	AdvectVelocity(delta);
+	MarkDataChanged();
 }
 
 std::vector<glm::vec3>* SequentialParticleBased::GetParticleVelocities()
@@ -6,6 +6,9 @@
 
 class Simulation {
 public:
+	// Simulations are deleted through this interface when switching between them
+	virtual ~Simulation() {}
+
 	virtual void SetInitialVelocities(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval) = 0;
 	virtual void TimeStep(float delta) = 0;
 	virtual std::vector<glm::vec3>* GetGridVelocities() = 0;
@@ -18,6 +21,60 @@ public:
 	virtual std::vector<float>* GetGridFluidCells() = 0;
 	virtual std::vector<glm::vec3>* GetParticleVelocities() = 0;
 	virtual std::vector<glm::vec3>* GetParticlePositions() = 0;
+
+	/*
+	* @brief
+	* The phases a time step of the particle simulations is made of, in order.
+	* TRANSFER_TO_GRID moves the particles and splats their velocities onto the grid,
+	* PRESSURE_PROJECTION makes the grid velocities divergence free and
+	* TRANSFER_TO_PARTICLES updates the particle velocities from the grid.
+	*/
+	enum StepPhase {
+		TRANSFER_TO_GRID,
+		PRESSURE_PROJECTION,
+		TRANSFER_TO_PARTICLES,
+		NUM_STEP_PHASES
+	};
+
+	/*
+	* @brief
+	* Simulations that can run the phases of a step one at a time return true and
+	* implement TimeStepPhase(), which lets them be compared phase by phase
+	* (see SimulationDiff). Running every phase in order is the same as TimeStep().
+	* In between phases the Get* accessors return the state the last phase left,
+	* e.g. GetGridVelocities() returns the velocities before the projection after
+	* TRANSFER_TO_GRID.
+	*/
+	virtual bool SupportsStepPhases() { return false; }
+	virtual void TimeStepPhase(StepPhase /*phase*/, float /*delta*/) {}
+
+	/*
+	* @brief
+	* The data behind each of the Get* accessors, for GetDataVersion().
+	*/
+	enum DataField {
+		GRID_VELOCITY_DATA,
+		GRID_PRESSURE_DATA,
+		GRID_DYE_DATA,
+		GRID_FLUID_CELL_DATA,
+		PARTICLE_POSITION_DATA,
+		PARTICLE_VELOCITY_DATA,
+		NUM_DATA_FIELDS
+	};
+
+	/*
+	* @brief
+	* A counter that changes whenever the data of the field may have, so viewers
+	* (see DebugRenderer) can skip data they have already processed without reading it.
+	* By default all fields share one counter, bumped with MarkDataChanged() by every
+	* step, phase and reseed of the simulation.
+	*/
+	virtual unsigned int GetDataVersion(DataField /*field*/) { return data_version_; }
+
+protected:
+	unsigned int data_version_ = 0;
+
+	void MarkDataChanged() { ++data_version_; }
 };
 
 class SequentialGridBased : public Simulation {
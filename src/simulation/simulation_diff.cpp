@@ -0,0 +1,340 @@
+#include "simulation_diff.hpp"
+#include "gpu_simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	const char* k_field_names[SimulationDiff::NUM_FIELDS] = {
+		"particle_positions",
+		"particle_velocities",
+		"grid_velocities",
+		"grid_divergence",
+		"grid_pressures",
+		"grid_fluid_cells"
+	};
+
+	const char* k_phase_names[Simulation::NUM_STEP_PHASES] = {
+		"transfer_to_grid",
+		"pressure_projection",
+		"transfer_to_particles"
+	};
+
+	unsigned int FieldBit(SimulationDiff::Field field)
+	{
+		return 1u << field;
+	}
+
+	// The fields each phase writes, which are the ones compared after it
+	const unsigned int k_phase_fields[Simulation::NUM_STEP_PHASES] = {
+		FieldBit(SimulationDiff::PARTICLE_POSITIONS) | FieldBit(SimulationDiff::PARTICLE_VELOCITIES)
+			| FieldBit(SimulationDiff::GRID_VELOCITIES) | FieldBit(SimulationDiff::GRID_FLUID_CELLS),
+		FieldBit(SimulationDiff::GRID_VELOCITIES) | FieldBit(SimulationDiff::GRID_DIVERGENCE) | FieldBit(SimulationDiff::GRID_PRESSURES),
+		FieldBit(SimulationDiff::PARTICLE_VELOCITIES)
+	};
+	const unsigned int k_all_fields = (1u << SimulationDiff::NUM_FIELDS) - 1;
+	const unsigned int k_initial_fields = FieldBit(SimulationDiff::PARTICLE_POSITIONS) | FieldBit(SimulationDiff::PARTICLE_VELOCITIES);
+
+	// Accumulates the errors of one field
+	struct ErrorSum {
+		SimulationDiff::FieldDiff diff;
+		double squared_sum;
+
+		ErrorSum()
+		{
+			memset(&diff, 0, sizeof(diff));
+			diff.compared = true;
+			squared_sum = 0.0;
+		}
+
+		void Add(float a, float b, float tolerance)
+		{
+			float error = std::fabs(a - b);
+			// NaN on either side is always a mismatch
+			if (!(error <= tolerance)) {
+				diff.over_tolerance++;
+				if (std::isnan(error)) {
+					error = INFINITY;
+				}
+			}
+			diff.max_error = std::max(diff.max_error, error);
+			squared_sum += (double)error * error;
+			diff.count++;
+		}
+
+		SimulationDiff::FieldDiff Finish()
+		{
+			diff.rms_error = diff.count > 0 ? (float)std::sqrt(squared_sum / diff.count) : 0.0f;
+			return diff;
+		}
+	};
+}
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+bool SimulationDiff::Compare(int phase, unsigned int field_mask)
+{
+	Report report;
+	report.step = step_;
+	report.phase = phase;
+	report.passed = true;
+	for (int field = 0; field < NUM_FIELDS; field++) {
+		if (field_mask & FieldBit((Field)field)) {
+			report.fields[field] = CompareField((Field)field);
+		}
+		else {
+			memset(&report.fields[field], 0, sizeof(FieldDiff));
+		}
+		const FieldDiff& diff = report.fields[field];
+		if (diff.compared && (diff.size_mismatch || diff.over_tolerance > 0)) {
+			report.passed = false;
+		}
+	}
+	reports_.push_back(report);
+	return report.passed;
+}
+
+SimulationDiff::FieldDiff SimulationDiff::CompareField(Field field)
+{
+	bool same_grid = a_->GetGridDimensions() == b_->GetGridDimensions();
+	FieldDiff diff;
+	switch (field) {
+	case PARTICLE_POSITIONS:
+		return CompareVectors(a_->GetParticlePositions(), b_->GetParticlePositions(), tolerances_[field], false);
+	case PARTICLE_VELOCITIES:
+		return CompareVectors(a_->GetParticleVelocities(), b_->GetParticleVelocities(), tolerances_[field], false);
+	case GRID_VELOCITIES:
+		diff = CompareVectors(a_->GetGridVelocities(), b_->GetGridVelocities(), tolerances_[field], true);
+		break;
+	case GRID_DIVERGENCE: {
+		std::vector<float> divergence_a = ComputeDivergence(a_);
+		std::vector<float> divergence_b = ComputeDivergence(b_);
+		diff = CompareScalars(divergence_a.empty() ? nullptr : &divergence_a, divergence_b.empty() ? nullptr : &divergence_b, tolerances_[field], true);
+		break;
+	}
+	case GRID_PRESSURES:
+		diff = CompareScalars(a_->GetGridPressures(), b_->GetGridPressures(), tolerances_[field], false);
+		break;
+	case GRID_FLUID_CELLS:
+		diff = CompareScalars(a_->GetGridFluidCells(), b_->GetGridFluidCells(), tolerances_[field], false);
+		break;
+	default:
+		memset(&diff, 0, sizeof(diff));
+		return diff;
+	}
+	if (!same_grid) {
+		diff.size_mismatch = true;
+	}
+	return diff;
+}
+
+SimulationDiff::FieldDiff SimulationDiff::CompareVectors(const std::vector<glm::vec3>* a, const std::vector<glm::vec3>* b, float tolerance, bool grid) const
+{
+	ErrorSum sum;
+	if (a == nullptr || b == nullptr) {
+		// Nothing to compare, e.g. a GPU readback that failed
+		sum.diff.compared = a != nullptr || b != nullptr;
+		sum.diff.size_mismatch = true;
+		return sum.Finish();
+	}
+	if (!grid) {
+		sum.diff.size_mismatch = a->size() != b->size();
+		unsigned int count = (unsigned int)std::min(a->size(), b->size());
+		for (unsigned int i = 0; i < count; i++) {
+			for (int c = 0; c < 3; c++) {
+				sum.Add((*a)[i][c], (*b)[i][c], tolerance);
+			}
+		}
+		return sum.Finish();
+	}
+
+	// Grid velocities are (n + 1)^3 long but only hold the faces of the n^3 cells,
+	// at x * n^2 + y * n + z (see GetVelocityFrom3DGridCell())
+	unsigned int n = std::min(a_->GetGridDimensions(), b_->GetGridDimensions());
+	if (a->size() < n * n * n || b->size() < n * n * n) {
+		sum.diff.size_mismatch = true;
+		return sum.Finish();
+	}
+	for (unsigned int i = 0; i < n * n * n; i++) {
+		for (int c = 0; c < 3; c++) {
+			sum.Add((*a)[i][c], (*b)[i][c], tolerance);
+		}
+	}
+	return sum.Finish();
+}
+
+SimulationDiff::FieldDiff SimulationDiff::CompareScalars(const std::vector<float>* a, const std::vector<float>* b, float tolerance, bool interior_only) const
+{
+	ErrorSum sum;
+	if (a == nullptr || b == nullptr) {
+		sum.diff.compared = a != nullptr || b != nullptr;
+		sum.diff.size_mismatch = true;
+		return sum.Finish();
+	}
+	unsigned int n = std::min(a_->GetGridDimensions(), b_->GetGridDimensions());
+	if (a->size() < n * n * n || b->size() < n * n * n) {
+		sum.diff.size_mismatch = true;
+		return sum.Finish();
+	}
+	unsigned int border = interior_only ? 1 : 0;
+	for (unsigned int x = border; x + border < n; x++) {
+		for (unsigned int y = border; y + border < n; y++) {
+			for (unsigned int z = border; z + border < n; z++) {
+				unsigned int i = x * n * n + y * n + z;
+				sum.Add((*a)[i], (*b)[i], tolerance);
+			}
+		}
+	}
+	return sum.Finish();
+}
+
+std::vector<float> SimulationDiff::ComputeDivergence(Simulation* sim) const
+{
+	std::vector<float> divergence;
+	std::vector<glm::vec3>* velocities = sim->GetGridVelocities();
+	unsigned int n = sim->GetGridDimensions();
+	if (velocities == nullptr || velocities->size() < n * n * n) {
+		return divergence;
+	}
+	divergence.assign(n * n * n, 0.0f);
+	for (unsigned int x = 1; x + 1 < n; x++) {
+		for (unsigned int y = 1; y + 1 < n; y++) {
+			for (unsigned int z = 1; z + 1 < n; z++) {
+				divergence[x * n * n + y * n + z] = GetDivergence(*velocities, n, x, y, z);
+			}
+		}
+	}
+	return divergence;
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+SimulationDiff::SimulationDiff(Simulation* a, Simulation* b) : a_(a), b_(b), step_(0)
+{
+	tolerances_[PARTICLE_POSITIONS] = 2.0f / 1000.0f;
+	tolerances_[PARTICLE_VELOCITIES] = 2.0f / 1000.0f;
+	tolerances_[GRID_VELOCITIES] = 2.0f / 1000.0f;
+	tolerances_[GRID_DIVERGENCE] = 6.0f / 1000.0f;
+	tolerances_[GRID_PRESSURES] = 1.0f / 1000.0f;
+	tolerances_[GRID_FLUID_CELLS] = 0.0f;
+
+	GPU_Simulation* gpu_a = dynamic_cast<GPU_Simulation*>(a_);
+	GPU_Simulation* gpu_b = dynamic_cast<GPU_Simulation*>(b_);
+	if (gpu_a != nullptr) {
+		gpu_a->SetBlockingReadback(true);
+	}
+	if (gpu_b != nullptr) {
+		gpu_b->SetBlockingReadback(true);
+	}
+}
+
+void SimulationDiff::SetTolerance(Field field, float tolerance)
+{
+	tolerances_[field] = tolerance;
+}
+
+float SimulationDiff::GetTolerance(Field field) const
+{
+	return tolerances_[field];
+}
+
+bool SimulationDiff::SetInitialState(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval)
+{
+	reports_.clear();
+	step_ = 0;
+	a_->SetInitialVelocities(initial, lower_bound, upper_bound, interval);
+	b_->SetInitialVelocities(initial, lower_bound, upper_bound, interval);
+	return Compare(-1, k_initial_fields);
+}
+
+bool SimulationDiff::Step(float delta)
+{
+	++step_;
+	if (!a_->SupportsStepPhases() || !b_->SupportsStepPhases()) {
+		a_->TimeStep(delta);
+		b_->TimeStep(delta);
+		return Compare(-1, k_all_fields);
+	}
+
+	bool passed = true;
+	for (int phase = 0; phase < Simulation::NUM_STEP_PHASES; phase++) {
+		a_->TimeStepPhase((Simulation::StepPhase)phase, delta);
+		b_->TimeStepPhase((Simulation::StepPhase)phase, delta);
+		passed &= Compare(phase, k_phase_fields[phase]);
+	}
+	return passed;
+}
+
+bool SimulationDiff::Run(int steps, float delta)
+{
+	bool passed = true;
+	for (int i = 0; i < steps; i++) {
+		passed &= Step(delta);
+	}
+	return passed;
+}
+
+const std::vector<SimulationDiff::Report>& SimulationDiff::GetReports() const
+{
+	return reports_;
+}
+
+void SimulationDiff::PrintReport() const
+{
+	const Report* first_failure = nullptr;
+	for (const Report& report : reports_) {
+		const char* phase = report.phase >= 0 ? k_phase_names[report.phase] : (report.step == 0 ? "initial" : "step");
+		for (int field = 0; field < NUM_FIELDS; field++) {
+			const FieldDiff& diff = report.fields[field];
+			if (!diff.compared) {
+				continue;
+			}
+			if (diff.size_mismatch && diff.count == 0) {
+				printf("diff step %d %s %s: not comparable\n", report.step, phase, k_field_names[field]);
+				continue;
+			}
+			printf("diff step %d %s %s: max %.6f rms %.6f over %u/%u%s%s\n", report.step, phase, k_field_names[field],
+				diff.max_error, diff.rms_error, diff.over_tolerance, diff.count,
+				diff.size_mismatch ? " (size mismatch)" : "", diff.over_tolerance > 0 || diff.size_mismatch ? " FAIL" : "");
+		}
+		if (!report.passed && first_failure == nullptr) {
+			first_failure = &report;
+		}
+	}
+
+	if (first_failure == nullptr) {
+		printf("diff passed (%d steps)\n", step_);
+		return;
+	}
+	const char* phase = first_failure->phase >= 0 ? k_phase_names[first_failure->phase] : (first_failure->step == 0 ? "initial" : "step");
+	printf("diff failed, first at step %d (%s):", first_failure->step, phase);
+	for (int field = 0; field < NUM_FIELDS; field++) {
+		const FieldDiff& diff = first_failure->fields[field];
+		if (diff.compared && (diff.size_mismatch || diff.over_tolerance > 0)) {
+			printf(" %s", k_field_names[field]);
+		}
+	}
+	printf("\n");
+}
+
+const char* SimulationDiff::GetFieldName(Field field)
+{
+	return field >= 0 && field < NUM_FIELDS ? k_field_names[field] : "unknown";
+}
+
+bool SimulationDiff::GetFieldByName(const char* name, Field& field)
+{
+	for (int i = 0; i < NUM_FIELDS; i++) {
+		if (strcmp(name, k_field_names[i]) == 0) {
+			field = (Field)i;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,148 @@
+#ifndef SIMULATION_DIFF_H
+#define SIMULATION_DIFF_H
+
+#include "sequential_simulation.hpp"
+
+#include <vector>
+
+/*
+* @brief
+* Runs two simulations side by side from the same initial state and compares
+* what they expose through the Simulation interface after every step, so that
+* an optimization which changes the results does not go unnoticed.
+*
+* When both simulations support step phases (Simulation::SupportsStepPhases()),
+* they are compared after every phase, which points at the kernel that made them
+* drift apart: positions and transferred grid velocities after TRANSFER_TO_GRID,
+* projected grid velocities, divergence and pressure after PRESSURE_PROJECTION,
+* and particle velocities after TRANSFER_TO_PARTICLES. Otherwise every field
+* is compared once the whole step is done.
+*
+* The simulations are not owned. GPU simulations are switched to blocking
+* readback, since comparing against stale data is meaningless.
+*/
+class SimulationDiff {
+public:
+	enum Field {
+		PARTICLE_POSITIONS,
+		PARTICLE_VELOCITIES,
+		GRID_VELOCITIES,
+		GRID_DIVERGENCE,
+		GRID_PRESSURES,
+		GRID_FLUID_CELLS,
+		NUM_FIELDS
+	};
+
+	/*
+	* @brief
+	* How far apart one field of the two simulations is. Vectors are compared
+	* per component, grid fields only on the cells both simulations report.
+	*/
+	struct FieldDiff {
+		bool compared;
+		bool size_mismatch;
+		float max_error;
+		float rms_error;
+		unsigned int over_tolerance;
+		unsigned int count;
+	};
+
+	/*
+	* @brief
+	* The comparison made after one phase of one step. step is 0 for the initial
+	* state, phase is -1 when the whole step was run at once (or for the initial state).
+	*/
+	struct Report {
+		int step;
+		int phase;
+		FieldDiff fields[NUM_FIELDS];
+		bool passed;
+	};
+
+private:
+	Simulation* a_;
+	Simulation* b_;
+	float tolerances_[NUM_FIELDS];
+	std::vector<Report> reports_;
+	int step_;
+
+	/*
+	* @brief
+	* Compares the fields whose bit is set in field_mask and records the result.
+	*
+	* @return
+	* Returns true if all of them are within their tolerance.
+	*/
+	bool Compare(int phase, unsigned int field_mask);
+	FieldDiff CompareField(Field field);
+	FieldDiff CompareVectors(const std::vector<glm::vec3>* a, const std::vector<glm::vec3>* b, float tolerance, bool grid) const;
+	FieldDiff CompareScalars(const std::vector<float>* a, const std::vector<float>* b, float tolerance, bool interior_only) const;
+
+	/*
+	* @brief
+	* The divergence of every cell from the grid velocities of a simulation,
+	* in the layout of SequentialGridBased. Only the inside of the solid border is filled.
+	*/
+	std::vector<float> ComputeDivergence(Simulation* sim) const;
+
+public:
+	SimulationDiff(Simulation* a, Simulation* b);
+
+	/*
+	* @brief
+	* The largest difference of a field that still passes. The defaults allow
+	* a couple of units of the GPU's fixed point precision (1 / 1000).
+	*/
+	void SetTolerance(Field field, float tolerance);
+	float GetTolerance(Field field) const;
+
+	/*
+	* @brief
+	* Seeds both simulations with SetInitialVelocities() and compares the particles.
+	*
+	* @return
+	* Returns true if the initial states match.
+	*/
+	bool SetInitialState(const std::vector<glm::vec3>& initial, glm::vec3 lower_bound, glm::vec3 upper_bound, float interval);
+
+	/*
+	* @brief
+	* Advances both simulations by one step, comparing them after every phase
+	* when possible.
+	*
+	* @return
+	* Returns true if every comparison of the step passed.
+	*/
+	bool Step(float delta);
+
+	/*
+	* @brief
+	* Runs Step() steps times. Keeps going after a failure so that the report
+	* shows whether the difference grows.
+	*
+	* @return
+	* Returns true if every step passed.
+	*/
+	bool Run(int steps, float delta);
+
+	const std::vector<Report>& GetReports() const;
+
+	/*
+	* @brief
+	* Prints one line per compared phase and field, then the first failure if any.
+	*/
+	void PrintReport() const;
+
+	static const char* GetFieldName(Field field);
+
+	/*
+	* @brief
+	* Looks a field up by the name GetFieldName() gives it.
+	*
+	* @return
+	* Returns false if there is no field of that name.
+	*/
+	static bool GetFieldByName(const char* name, Field& field);
+};
+
+#endif // !SIMULATION_DIFF_H
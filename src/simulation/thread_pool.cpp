@@ -0,0 +1,120 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+///////////////////////
+///	Private Methods ///
+///////////////////////
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned long long seen_generation = 0;
+	while (true) {
+		Loop loop;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			work_ready_.wait(lock, [&] { return stopping_ || generation_ != seen_generation; });
+			if (stopping_) {
+				return;
+			}
+			seen_generation = generation_;
+			loop = loop_;
+			++workers_busy_;
+		}
+
+		RunChunks(loop);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--workers_busy_;
+			++workers_finished_;
+		}
+		work_done_.notify_all();
+	}
+}
+
+void ThreadPool::RunChunks(const Loop& loop)
+{
+	while (true) {
+		int chunk = next_chunk_.fetch_add(1);
+		if (chunk >= loop.num_chunks) {
+			return;
+		}
+		int begin = chunk * loop.chunk_size;
+		(*loop.body)(begin, std::min(begin + loop.chunk_size, loop.count));
+	}
+}
+
+//////////////////////
+///	Public Methods ///
+//////////////////////
+
+ThreadPool::ThreadPool(unsigned int num_threads) :
+	loop_{ nullptr, 0, 1, 0 },
+	next_chunk_(0),
+	workers_busy_(0),
+	workers_finished_(0),
+	generation_(0),
+	stopping_(false)
+{
+	if (num_threads == 0) {
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// The calling thread takes part in every loop
+	for (unsigned int i = 1; i < num_threads; i++) {
+		workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+	// No loop has run yet, so there is no previous one to wait for
+	workers_finished_ = (int)workers_.size();
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	work_ready_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, int grain, const std::function<void(int begin, int end)>& body)
+{
+	if (count <= 0) {
+		return;
+	}
+	// A few chunks per thread balances uneven work without much contention
+	int target_chunks = (int)GetThreadCount() * 4;
+	int chunk_size = std::max(std::max(grain, 1), (count + target_chunks - 1) / target_chunks);
+	if (workers_.empty() || chunk_size >= count) {
+		body(0, count);
+		return;
+	}
+
+	Loop loop = { &body, count, chunk_size, (count + chunk_size - 1) / chunk_size };
+	{
+		// Workers that woke up late for the previous loop still claim from
+		// next_chunk_, so it must not be reset until they have all left.
+		std::unique_lock<std::mutex> lock(mutex_);
+		work_done_.wait(lock, [&] { return workers_finished_ == (int)workers_.size(); });
+		loop_ = loop;
+		next_chunk_.store(0);
+		workers_finished_ = 0;
+		++generation_;
+	}
+	work_ready_.notify_all();
+
+	RunChunks(loop);
+
+	// Every chunk has been claimed, wait for the workers still running one.
+	// Workers that have not woken up yet find no chunks left and never call body.
+	std::unique_lock<std::mutex> lock(mutex_);
+	work_done_.wait(lock, [&] { return workers_busy_ == 0; });
+}
+
+unsigned int ThreadPool::GetThreadCount() const
+{
+	return (unsigned int)workers_.size() + 1;
+}
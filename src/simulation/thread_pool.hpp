@@ -0,0 +1,79 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* @brief
+* A fixed set of worker threads that run data parallel loops, the CPU
+* counterpart of a compute dispatch. ParallelFor() splits a range into chunks,
+* hands them out to the workers and the calling thread, and returns once every
+* chunk is done, so consecutive calls behave like dispatches separated by a barrier.
+*
+* Only one loop runs at a time. ParallelFor() must not be called from inside
+* a loop body.
+*/
+class ThreadPool {
+private:
+	struct Loop {
+		const std::function<void(int, int)>* body;
+		int count;
+		int chunk_size;
+		int num_chunks;
+	};
+
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable work_ready_;
+	std::condition_variable work_done_;
+
+	/// <summary>
+	/// The loop being run. generation_ changes for every loop so that workers
+	/// know when there is new work, chunks are claimed through next_chunk_.
+	/// Workers copy loop_ when they pick up a generation, and a new loop is only
+	/// published once every worker has finished the previous one.
+	/// </summary>
+	Loop loop_;
+	std::atomic<int> next_chunk_;
+	int workers_busy_;
+	int workers_finished_;
+	unsigned long long generation_;
+	bool stopping_;
+
+	void WorkerLoop();
+	void RunChunks(const Loop& loop);
+
+public:
+	/*
+	* @brief
+	* Starts the workers.
+	*
+	* @param
+	* num_threads: The total number of threads loops run on, including the
+	* calling thread. 0 uses one per hardware thread.
+	*/
+	ThreadPool(unsigned int num_threads = 0);
+	~ThreadPool();
+
+	/*
+	* @brief
+	* Calls body(begin, end) on disjoint ranges covering [0, count) and waits
+	* for all of them.
+	*
+	* @param
+	* count: The number of items.
+	* grain: The smallest number of items handed out at once. Ranges are made
+	* larger than this when there are many items, to keep the overhead low.
+	*/
+	void ParallelFor(int count, int grain, const std::function<void(int begin, int end)>& body);
+
+	unsigned int GetThreadCount() const;
+};
+
+#endif // !THREAD_POOL_H
@@ -1,4 +1,7 @@
 #include "water_particle_renderer.hpp"
+
+#include <cmath>
+#include <utility>
 /*
 * Code taken and modified from 
 * http://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/particles-instancing/
@@ -10,27 +13,19 @@
 
 void WaterParticleRenderer::InitializeParticleRenderingVariables()
 {
+	// No vertex buffers, the sprite shader pulls every particle from the position textures by gl_VertexID
 	glGenVertexArrays(1, &particle_VAO_);
 	glBindVertexArray(particle_VAO_);
 
-	glGenBuffers(1, &particle_billboard_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, particle_billboard_buffer_);
-	glBufferData(GL_ARRAY_BUFFER, kQuadData_.size() * sizeof(glm::vec3), &kQuadData_[0], GL_STATIC_DRAW);
-
-	// The VBO containing the positions of particle uvs into the texture of positions
-	glGenBuffers(1, &particle_index_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, particle_index_buffer_);
-	glBufferData(GL_ARRAY_BUFFER, MAX_NUM_PARTICLES * sizeof(glm::vec2), NULL, GL_STREAM_DRAW);
-
 	// render to texture setup
 	glGenFramebuffers(1, &particle_frame_buffer_id_);
 	glBindFramebuffer(GL_FRAMEBUFFER, particle_frame_buffer_id_);
 
-	GLuint depthrenderbuffer;
-	glGenRenderbuffers(1, &depthrenderbuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthrenderbuffer);
+	glm::ivec2 render_size = GetRenderSize();
+	glGenRenderbuffers(1, &particle_depth_buffer_);
+	glBindRenderbuffer(GL_RENDERBUFFER, particle_depth_buffer_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, render_size.x, render_size.y);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, particle_depth_buffer_);
 
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, depth_texture_.GetTextureId(), 0);
 
@@ -44,38 +39,180 @@ void WaterParticleRenderer::InitializeParticleRenderingVariables()
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void WaterParticleRenderer::InitializeScreenQuadVariables()
+static ShaderDefines GetSmoothingDefines(int tile_size, int filter_radius, bool column_pass)
 {
-	glGenVertexArrays(1, &quad_VAO_);
-	glBindVertexArray(quad_VAO_);
+	ShaderDefines defines;
+	defines["LOCAL_SIZE_X"] = std::to_string(tile_size);
+	defines["LOCAL_SIZE_Y"] = std::to_string(tile_size);
+	defines["FILTER_RADIUS"] = std::to_string(filter_radius);
+	if (column_pass) {
+		defines["COLUMN_PASS"] = "1";
+	}
+	return defines;
+}
 
-	glGenBuffers(1, &quad_position_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, quad_position_buffer_);
-	glBufferData(GL_ARRAY_BUFFER, kQuadData_.size() * sizeof(glm::vec3), &kQuadData_[0], GL_STATIC_DRAW);
+static ShaderDefines GetTemporalDepthDefines(int local_size)
+{
+	ShaderDefines defines;
+	defines["LOCAL_SIZE"] = std::to_string(local_size);
+	return defines;
+}
 
-	glGenBuffers(1, &quad_index_buffer_);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer_);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, kQuadIndices_.size() * sizeof(unsigned short), &kQuadIndices_[0], GL_STATIC_DRAW);
+static ShaderDefines GetNormalsDefines(int tile_size)
+{
+	ShaderDefines defines;
+	defines["TILE_SIZE"] = std::to_string(tile_size);
+	return defines;
+}
 
-	glBindVertexArray(0);
+// The commands (8 values) and room for every tile of the render size
+static GLsizeiptr GetWaterTilesBufferSize(glm::ivec2 render_size, int tile_size)
+{
+	glm::ivec2 tiles = (render_size + tile_size - 1) / tile_size;
+	return (8 + tiles.x * tiles.y) * sizeof(GLuint);
 }
 
 void WaterParticleRenderer::InitializeSmoothingVariables()
 {
-	// Smoothing shader initialization
-	glGenFramebuffers(1, &smoothing_frame_buffer_id_);
-	glBindFramebuffer(GL_FRAMEBUFFER, smoothing_frame_buffer_id_);
+	// Smoothing shader uniforms
+	SetNarrowRangeFilter(narrow_range_filter_);
+	ResizeRenderTargets();
+}
 
-	GLuint depthrenderbuffer;
-	glGenRenderbuffers(1, &depthrenderbuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthrenderbuffer);
+void WaterParticleRenderer::InitializeWaterTileVariables()
+{
+	glGenBuffers(1, &water_tiles_buffer_);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, water_tiles_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GetWaterTilesBufferSize(GetRenderSize(), k_smoothing_tile_size_), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The quad corners come from gl_VertexID, only the tile changes per instance
+	glGenVertexArrays(1, &water_tiles_VAO_);
+	glBindVertexArray(water_tiles_VAO_);
+	glBindBuffer(GL_ARRAY_BUFFER, water_tiles_buffer_);
+	glEnableVertexAttribArray(0);
+	glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 0, (void*)(8 * sizeof(GLuint)));
+	glVertexAttribDivisor(0, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, smoothed_depth_texture_.GetTextureId(), 0);
+	water_shader_.SetUniform1ui("tile_size", k_smoothing_tile_size_);
+	composite_shader_.SetUniform1ui("tile_size", k_smoothing_tile_size_);
+}
 
+void WaterParticleRenderer::InitializeShadingVariables()
+{
+	glGenFramebuffers(1, &shading_frame_buffer_id_);
+	glBindFramebuffer(GL_FRAMEBUFFER, shading_frame_buffer_id_);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shaded_water_texture_.GetTextureId(), 0);
 	GLenum draw_buffers[1] = { GL_COLOR_ATTACHMENT0 };
 	glDrawBuffers(1, draw_buffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fprintf(stderr, "Problem with the water shading framebuffer\n");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////
+// Dynamic Resolution //
+////////////////////////
+
+glm::ivec2 WaterParticleRenderer::GetRenderSize() const
+{
+	glm::ivec2 size = glm::ivec2(viewport_width_, viewport_height_) * render_scale_steps_ / k_render_scale_steps_;
+	return glm::max(size, glm::ivec2(1));
+}
+
+void WaterParticleRenderer::ResizeRenderTargets()
+{
+	// The filter covers the same part of the screen at every scale
+	unsigned int base_radius = k_filter_radius_;
+	if (temporal_smoothing_) {
+		base_radius = k_temporal_filter_radius_;
+	}
+	unsigned int filter_radius = (base_radius * render_scale_steps_ + k_render_scale_steps_ / 2) / k_render_scale_steps_;
+	filter_radius = glm::max(filter_radius, 1u);
+	smooth_rows_shader_.SetUniform1ui("filter_radius", filter_radius);
+	smooth_columns_shader_.SetUniform1ui("filter_radius", filter_radius);
+
+	ResizeShadingTarget();
+
+	glm::ivec2 size = GetRenderSize();
+	if (size == depth_texture_.GetDimensions()) {
+		return;
+	}
+	// New dimensions make new textures, so the depth is attached again
+	depth_texture_.SetNewData(size, nullptr);
+	smoothing_row_sums_texture_.SetNewData(size, nullptr);
+	smoothed_depth_texture_.SetNewData(size, nullptr);
+	normals_texture_.SetNewData(size, nullptr);
+	temporal_depth_texture_a_.SetNewData(size, nullptr);
+	temporal_depth_texture_b_.SetNewData(size, nullptr);
+	depth_history_valid_ = false;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, water_tiles_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GetWaterTilesBufferSize(size, k_smoothing_tile_size_), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, particle_depth_buffer_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, size.x, size.y);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, particle_frame_buffer_id_);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, depth_texture_.GetTextureId(), 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void WaterParticleRenderer::UpdateRenderScale()
+{
+	if (gpu_time_budget_ms_ <= 0.0f || ++frames_since_rescale_ < k_rescale_cooldown_frames_) {
+		return;
+	}
+	float depth_ms = 0.0f;
+	if (!render_scale_timer_.GetLast("depth", depth_ms) || depth_ms <= 0.0f) {
+		return;
+	}
+
+	// The passes cost about the same per pixel, so their time goes with the square of the
+	// scale. The largest scale predicted to stay 10% under the budget fits.
+	float fitting_scale = (float)render_scale_steps_ * sqrtf(0.9f * gpu_time_budget_ms_ / depth_ms);
+	int fitting_steps = (int)floorf(fitting_scale);
+	int steps = render_scale_steps_;
+	if (depth_ms > gpu_time_budget_ms_) {
+		steps = glm::min(fitting_steps, render_scale_steps_ - 1);
+	}
+	else if (fitting_steps > render_scale_steps_) {
+		// Up one step at a time, the estimate is rough for large changes
+		steps = render_scale_steps_ + 1;
+	}
+	steps = glm::clamp(steps, k_min_render_scale_steps_, k_render_scale_steps_);
+	if (steps != render_scale_steps_) {
+		render_scale_steps_ = steps;
+		frames_since_rescale_ = 0;
+		ResizeRenderTargets();
+	}
+}
+
+glm::ivec2 WaterParticleRenderer::GetShadingSize() const
+{
+	glm::ivec2 size = GetRenderSize();
+	if (shading_resolution_ == SHADE_QUARTER) {
+		size = glm::max((size + 1) / 2, glm::ivec2(1));
+	}
+	return size;
+}
+
+bool WaterParticleRenderer::IsShadingBelowScreenResolution() const
+{
+	return shading_resolution_ != SHADE_FULL && GetShadingSize() != glm::ivec2(viewport_width_, viewport_height_);
+}
+
+void WaterParticleRenderer::ResizeShadingTarget()
+{
+	glm::ivec2 size = GetShadingSize();
+	if (size == shaded_water_texture_.GetDimensions()) {
+		return;
+	}
+	shaded_water_texture_.SetNewData(size, nullptr);
+	glBindFramebuffer(GL_FRAMEBUFFER, shading_frame_buffer_id_);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shaded_water_texture_.GetTextureId(), 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
@@ -85,27 +222,43 @@ void WaterParticleRenderer::InitializeSmoothingVariables()
 
 WaterParticleRenderer::WaterParticleRenderer()
 	: particle_shader_("water/particle_sprites.vert", "water/particle_sprites.frag"),
-	particle_billboard_buffer_(0), particle_index_buffer_(0), particle_VAO_(0), 
-	depth_texture_(glm::ivec2(viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_)),
-	quad_VAO_(0), quad_position_buffer_(0),
-	smoothing_shader_("screen_quad.vert", "water/water_smooth_depth.frag"),
-	smoothing_frame_buffer_id_(0), 
-	smoothed_depth_texture_(glm::ivec2(viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_)),
-	water_shader_("screen_quad.vert", "water/water_shader.frag"),
+	particle_VAO_(0),
+	particle_depth_buffer_(0),
+	depth_texture_(GetRenderSize()),
+	smooth_rows_shader_("water/water_smooth_depth.comp", glm::ivec3(1), GetSmoothingDefines(k_smoothing_tile_size_, k_filter_radius_, false)),
+	smooth_columns_shader_("water/water_smooth_depth.comp", glm::ivec3(1), GetSmoothingDefines(k_smoothing_tile_size_, k_filter_radius_, true)),
+	smoothing_row_sums_texture_(GetRenderSize(), StorageType::TEX_FLOAT, ChannelType::RG32F),
+	smoothed_depth_texture_(GetRenderSize()),
+	temporal_depth_shader_("water/water_temporal_depth.comp", glm::ivec3(1), GetTemporalDepthDefines(k_smoothing_tile_size_)),
+	temporal_depth_texture_a_(GetRenderSize(), StorageType::TEX_FLOAT, ChannelType::R32F),
+	temporal_depth_texture_b_(GetRenderSize(), StorageType::TEX_FLOAT, ChannelType::R32F),
+	accumulated_depth_(&temporal_depth_texture_a_), depth_history_(&temporal_depth_texture_b_),
+	history_view_(1.0f), history_proj_(1.0f),
+	water_depth_texture_(&smoothed_depth_texture_),
+	water_tiles_buffer_(0), water_tiles_VAO_(0),
+	normals_shader_("water/water_normals.comp", glm::ivec3(1), GetNormalsDefines(k_smoothing_tile_size_)),
+	normals_texture_(GetRenderSize()),
+	water_shader_("water/water_tiles.vert", "water/water_shader.frag"),
+	shading_frame_buffer_id_(0),
+	shaded_water_texture_(GetShadingSize(), StorageType::TEX_BYTE, ChannelType::RGBA),
+	composite_shader_("water/water_tiles.vert", "water/water_shader.frag", { { "COMPOSITE", "1" } }),
 	camera_(nullptr), skybox_(nullptr), cached_view_(1.0f), cached_proj_(1.0f),
-	tex_pos_x(nullptr), tex_pos_y(nullptr), tex_pos_z(nullptr)
+	tex_pos_x(nullptr), tex_pos_y(nullptr), tex_pos_z(nullptr),
+	profiler_(nullptr)
 {
 	InitializeParticleRenderingVariables();
-	InitializeScreenQuadVariables();
+	InitializeWaterTileVariables();
+	InitializeShadingVariables();
 	InitializeSmoothingVariables();
 
 	water_shader_.SetUniform3fv("diffuse_color", glm::normalize(glm::vec3(-0.1, 0.1, 0.2)));
+	composite_shader_.SetUniform3fv("diffuse_color", glm::normalize(glm::vec3(-0.1, 0.1, 0.2)));
 
 	// Particle shader uniform
 	particle_shader_.SetUniform1fv("particle_radius", 0.05f);
-
-	// Smoothing shader uniforms
-	smoothing_shader_.SetUniform1fv("filter_radius", 9.0);
+	GLfloat point_size_range[2];
+	glGetFloatv(GL_POINT_SIZE_RANGE, point_size_range);
+	particle_shader_.SetUniform1fv("max_point_size", point_size_range[1]);
 }
 
 void WaterParticleRenderer::UpdateParticlePositionsTexture(Texture2D* positions_x, Texture2D* positions_y, Texture2D* positions_z)
@@ -113,30 +266,9 @@ void WaterParticleRenderer::UpdateParticlePositionsTexture(Texture2D* positions_
 	tex_pos_x = positions_x;
 	tex_pos_y = positions_y;
 	tex_pos_z = positions_z;
+	// One sprite per texel, the sprite shader finds its texel from gl_VertexID
 	glm::ivec2 tex_dimensions = positions_x->GetDimensions();
-	int current_particle_count = tex_dimensions.x * tex_dimensions.y;
-	if (current_particle_count != particle_count_)
-	{
-		// We update position indexes only when the size of the texture is different from what we had.
-		// Really, this should only happen once when we first call the method, and not again
-		std::vector<glm::vec2> uvs(current_particle_count);
-		for (int x = 0; x < tex_dimensions.x; x++) 
-		{
-			for (int y = 0; y < tex_dimensions.y; y++) 
-			{
-				uvs[x + y * tex_dimensions.x] = glm::vec2(float(x) / float(tex_dimensions.x), float(y) / float(tex_dimensions.y));
-			}
-		}
-		glBindVertexArray(particle_VAO_);
-		glBindBuffer(GL_ARRAY_BUFFER, particle_index_buffer_);
-		// Buffer orphaning (improves streaming data performance)-> http://www.opengl.org/wiki/Buffer_Object_Streaming
-		glBufferData(GL_ARRAY_BUFFER, MAX_NUM_PARTICLES * sizeof(glm::vec2), NULL, GL_STREAM_DRAW); 
-		glBufferSubData(GL_ARRAY_BUFFER, 0, current_particle_count * sizeof(glm::vec2), (void*) &uvs[0]);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
-	}
-
-	particle_count_ = current_particle_count;
+	particle_count_ = tex_dimensions.x * tex_dimensions.y;
 }
 
 void WaterParticleRenderer::UpdateViewMat(const glm::mat4& view)
@@ -144,10 +276,10 @@ void WaterParticleRenderer::UpdateViewMat(const glm::mat4& view)
 	cached_view_ = view;
 
 	water_shader_.SetUniformMatrix4fv("inv_view", glm::inverse(cached_view_));
+	composite_shader_.SetUniformMatrix4fv("inv_view", glm::inverse(cached_view_));
+	temporal_depth_shader_.SetUniformMatrix4fv("inv_view", glm::inverse(cached_view_));
 
-	particle_shader_.SetUniform3fv("ws_camera_right", { cached_view_[0][0], cached_view_[1][0], cached_view_[2][0] });
-	particle_shader_.SetUniform3fv("ws_camera_up", { cached_view_[0][1], cached_view_[1][1], cached_view_[2][1] });
-	particle_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	particle_shader_.SetUniformMatrix4fv("view", cached_view_);
 
 }
 
@@ -156,9 +288,12 @@ void WaterParticleRenderer::UpdateProjMat(const glm::mat4& proj)
 	cached_proj_ = proj;
 
 	water_shader_.SetUniformMatrix4fv("inv_proj", glm::inverse(cached_proj_));
+	composite_shader_.SetUniformMatrix4fv("inv_proj", glm::inverse(cached_proj_));
+	normals_shader_.SetUniformMatrix4fv("inv_proj", glm::inverse(cached_proj_));
+	temporal_depth_shader_.SetUniformMatrix4fv("inv_proj", glm::inverse(cached_proj_));
 
 	particle_shader_.SetUniformMatrix4fv("proj", cached_proj_);
-	particle_shader_.SetUniformMatrix4fv("proj_view", cached_proj_ * cached_view_);
+	particle_shader_.SetUniformMatrix4fv("inv_proj", glm::inverse(cached_proj_));
 
 }
 
@@ -181,6 +316,74 @@ void WaterParticleRenderer::UpdateTexturePrecision(float texture_precision)
 	particle_shader_.SetUniform1fv("texture_precision", texture_precision);
 }
 
+void WaterParticleRenderer::SetProfiler(GPUProfiler* profiler)
+{
+	profiler_ = profiler;
+}
+
+void WaterParticleRenderer::SetNarrowRangeFilter(bool enabled)
+{
+	narrow_range_filter_ = enabled;
+	float depth_range = enabled ? narrow_range_depth_ : 0.0f;
+	smooth_rows_shader_.SetUniform1fv("depth_range", depth_range);
+	smooth_columns_shader_.SetUniform1fv("depth_range", depth_range);
+}
+
+bool WaterParticleRenderer::GetNarrowRangeFilter() const
+{
+	return narrow_range_filter_;
+}
+
+void WaterParticleRenderer::SetTemporalSmoothing(bool enabled)
+{
+	temporal_smoothing_ = enabled;
+	depth_history_valid_ = false;
+	// For the filter radius
+	ResizeRenderTargets();
+}
+
+bool WaterParticleRenderer::GetTemporalSmoothing() const
+{
+	return temporal_smoothing_;
+}
+
+void WaterParticleRenderer::SetViewportSize(int width, int height)
+{
+	viewport_width_ = width;
+	viewport_height_ = height;
+	ResizeRenderTargets();
+}
+
+void WaterParticleRenderer::SetGPUTimeBudget(float budget_ms)
+{
+	gpu_time_budget_ms_ = budget_ms;
+	frames_since_rescale_ = 0;
+}
+
+void WaterParticleRenderer::SetRenderScale(float scale)
+{
+	int steps = (int)roundf(scale * k_render_scale_steps_);
+	render_scale_steps_ = glm::clamp(steps, k_min_render_scale_steps_, k_render_scale_steps_);
+	frames_since_rescale_ = 0;
+	ResizeRenderTargets();
+}
+
+float WaterParticleRenderer::GetRenderScale() const
+{
+	return (float)render_scale_steps_ / k_render_scale_steps_;
+}
+
+void WaterParticleRenderer::SetShadingResolution(ShadingResolution resolution)
+{
+	shading_resolution_ = resolution;
+	ResizeShadingTarget();
+}
+
+WaterParticleRenderer::ShadingResolution WaterParticleRenderer::GetShadingResolution() const
+{
+	return shading_resolution_;
+}
+
 
 /////////////
 // Drawing //
@@ -188,9 +391,6 @@ void WaterParticleRenderer::UpdateTexturePrecision(float texture_precision)
 
 void WaterParticleRenderer::DrawParticleSprites()
 {
-	// particle_shader_.SetUniformMatrix4fv("view", view_mat);
-
-
 	// set our depth_texture_ as the frame buffer
 	particle_shader_.SetActive();
 	if (tex_pos_x != nullptr) {
@@ -208,85 +408,163 @@ void WaterParticleRenderer::DrawParticleSprites()
 	glBindFramebuffer(GL_FRAMEBUFFER, particle_frame_buffer_id_);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glClearColor(0, 0, 0, 1.0);
-	glViewport(0, 0, viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_);
-	
-	glBindVertexArray(particle_VAO_);
-	// 1st attribute buffer : vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, particle_billboard_buffer_);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-	// 2nd attribute buffer : positions of particles' centers
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, particle_index_buffer_);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glm::ivec2 render_size = depth_texture_.GetDimensions();
+	glViewport(0, 0, render_size.x, render_size.y);
+	particle_shader_.SetUniform2fv("render_size", glm::vec2(render_size));
 
-	// Instance drawing
-	glVertexAttribDivisor(0, 0); // particles vertices : always reuse the same 4 vertices -> 0
-	glVertexAttribDivisor(1, 1); // positions : one per quad (its center)                 -> 1
+	// One point per particle, sized in the vertex shader to cover its sphere
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glBindVertexArray(particle_VAO_);
+	particle_shader_.SetUniform1ui("edge_quads", 0);
+	glDrawArrays(GL_POINTS, 0, particle_count_);
+	// Quads for the particles the points lose to clipping or the point size limit
+	particle_shader_.SetUniform1ui("edge_quads", 1);
 	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particle_count_);
 
 	// Cleanup
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	glDisable(GL_PROGRAM_POINT_SIZE);
 	glBindVertexArray(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void WaterParticleRenderer::SmoothDepthTexture()
 {
-	// Smooth the depth
-	smoothing_shader_.SetActive();
-	smoothing_shader_.SetUniformTexture2D("depth_sampler", depth_texture_, GL_TEXTURE0);
-	glBindFramebuffer(GL_FRAMEBUFFER, smoothing_frame_buffer_id_);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glViewport(0, 0, viewport_width_ / reduce_resolution_factor_, viewport_height_ / reduce_resolution_factor_);
-
-
-	glBindVertexArray(quad_VAO_);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, quad_position_buffer_);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer_);
-	glDrawElements(GL_TRIANGLES, kQuadIndices_.size(), GL_UNSIGNED_SHORT, 0);
+	// Smooth the depth, each pass reads 2 * k_filter_radius_ + 1 texels per pixel
+	glm::ivec2 size = depth_texture_.GetDimensions();
+	glm::ivec3 work_groups((size + k_smoothing_tile_size_ - 1) / k_smoothing_tile_size_, 1);
+
+	smooth_rows_shader_.SetActive();
+	smooth_rows_shader_.SetUniformTexture2D("depth_sampler", depth_texture_, GL_TEXTURE0);
+	smoothing_row_sums_texture_.BindImageTexture(0);
+	smooth_rows_shader_.Dispatch(work_groups);
+	smooth_rows_shader_.Barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	// Empty the tile list, the column pass adds the tiles with water. 6 vertices per tile
+	// are drawn, and the y and z counts of the dispatch stay 1.
+	GLuint tile_commands[8] = { 6, 0, 0, 0, 0, 1, 1, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, water_tiles_buffer_);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(tile_commands), tile_commands);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	smooth_columns_shader_.SetActive();
+	smooth_columns_shader_.SetUniformTexture2D("depth_sampler", depth_texture_, GL_TEXTURE0);
+	smoothing_row_sums_texture_.BindImageTexture(0);
+	smoothed_depth_texture_.BindImageTexture(1);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, water_tiles_buffer_);
+	smooth_columns_shader_.Dispatch(work_groups);
+	// The normals and DrawWater() sample the result, and the tile list is read as
+	// commands and instanced attributes
+	smooth_columns_shader_.Barrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT
+		| GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
 
-	glDisableVertexAttribArray(0);
-	glBindVertexArray(0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void WaterParticleRenderer::AccumulateDepth()
+{
+	std::swap(accumulated_depth_, depth_history_);
+	glm::ivec2 size = smoothed_depth_texture_.GetDimensions();
+
+	temporal_depth_shader_.SetActive();
+	temporal_depth_shader_.SetUniformTexture2D("depth_sampler", smoothed_depth_texture_, GL_TEXTURE0);
+	temporal_depth_shader_.SetUniformTexture2D("history_sampler", *depth_history_, GL_TEXTURE1);
+	temporal_depth_shader_.SetUniform1ui("history_valid", depth_history_valid_ ? 1u : 0u);
+	temporal_depth_shader_.SetUniformMatrix4fv("history_view", history_view_);
+	temporal_depth_shader_.SetUniformMatrix4fv("history_proj", history_proj_);
+	accumulated_depth_->BindImageTexture(0);
+	temporal_depth_shader_.Dispatch(glm::ivec3((size + k_smoothing_tile_size_ - 1) / k_smoothing_tile_size_, 1));
+	// The normals and DrawWater() sample the result, and the next frame samples it as the history
+	temporal_depth_shader_.Barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	history_view_ = cached_view_;
+	history_proj_ = cached_proj_;
+	depth_history_valid_ = true;
 }
 
-void WaterParticleRenderer::DrawWater(glm::vec3& light_dir)
+void WaterParticleRenderer::ComputeNormals()
 {
-	water_shader_.SetActive();
+	normals_shader_.SetActive();
+	normals_shader_.SetUniformTexture2D("depth_sampler", *water_depth_texture_, GL_TEXTURE0);
+	normals_texture_.BindImageTexture(0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, water_tiles_buffer_);
+	// One work group per tile with water, from the dispatch command of the list
+	normals_shader_.DispatchIndirect(water_tiles_buffer_, 4 * sizeof(GLuint));
+	// DrawWater() samples the result
+	normals_shader_.Barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
 
-	water_shader_.SetUniformTexture2D("depth_tex", smoothed_depth_texture_, GL_TEXTURE0);
-	smoothed_depth_texture_.ActiveBind(GL_TEXTURE0);
+void WaterParticleRenderer::SetWaterUniforms(Shader& shader, const glm::vec3& light_dir)
+{
+	shader.SetUniformTexture2D("depth_tex", *water_depth_texture_, GL_TEXTURE0);
+	shader.SetUniformTexture2D("normal_tex", normals_texture_, GL_TEXTURE2);
+	shader.SetUniform2fv("render_size", glm::vec2(water_depth_texture_->GetDimensions()));
 	if (skybox_ != nullptr) {
-		water_shader_.SetUniformTexture2D("skybox", *skybox_, GL_TEXTURE1);
-		skybox_->ActiveBind(GL_TEXTURE1);
+		shader.SetUniformTexture2D("skybox", *skybox_, GL_TEXTURE1);
 	}
 	if (camera_ != nullptr) {
-		water_shader_.SetUniform3fv("ws_cam_pos", camera_->GetPosition());
+		shader.SetUniform3fv("ws_cam_pos", camera_->GetPosition());
 	}
 
-	water_shader_.SetUniform3fv("ws_light_dir", light_dir);
+	shader.SetUniform3fv("ws_light_dir", light_dir);
+}
 
-	glViewport(0, 0, viewport_width_, viewport_height_);
+void WaterParticleRenderer::DrawWater(const glm::vec3& light_dir)
+{
+	// One quad per tile with water, from the draw command of the list
+	glBindVertexArray(water_tiles_VAO_);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, water_tiles_buffer_);
 
-	glBindVertexArray(quad_VAO_);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, quad_position_buffer_);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer_);
-	glDrawElements(GL_TRIANGLES, kQuadIndices_.size(), GL_UNSIGNED_SHORT, 0);
-	glDisableVertexAttribArray(0);
+	water_shader_.SetActive();
+	SetWaterUniforms(water_shader_, light_dir);
+	bool composite = IsShadingBelowScreenResolution();
+	if (composite) {
+		glm::ivec2 shading_size = shaded_water_texture_.GetDimensions();
+		glBindFramebuffer(GL_FRAMEBUFFER, shading_frame_buffer_id_);
+		glViewport(0, 0, shading_size.x, shading_size.y);
+	}
+	else {
+		glViewport(0, 0, viewport_width_, viewport_height_);
+	}
+	glDrawArraysIndirect(GL_TRIANGLES, (void*)0);
+
+	if (composite) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, viewport_width_, viewport_height_);
+		composite_shader_.SetActive();
+		SetWaterUniforms(composite_shader_, light_dir);
+		composite_shader_.SetUniformTexture2D("shaded_water", shaded_water_texture_, GL_TEXTURE3);
+		glDrawArraysIndirect(GL_TRIANGLES, (void*)0);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
 void WaterParticleRenderer::Draw()
 {
-	DrawParticleSprites();
-	SmoothDepthTexture();
-	DrawWater(glm::normalize(glm::vec3(0.4, -0.8, -0.4)));
-
+	render_scale_timer_.BeginFrame();
+	UpdateRenderScale();
+	{
+		GPUProfiler::Scope depth_scope(&render_scale_timer_, "depth");
+		{
+			GPUProfiler::Scope scope(profiler_, "particle sprites");
+			DrawParticleSprites();
+		}
+		{
+			GPUProfiler::Scope scope(profiler_, "smooth depth");
+			SmoothDepthTexture();
+		}
+		water_depth_texture_ = &smoothed_depth_texture_;
+		if (temporal_smoothing_) {
+			GPUProfiler::Scope scope(profiler_, "temporal depth");
+			AccumulateDepth();
+			water_depth_texture_ = accumulated_depth_;
+		}
+		{
+			GPUProfiler::Scope scope(profiler_, "water normals");
+			ComputeNormals();
+		}
+	}
+	{
+		GPUProfiler::Scope scope(profiler_, "water shading");
+		DrawWater(glm::normalize(glm::vec3(0.4, -0.8, -0.4)));
+	}
 }
\ No newline at end of file
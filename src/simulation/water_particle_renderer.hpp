@@ -6,16 +6,17 @@
 #include <glad/glad.h>
 #include "../rendering/texture.hpp"
 #include "../rendering/shader.hpp"
+#include "../rendering/compute_shader.hpp"
 #include "../rendering/camera.hpp"
 #include "../rendering/skybox.hpp"
-
-#define MAX_NUM_PARTICLES (1024 * 512)
+#include "../rendering/gpu_profiler.hpp"
 
 /*
 * 
 * The pic flip renderer uses the following steps in the rendering process.
-*	1. Render each particle position as a sprite of a certain radius.
-*	   Output this particle rendering's depth to a texture.
+*	1. Render each particle position as a point sprite of a certain radius.
+*	   Particles the points would lose at the screen edges are drawn as quads.
+*	   Output the depth of the sphere under each pixel to a texture.
 * 
 *	2. Smooth the depth texture using bilaterial filtering, (to have edges hold better).
 * 
@@ -23,60 +24,124 @@
 * 
 */
 class WaterParticleRenderer {
-private:
-	std::vector<glm::vec3> kQuadData_ = {
-		{ -1.0f, -1.0f, 0.0f},
-		{ 1.0f, -1.0f, 0.0f},
-		{ -1.0f, 1.0f, 0.0f},
-		{ 1.0f, 1.0f, 0.0f},
-	};
-
-	std::vector<unsigned short> kQuadIndices_ = {
-		0, 1, 2, 2, 1, 3
+public:
+	// The resolution the water is shaded at (see SetShadingResolution())
+	enum ShadingResolution {
+		SHADE_FULL,    // Every screen pixel
+		SHADE_DEPTH,   // Every depth texel, at the render scale
+		SHADE_QUARTER, // Every 2x2 depth texels
 	};
 
+private:
 	int viewport_width_ = 1024;
 	int viewport_height_ = 768;
-	int reduce_resolution_factor_ = 2;
+
+	////////////////////////
+	// Dynamic Resolution //
+	////////////////////////
+	// The particle depth and its smoothing are rendered at a fraction of the viewport,
+	// in steps of 1 / k_render_scale_steps_. Every frame the GPU time of those passes
+	// is checked against the budget and the fraction moved to the largest that fits.
+	static const int k_render_scale_steps_ = 8;
+	static const int k_min_render_scale_steps_ = 2;
+	// Results arrive a few frames late, so a new scale is given this many frames to show up
+	static const int k_rescale_cooldown_frames_ = 8;
+	int render_scale_steps_ = 4;
+	float gpu_time_budget_ms_ = 4.0f;
+	int frames_since_rescale_ = 0;
+	// Always on (unlike profiler_), times the passes the scale applies to
+	GPUProfiler render_scale_timer_;
+	glm::ivec2 GetRenderSize() const;
+	void ResizeRenderTargets();
+	void UpdateRenderScale();
 
 	///////////////////////////////
 	// Particle Sprite Rendering //
 	///////////////////////////////
 	void InitializeParticleRenderingVariables();
+	// Empty, particles are drawn as points (and edge quads) pulled from the position textures by id
 	GLuint particle_VAO_;
-	GLuint particle_billboard_buffer_;
-	GLuint particle_index_buffer_;
 	Shader particle_shader_;
 	int particle_count_ = 0;
 	float particle_radius_ = 0.1f;
 	// We render depth to this image, nothing gets rendered to the screen on the first pass.
 	GLuint particle_frame_buffer_id_;
+	GLuint particle_depth_buffer_;
 	Texture2D depth_texture_;
-	
-	// We will be rendering using textures rather than real model vertex data, 
-	// so use a simple screen-space quad for future passes
-	void InitializeScreenQuadVariables();
-	GLuint quad_VAO_;
-	GLuint quad_position_buffer_;
-	GLuint quad_index_buffer_;
 	void DrawParticleSprites();
 
 
 	//////////////////////
 	// Smoothing Shader //
 	//////////////////////
-	// We now smooth the rendered textures
+	// We now smooth the rendered textures, one compute pass along the rows
+	// and one along the columns (see water_smooth_depth.comp)
 	void InitializeSmoothingVariables();
-	Shader smoothing_shader_;
-	GLuint smoothing_frame_buffer_id_;
+	// In viewport pixels, the radius in texels goes with the render scale
+	static const int k_filter_radius_ = 18;
+	// The smoothing work groups are k_smoothing_tile_size_^2 pixels
+	static const int k_smoothing_tile_size_ = 16;
+	ComputeShader smooth_rows_shader_;
+	ComputeShader smooth_columns_shader_;
+	// The sum and count of the water depths along the row of every filter window
+	Texture2D smoothing_row_sums_texture_;
 	Texture2D smoothed_depth_texture_;
+	// Depths further apart than this are not averaged when the narrow-range filter is on
+	float narrow_range_depth_ = 0.2f;
+	bool narrow_range_filter_ = false;
 	void SmoothDepthTexture();
 
+	// The smoothed depth of the last frame is reprojected into this one and blended in
+	// (see water_temporal_depth.comp), which lets the spatial filter use a smaller radius.
+	// Much smaller than k_filter_radius_ shows, the filter also grows the water by its radius.
+	static const int k_temporal_filter_radius_ = 15;
+	bool temporal_smoothing_ = true;
+	ComputeShader temporal_depth_shader_;
+	// Swapped every frame, the accumulated depth of one frame is the history of the next
+	Texture2D temporal_depth_texture_a_;
+	Texture2D temporal_depth_texture_b_;
+	Texture2D* accumulated_depth_;
+	Texture2D* depth_history_;
+	// False until there is a last frame at the current size
+	bool depth_history_valid_ = false;
+	glm::mat4 history_view_;
+	glm::mat4 history_proj_;
+	void AccumulateDepth();
+	// What the passes after the smoothing read: accumulated_depth_, or the smoothed
+	// depth when the temporal smoothing is off
+	Texture2D* water_depth_texture_;
+
 	//////////////////
 	// Water Shader //
 	//////////////////
+	// Only the smoothing tiles with water in them are shaded. The column pass of the
+	// smoothing lists them on the GPU, the normal pass runs one work group and the
+	// water shader one quad per listed tile, both from indirect commands read off
+	// the list (see water_smooth_depth.comp).
+	void InitializeWaterTileVariables();
+	// The draw command, then the dispatch command, then the tiles
+	GLuint water_tiles_buffer_;
+	// Feeds the tiles of water_tiles_buffer_ as one instanced attribute
+	GLuint water_tiles_VAO_;
+	ComputeShader normals_shader_;
+	// View space normals of the water, one per depth texel (see water_normals.comp)
+	Texture2D normals_texture_;
+	void ComputeNormals();
 	Shader water_shader_;
-	void DrawWater(glm::vec3& light_dir);
+	void SetWaterUniforms(Shader& shader, const glm::vec3& light_dir);
+	void DrawWater(const glm::vec3& light_dir);
+
+	// Below screen resolution the water is shaded into shaded_water_texture_, and
+	// composite_shader_ upsamples it onto the screen, only between texels close in
+	// depth. Pixels with no such texel are shaded by composite_shader_ directly.
+	ShadingResolution shading_resolution_ = SHADE_DEPTH;
+	void InitializeShadingVariables();
+	GLuint shading_frame_buffer_id_;
+	Texture2D shaded_water_texture_;
+	Shader composite_shader_;
+	glm::ivec2 GetShadingSize() const;
+	bool IsShadingBelowScreenResolution() const;
+	void ResizeShadingTarget();
 
 	// TODO: Add references to the scene elements (camera, skybox) and only update uniforms when they change
 	// Will be far more efficient than updating on every draw frame
@@ -88,6 +153,9 @@ private:
 	Texture2D* tex_pos_y;
 	Texture2D* tex_pos_z;
 
+	// Times the passes of Draw() when set. Not owned.
+	GPUProfiler* profiler_;
+
 public:
 	WaterParticleRenderer();
 
@@ -98,6 +166,75 @@ public:
 	void UpdateSkybox(Skybox* skybox);
 	void UpdateCamera(Camera* camera);
 	void UpdateTexturePrecision(float texture_precision);
+	void SetProfiler(GPUProfiler* profiler);
+
+	/*
+	* @brief
+	* Switches the depth smoothing between averaging every water depth around a
+	* pixel (the default) and a narrow-range filter, which leaves out the depths
+	* too far in front of or behind the pixel. The narrow range keeps the edges
+	* of water in front of other water sharp.
+	*
+	* @param
+	* enabled: True for the narrow-range filter.
+	*/
+	void SetNarrowRangeFilter(bool enabled);
+	bool GetNarrowRangeFilter() const;
+
+	/*
+	* @brief
+	* Switches the temporal accumulation of the smoothed depth. When on (the default),
+	* the depth of the last frame is reprojected with its camera and blended with the
+	* depth of this frame wherever it shows the same surface, and the spatial filter
+	* runs at a smaller radius.
+	*
+	* @param
+	* enabled: True to accumulate the depth over frames.
+	*/
+	void SetTemporalSmoothing(bool enabled);
+	bool GetTemporalSmoothing() const;
+
+	/*
+	* @brief
+	* Resizes the render targets for a new viewport, such as after the window is resized.
+	*/
+	void SetViewportSize(int width, int height);
+
+	/*
+	* @brief
+	* Sets the GPU time the particle depth and smoothing passes may take each frame.
+	* Their resolution is scaled between a quarter of the viewport and all of it to
+	* stay within the budget. The water shading resolution follows the depth unless
+	* it is SHADE_FULL (see SetShadingResolution()).
+	*
+	* @param
+	* budget_ms: The time in milliseconds. 0 turns the dynamic resolution off and
+	* keeps the current scale.
+	*/
+	void SetGPUTimeBudget(float budget_ms);
+
+	/*
+	* @brief
+	* Sets the fraction of the viewport resolution the depth is rendered at, rounded
+	* to the nearest eighth. With a GPU time budget, the scale keeps adapting from here.
+	*/
+	void SetRenderScale(float scale);
+	float GetRenderScale() const;
+
+	/*
+	* @brief
+	* Sets the resolution the reflection and refraction of the water are shaded at.
+	* SHADE_DEPTH (the default) shades once per texel of the smoothed depth, so the
+	* shading cost follows the render scale. SHADE_QUARTER shades a quarter of those
+	* texels, which holds up for distant water where a texel covers little of the
+	* surface detail. Both are upsampled to the screen without blending across
+	* depth edges.
+	*
+	* @param
+	* resolution: SHADE_FULL shades every screen pixel, as the water always was.
+	*/
+	void SetShadingResolution(ShadingResolution resolution);
+	ShadingResolution GetShadingResolution() const;
 	void Draw();
 
 };